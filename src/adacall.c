@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adacall.h"
+#include "adamod.h"
+#include "replay.h"
+#include "timer.h"
+#include "trace.h"
+
+/* Initial and maximal delay between attempts to open database. */
+#define OPEN_DELAY_USEC 50000
+#define OPEN_DELAY_MAX_USEC 5000000
+/* Maximal number of databases opened by process. */
+#define SESSIONS_MAX 4
+/* Maximal length of options of opened database. */
+#define SESSION_OPTIONS_MAX 64
+
+/* Database opened by process with its options, so it can be reopened. */
+struct Session {
+	int db_id;
+	char db_options[SESSION_OPTIONS_MAX];
+};
+
+void backoff_sleep(uint64_t *delay_usec);
+void session_save(int db_id, const char *db_options);
+
+/* Duration of last Adabas direct call. */
+static uint64_t call_usec = 0;
+
+/* Opened databases. */
+static struct Session sessions[SESSIONS_MAX];
+static int session_count = 0;
+/* Session was lost by failed command and not reopened yet. */
+static int lost_flag = 0;
+
+/* Statistics of reopened sessions and slow calls. */
+static unsigned long reopened_sessions = 0;
+static unsigned long slow_calls = 0;
+static uint64_t slowest_usec = 0;
+
+/*
+ * Prepare Adabas extended control block for command.
+ */
+void acbx_init(ACBX *acbx, const char *cmd_code, int db_id, int file_no)
+{
+	memset(acbx, 0, sizeof(ACBX));
+	acbx->acbxver[0] = 'F';
+	acbx->acbxver[1] = '2';
+	acbx->acbxlen = sizeof(ACBX);
+	acbx->acbxcmd[0] = cmd_code[0];
+	acbx->acbxcmd[1] = cmd_code[1];
+	acbx->acbxdbid = db_id;
+	acbx->acbxfnr = file_no;
+}
+
+/*
+ * Prepare Adabas buffer description.
+ */
+void abd_init(ABD *abd, char abd_id, void *buf, uint32_t buf_size,
+	uint32_t send_len)
+{
+	memset(abd, 0, sizeof(ABD));
+	abd->abdlen = sizeof(ABD);
+	abd->abdver[0] = 'G';
+	abd->abdver[1] = '2';
+	abd->abdid = abd_id;
+	/* Buffer is located in user memory (indirect addressing). */
+	abd->abdloc = 'I';
+	abd->abdsize = buf_size;
+	abd->abdsend = send_len;
+	abd->abdaddr = buf;
+}
+
+/*
+ * Execute Adabas direct call with extended control block. This is
+ * the only place where Adabas is called, so every call is timed,
+ * traced, recorded or replayed here.
+ */
+int adabas_call(ACBX *acbx, int abd_count, ABD **abds)
+{
+	uint64_t start_usec = timer_usec();
+	uint32_t hash = call_hash(acbx, abd_count, abds);
+
+	if (replay_enabled()) {
+		replay_call(acbx, abd_count, abds, hash);
+	} else {
+		adabasx(acbx, abd_count, abds);
+	}
+	call_usec = timer_usec() - start_usec;
+	record_call(acbx, abd_count, abds, hash, call_usec);
+	trace_call((const char *) acbx->acbxcmd, acbx->acbxrsp, acbx->acbxisn,
+		start_usec, start_usec + call_usec);
+
+	/* Calls exceeding latency threshold are flagged by watchdog. */
+	if (options.watchdog_time > 0
+		&& call_usec > (uint64_t) options.watchdog_time * 1000)
+	{
+		slow_calls++;
+		if (call_usec > slowest_usec) {
+			slowest_usec = call_usec;
+		}
+		if (options.verbose_level > 0) {
+			fprintf(stderr, "\rSlow Adabas call %c%c: %lu ms, "
+				"response %d\n", acbx->acbxcmd[0], acbx->acbxcmd[1],
+				(unsigned long) (call_usec / 1000), (int) acbx->acbxrsp);
+		}
+		trace_span("slow call", "watchdog", start_usec,
+			start_usec + call_usec);
+	}
+
+	/*
+	 * Session is lost when nucleus has gone or transaction of session
+	 * was backed out (e.g. after timeout of user).
+	 */
+	if (acbx->acbxcmd[0] != 'O' && (acbx->acbxrsp == ADA_NOT_ACTIVE
+		|| acbx->acbxrsp == ADA_TABT))
+	{
+		lost_flag = 1;
+	}
+
+	return acbx->acbxrsp;
+}
+
+/*
+ * Get duration of last Adabas direct call in microseconds.
+ */
+uint64_t adabas_call_usec(void)
+{
+	return call_usec;
+}
+
+/*
+ * Get number of records returned in multi-fetch buffer. Multi-fetch
+ * buffer contains number of records followed by entry for every
+ * record, all values in native byte order.
+ */
+uint32_t multifetch_count(const unsigned char *buf)
+{
+	uint32_t count;
+
+	memcpy(&count, buf, 4);
+
+	return count;
+}
+
+/*
+ * Get entry of multi-fetch buffer.
+ */
+void multifetch_entry(const unsigned char *buf, uint32_t entry_no,
+	struct MultifetchEntry *entry)
+{
+	const unsigned char *p = buf + 4 + entry_no * MULTIFETCH_ENTRY_LEN;
+
+	memcpy(&entry->record_len, p, 4);
+	memcpy(&entry->response, p + 4, 4);
+	memcpy(&entry->isn, p + 8, 4);
+	memcpy(&entry->isn_quantity, p + 12, 4);
+}
+
+/*
+ * Wait before next attempt to open database and double delay up to
+ * its maximum. Actual wait is randomized between half of delay and
+ * delay, so processes waiting for nucleus don't return all at once.
+ * Replayed calls are answered without waits.
+ */
+void backoff_sleep(uint64_t *delay_usec)
+{
+	static int seeded = 0;
+
+	if (!seeded) {
+		srand((unsigned int) timer_usec());
+		seeded = 1;
+	}
+	if (!replay_enabled()) {
+		timer_sleep(*delay_usec / 2
+			+ *delay_usec / 2 * (uint64_t) (rand() % 1000) / 1000);
+	}
+
+	*delay_usec *= 2;
+	if (*delay_usec > OPEN_DELAY_MAX_USEC) {
+		*delay_usec = OPEN_DELAY_MAX_USEC;
+	}
+}
+
+/*
+ * Remember options of opened database for reopening of its session.
+ */
+void session_save(int db_id, const char *db_options)
+{
+	int i;
+
+	if (strlen(db_options) >= SESSION_OPTIONS_MAX) {
+		return;
+	}
+	for (i = 0; i < session_count && sessions[i].db_id != db_id; i++) {
+	}
+	if (i == SESSIONS_MAX) {
+		return;
+	}
+	if (i == session_count) {
+		session_count++;
+	}
+	sessions[i].db_id = db_id;
+	if (sessions[i].db_options != db_options) {
+		strcpy(sessions[i].db_options, db_options);
+	}
+}
+
+/*
+ * Open Adabas database. Open is repeated after backed out transaction
+ * of previous session and, within reconnect time, while nucleus is
+ * not active.
+ */
+int db_open(int db_id, const char *db_options)
+{
+	ACBX acbx;
+	ABD rb_abd;
+	ABD *abds[1];
+	uint64_t delay_usec = OPEN_DELAY_USEC;
+	uint64_t end_usec = timer_usec()
+		+ (uint64_t) options.reconnect_time * 1000000;
+
+	/* Prepare Adabas direct call control block. */
+	acbx_init(&acbx, "OP", db_id, 0);
+	abd_init(&rb_abd, ABD_RECORD, (char *) db_options,
+		strlen(db_options), strlen(db_options));
+	abds[0] = &rb_abd;
+
+	/* Execute Adabas direct call command OP. */
+	while (adabas_call(&acbx, 1, abds) == ADA_TABT
+		|| (acbx.acbxrsp == ADA_NOT_ACTIVE && timer_usec() < end_usec))
+	{
+		backoff_sleep(&delay_usec);
+	}
+
+	if (acbx.acbxrsp == ADA_NORMAL) {
+		session_save(db_id, db_options);
+	}
+
+	return acbx.acbxrsp;
+}
+
+/*
+ * Close Adabas database.
+ */
+int db_close(int db_id)
+{
+	/* Prepare Adabas direct call control block. */
+	ACBX acbx;
+	acbx_init(&acbx, "CL", db_id, 0);
+
+	/* Execute Adabas direct call command CL. */
+	return adabas_call(&acbx, 0, NULL);
+}
+
+/*
+ * Check whether Adabas session was lost by failed command, so database
+ * must be opened again.
+ */
+int session_lost(void)
+{
+	return lost_flag;
+}
+
+/*
+ * Open database of lost Adabas session again with its options. Records
+ * modified in backed out transaction must be processed again by caller.
+ */
+int session_reopen(int db_id)
+{
+	int i;
+	int response;
+
+	for (i = 0; i < session_count && sessions[i].db_id != db_id; i++) {
+	}
+	if (i == session_count) {
+		return ADA_NOT_ACTIVE;
+	}
+
+	response = db_open(db_id, sessions[i].db_options);
+	if (response == ADA_NORMAL) {
+		lost_flag = 0;
+		reopened_sessions++;
+	}
+
+	return response;
+}
+
+/*
+ * Print numbers of reopened sessions and calls flagged by watchdog.
+ */
+void session_report(void)
+{
+	if (reopened_sessions > 0) {
+		fprintf(stderr, "Reopened Adabas sessions: %lu\n",
+			reopened_sessions);
+	}
+	if (slow_calls > 0) {
+		fprintf(stderr, "Slow Adabas calls: %lu, slowest: %lu ms\n",
+			slow_calls, (unsigned long) (slowest_usec / 1000));
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(ADACALL_H)
+#define ADACALL_H
+
+#include <adabasx.h>
+#include <stdint.h>
+
+/* Identifiers of Adabas buffers. */
+#define ABD_FORMAT 'F'
+#define ABD_RECORD 'R'
+#define ABD_SEARCH 'S'
+#define ABD_VALUE 'V'
+#define ABD_ISN 'I'
+#define ABD_MULTIFETCH 'M'
+
+/* Response code when record with specified ISN is not found. */
+#define ADA_ISN_NOT_FOUND 113
+/* Response code when record is held or hold queue is full. */
+#define ADA_HOLD_QUEUE 145
+/* Response code when file is locked by other users. */
+#define ADA_FILE_LOCKED 48
+/* Response code when Adabas nucleus is not active or not reachable. */
+#define ADA_NOT_ACTIVE 148
+
+/* Length of one ISN in Adabas ISN buffer. */
+#define ISN_LEN 4
+
+/* Maximal number of records returned by one multi-fetch command. */
+#define MULTIFETCH_MAX 256
+/*
+ * Length of multi-fetch buffer entry (record length, response code,
+ * ISN and ISN quantity, 4 bytes each).
+ */
+#define MULTIFETCH_ENTRY_LEN 16
+/* Size of multi-fetch buffer (number of records and entries). */
+#define MULTIFETCH_BUF_SIZE (4 + MULTIFETCH_MAX * MULTIFETCH_ENTRY_LEN)
+
+/* Entry of multi-fetch buffer describing one returned record. */
+struct MultifetchEntry {
+	uint32_t record_len;
+	uint32_t response;
+	uint32_t isn;
+	uint32_t isn_quantity;
+};
+
+/* Prepare Adabas extended control block for command. */
+void acbx_init(ACBX *acbx, const char *cmd_code, int db_id, int file_no);
+/* Prepare Adabas buffer description. */
+void abd_init(ABD *abd, char abd_id, void *buf, uint32_t buf_size,
+	uint32_t send_len);
+/* Execute Adabas direct call with extended control block. */
+int adabas_call(ACBX *acbx, int abd_count, ABD **abds);
+/* Get duration of last Adabas direct call in microseconds. */
+uint64_t adabas_call_usec(void);
+
+/* Get number of records returned in multi-fetch buffer. */
+uint32_t multifetch_count(const unsigned char *buf);
+/* Get entry of multi-fetch buffer. */
+void multifetch_entry(const unsigned char *buf, uint32_t entry_no,
+	struct MultifetchEntry *entry);
+
+/* Open Adabas database. */
+int db_open(int db_id, const char *db_options);
+/* Close Adabas database. */
+int db_close(int db_id);
+/* Check whether Adabas session was lost by failed command. */
+int session_lost(void);
+/* Open database of lost Adabas session again. */
+int session_reopen(int db_id);
+/* Print numbers of reopened sessions and slow Adabas calls. */
+void session_report(void);
+
+#endif /* ADACALL_H */
@@ -32,15 +32,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "adacall.h"
 #include "adamod.h"
+#include "codepage.h"
+#include "compare.h"
+#include "control.h"
+#include "export.h"
+#include "load.h"
 #include "messages.h"
 #include "modify.h"
+#include "replay.h"
+#include "search.h"
+#include "trace.h"
+#include "transform.h"
+#include "tune.h"
+#include "update.h"
+#include "verify.h"
 
-/* Application options. */
-struct Options options = { 0, 0, 0, NULL, 0, 0, 0, NULL, NULL };
+/* Application options (defaults are set in main()). */
+struct Options options;
 
 /* Log file. */
 FILE *log_file = NULL;
+/* Log of processed ISNs. */
+struct IsnWriter isn_log;
 
 /* Print help information. */
 void print_help(void);
@@ -60,21 +75,155 @@ void print_help(void)
 		"\n",
 		"Usage:\n"
                 "  adamod -h\n",
-		"  adamod [-v] -t dbid,fileno [-l logfile] [-i isn]\n",
-		"         [-s searchbuf.valuebuf] formatbuf.recordbuf\n",
-		"  adamod -d [-v] -t dbid,fileno [-l logfile] [-i isn]\n",
-		"         [-s searchbuf.valuebuf]\n",
+		"  adamod [-dEv] -t dbid,fileno [-l logfile] [-c count] [-T hours]\n",
+		"         [-j journal] [-i isn] [selection] formatbuf.recordbuf\n",
+		"  adamod -M transformation [-dEv] -t dbid,fileno [-l logfile]\n",
+		"         [-c count] [-T hours] [-j journal] [-i isn] [selection]\n",
+		"  adamod -N rulesfile [-dEv] -t dbid,fileno [-l logfile] [-c count]\n",
+		"         [-T hours] [-j journal] [-i isn] [selection]\n",
+		"  adamod -e [-dEv] -t dbid,fileno [-l logfile] [-c count] [-T hours]\n",
+		"         [-i isn] [selection] [-j journal formatbuf]\n",
+		"  adamod -e -p [-dv] -t dbid,fileno [-l logfile]\n",
+		"  adamod [-e] [-v] -t dbid,fileno -S sharddir[,isns[,seconds]]\n",
+		"         [-l logfile] [-c count] [-T hours] [-s searchbuf.valuebuf]...\n",
+		"         [-X isnfile]... [-j journal] [formatbuf[.recordbuf]]\n",
+		"  adamod -V [-v] -t dbid,fileno [-l logfile] [-F format] [-y percent]\n",
+		"         [-S sharddir[,isns[,seconds]]] [-i isn] [selection]\n",
+		"         formatbuf.recordbuf|-M transformation|-N rulesfile\n",
+		"  adamod -H hashfile [-v] -t dbid,fileno [-l logfile]\n",
+		"         [-X isnfile]... formatbuf\n",
+		"  adamod -H hashfile -D dbid,fileno,hashfile [-v] -t dbid,fileno\n",
+		"         [-l logfile] [-F format] [-o updfile] [-X isnfile]...\n",
+		"  adamod -u journal [-dJv] [-l logfile] [-c count]\n",
+		"  adamod -x [-v] -t dbid,fileno [-l logfile] [-o outfile]\n",
+		"         [-O format] [-i isn] [selection] formatbuf\n",
+		"  adamod -U updfile [-dEv] -t dbid,fileno [-l logfile] [-c count]\n",
+		"         [-T hours] [-W count] [-f [-L msec]] [-X isnfile]...\n",
+		"  adamod -n infile [-dv] -t dbid,fileno [-l logfile] [-c count]\n",
+		"         [-o isnfile] [-F format] [formatbuf]\n",
+		"  selection: -s searchbuf.valuebuf|-I isnlog\n",
+		"         [-a|-m searchbuf.valuebuf]... [-I isnlog]... [-X isnfile]...\n",
+		"         [-C cachedir [-A seconds]] [-P]\n",
+		"         or -r searchbuf.startvalue [-R endvalue]\n",
+		"  signals: USR1 pauses and USR2 resumes processing,\n",
+		"         INT and TERM stop it after commit of processed records\n",
 		"\n",
-		"  -h --help     print this help\n",
-		"  -d --dry      dry run (do not modify database)\n",
-		"  -e --delete   delete records from database\n",
-		"  -i --isn      specify ISN of Adabas record\n",
-		"  -l --log      specify log file for utility messages\n",
-		"  -s --search   specify Adabas search and value buffers\n",
-		"  -t --target   specify target Adabas database and file\n",
-		"  -v --verbose  increase verbosity level (repeatable)\n",
-		"  formatbuf     Adabas format buffer\n",
-		"  recordbuf     Adabas record buffer\n",
+		"  -h --help           print this help\n",
+		"  -A --cache-age      specify maximal age of cached search results\n",
+		"                      and field definitions in seconds\n",
+		"                      (default 3600)\n",
+		"  -a --and            intersect found records with records found\n",
+		"                      by search and value buffers\n",
+		"  -C --cache          keep search results and field definitions\n",
+		"                      in cache directory\n",
+		"  -c --commit         specify number of records per transaction\n",
+		"                      or its bounds min,max for automatic tuning\n",
+		"  -D --source         compare hash tree of target file with hash\n",
+		"                      tree of source file (dbid,fileno,hashfile),\n",
+		"                      reading only records of differing ranges\n",
+		"                      of ISNs from both files, and write ISNs\n",
+		"                      of divergent records to ISN log and\n",
+		"                      values of source records existing in both\n",
+		"                      files to update file (option -o)\n",
+		"  -d --dry            dry run (do not modify database)\n",
+		"  -E --exclusive      modify records under exclusive control of\n",
+		"                      file without holds, writing checkpoints\n",
+		"                      every 100000 records\n",
+		"  -e --delete         delete records from database\n",
+		"  -f --follow         read update file as endless feed (FIFO\n",
+		"                      or standard input) committing batches\n",
+		"  -F --log-format     specify format of ISN log:\n",
+		"                      text (default), binary or delta\n",
+		"  -G --reconnect      reopen database within specified number of\n",
+		"                      seconds while nucleus is not active and\n",
+		"                      resume modification after lost session,\n",
+		"                      skipping records of committed transactions\n",
+		"                      (not in update, dry and exclusive modes)\n",
+		"  -H --hash           build hash tree of fields of records in\n",
+		"                      ranges of ISNs by physical scan of file\n",
+		"                      and write it to hash file\n",
+		"  -I --isns           select records with ISNs from ISN log\n",
+		"                      of previous run\n",
+		"  -i --isn            specify ISN of Adabas record\n",
+		"  -K --record         record Adabas calls with their results\n",
+		"                      to file for replay\n",
+		"  -k --replay         answer Adabas calls from file of recorded\n",
+		"                      calls with their durations multiplied\n",
+		"                      by optional scale (file[,scale])\n",
+		"  -J --unmarked       undo also modifications saved in journal\n",
+		"                      after its last commit marker (left by\n",
+		"                      interrupted run, may be committed)\n",
+		"  -j --journal        save before-images of records to journal\n",
+		"  -L --latency        specify maximal delay of batch in follow\n",
+		"                      mode in milliseconds (default 1000)\n",
+		"  -l --log            specify log file for utility messages\n",
+		"  -M --transform      modify fields with values computed from\n",
+		"                      current values of fields read with hold\n",
+		"                      (FIELD=expression[;FIELD=expression]...)\n",
+		"                      with numbers, texts in quotes, fields,\n",
+		"                      + - * / (+ concatenates texts), upper(),\n",
+		"                      lower(), trim(), replace(text,from,to)\n",
+		"                      and prefix(text,from,to)\n",
+		"  -m --minus          exclude records found by search and value\n",
+		"                      buffers from found records\n",
+		"  -N --rules          modify fields by rules of file applied\n",
+		"                      together in one pass, rule per line\n",
+		"                      (condition -> FIELD=expression[;...])\n",
+		"                      with comparisons = <> < <= > >= of\n",
+		"                      expressions combined by not, and, or;\n",
+		"                      first matching rule assigning field wins\n",
+		"  -n --load           add records from file (binary export file\n",
+		"                      or record buffer per line) to database\n",
+		"  -o --output         specify output file of exported records\n",
+		"                      (ISNs of added records in load mode,\n",
+		"                      update file in comparison mode)\n",
+		"  -O --output-format  specify format of exported records:\n",
+		"                      csv (default), json or binary\n",
+		"  -P --physical       process found records in sequence they are\n",
+		"                      stored in Data Storage (read with L2)\n",
+		"  -p --purge          delete all records at once by refresh of\n",
+		"                      file under exclusive control (dry run\n",
+		"                      reports number of deleted records)\n",
+		"  -Q --codepage       translate alphanumeric values between codepage\n",
+		"                      of database and local one (db[,local],\n",
+		"                      latin1 by default): ascii, latin1, cp1252,\n",
+		"                      cp1251, cp866, koi8r, cp037, cp273, cp500\n",
+		"                      or cp1140\n",
+		"  -R --range-end      specify end value of descriptor range\n",
+		"                      (compared with prefix of descriptor value)\n",
+		"  -r --range          process records in sequence of descriptor\n",
+		"                      starting with value (not super-, sub-\n",
+		"                      or phonetic descriptor)\n",
+		"  -S --shard-dir      share job with other processes by leases\n",
+		"                      of ISN ranges in directory, optionally\n",
+		"                      with range size and lease time in seconds\n",
+		"                      (dir[,isns[,seconds]], 100000 and 300)\n",
+		"  -s --search         specify Adabas search and value buffers\n",
+		"  -T --time-window    process records only in hours HH:MM-HH:MM\n",
+		"                      (processing is paused outside of them)\n",
+		"  -t --target         specify target Adabas database and file\n",
+		"  -U --updates        modify records with values from file\n",
+		"                      (\"isn formatbuf.recordbuf\" per line)\n",
+		"  -u --undo           undo modifications saved in journal\n",
+		"  -V --verify         read modified fields of selected records\n",
+		"                      back with multi-fetch and write ISNs of\n",
+		"                      records which don't match modification\n",
+		"                      (are changed by transformation again)\n",
+		"                      or are missing to ISN log, so they can be\n",
+		"                      processed again with option -I\n",
+		"  -v --verbose        increase verbosity level (repeatable)\n",
+		"  -W --window         specify number of modifications merged\n",
+		"                      per record before update (default 1000)\n",
+		"  -w --watchdog       report Adabas calls lasting longer than\n",
+		"                      specified number of milliseconds\n",
+		"  -X --exclude        skip records with ISNs listed in file\n",
+		"  -x --export         export records from database\n",
+		"  -y --sample         verify only sample of records (percent\n",
+		"                      of blocks of consecutive ISNs)\n",
+		"  -Z --trace          write spans of Adabas calls, commits and\n",
+		"                      waits to file in Chrome trace format\n",
+		"  formatbuf           Adabas format buffer\n",
+		"  recordbuf           Adabas record buffer\n",
 		"\n",
 		NULL};
 
@@ -92,20 +241,59 @@ void print_help(void)
  */
 int parse_command_line(int argc, char *argv[])
 {
-	static const char *short_options = "hvdet:l:i:s:";
+	static const char *short_options = "hvdEet:l:F:i:s:a:m:X:C:A:r:R:Pj:u:Jc:xo:O:n:U:W:fL:T:Z:K:k:pS:Q:M:N:I:Vy:H:D:G:w:";
 	static struct option long_options[] = {
 		{ "help", no_argument, 0, 'h' },
 		{ "verbose", no_argument, 0, 'v' },
 		{ "dry", no_argument, 0, 'd' },
 		{ "delete", no_argument, 0, 'e' },
+		{ "exclusive", no_argument, 0, 'E' },
+		{ "purge", no_argument, 0, 'p' },
+		{ "shard-dir", required_argument, 0, 'S' },
+		{ "codepage", required_argument, 0, 'Q' },
+		{ "transform", required_argument, 0, 'M' },
+		{ "rules", required_argument, 0, 'N' },
+		{ "isns", required_argument, 0, 'I' },
+		{ "verify", no_argument, 0, 'V' },
+		{ "sample", required_argument, 0, 'y' },
+		{ "hash", required_argument, 0, 'H' },
+		{ "source", required_argument, 0, 'D' },
+		{ "reconnect", required_argument, 0, 'G' },
+		{ "watchdog", required_argument, 0, 'w' },
 		{ "target", required_argument, 0, 't' },
 		{ "log", required_argument, 0, 'l' },
+		{ "log-format", required_argument, 0, 'F' },
 		{ "isn", required_argument, 0, 'i' },
 		{ "search", required_argument, 0, 's'},
+		{ "and", required_argument, 0, 'a' },
+		{ "minus", required_argument, 0, 'm' },
+		{ "exclude", required_argument, 0, 'X' },
+		{ "cache", required_argument, 0, 'C' },
+		{ "cache-age", required_argument, 0, 'A' },
+		{ "range", required_argument, 0, 'r' },
+		{ "range-end", required_argument, 0, 'R' },
+		{ "physical", no_argument, 0, 'P' },
+		{ "journal", required_argument, 0, 'j' },
+		{ "undo", required_argument, 0, 'u' },
+		{ "unmarked", no_argument, 0, 'J' },
+		{ "commit", required_argument, 0, 'c' },
+		{ "export", no_argument, 0, 'x' },
+		{ "output", required_argument, 0, 'o' },
+		{ "output-format", required_argument, 0, 'O' },
+		{ "load", required_argument, 0, 'n' },
+		{ "updates", required_argument, 0, 'U' },
+		{ "window", required_argument, 0, 'W' },
+		{ "follow", no_argument, 0, 'f' },
+		{ "latency", required_argument, 0, 'L' },
+		{ "time-window", required_argument, 0, 'T' },
+		{ "trace", required_argument, 0, 'Z' },
+		{ "record", required_argument, 0, 'K' },
+		{ "replay", required_argument, 0, 'k' },
 		{ 0, 0, 0, 0 }
 	};
 	int option;
 	char *target_arg = NULL;
+	int result_code;
 
 	/* Print help when no arguments specified. */
 	if (argc <= 1) {
@@ -121,23 +309,188 @@ int parse_command_line(int argc, char *argv[])
 		case 'h':
 			print_help();
 			return ADAMOD_E_NOARGS;
+		case 'A':
+			if (atol(optarg) < 0) {
+				return ADAMOD_E_INVARG;
+			}
+			options.cache_max_age = atol(optarg);
+			break;
+		case 'C':
+			options.cache_dir_name = optarg;
+			break;
+		case 'c':
+			if (atol(optarg) < 1) {
+				return ADAMOD_E_INVARG;
+			}
+			options.commit_count = atol(optarg);
+
+			/*
+			 * With bounds of transaction size, number of records
+			 * per transaction and per read command are tuned.
+			 */
+			if (strchr(optarg, ',') != NULL) {
+				if (atol(strchr(optarg, ',') + 1)
+					< (long) options.commit_count)
+				{
+					return ADAMOD_E_INVARG;
+				}
+				options.commit_max = atol(strchr(optarg, ',') + 1);
+			}
+			break;
+		case 'D':
+			/* Hash file of source follows its database and file. */
+			if (strchr(optarg, ',') == NULL
+				|| strchr(strchr(optarg, ',') + 1, ',') == NULL)
+			{
+				return ADAMOD_E_INVTARGET;
+			}
+			options.source_db_id = atol(optarg);
+			options.source_file_no = atol(strchr(optarg, ',') + 1);
+			options.source_hash_file_name =
+				strchr(strchr(optarg, ',') + 1, ',') + 1;
+			if (options.source_db_id < 1 || options.source_file_no < 1) {
+				return ADAMOD_E_INVTARGET;
+			}
+			break;
 		case 'd':
 			options.dry_mode = 1;
 			break;
+		case 'E':
+			options.exclusive_mode = 1;
+			break;
 		case 'e':
 			options.delete_mode = 1;
 			break;
+		case 'f':
+			options.follow_mode = 1;
+			break;
+		case 'F':
+			if (isn_log_format(optarg, &options.log_format)
+				!= ADAMOD_SUCCESS)
+			{
+				return ADAMOD_E_INVARG;
+			}
+			break;
+		case 'G':
+			if (atol(optarg) < 0) {
+				return ADAMOD_E_INVARG;
+			}
+			options.reconnect_time = atol(optarg);
+			break;
+		case 'H':
+			options.hash_file_name = optarg;
+			break;
 		case 'i':
-			options.isn = atol(optarg);
+			if (parse_isn(optarg, &options.isn) != ADAMOD_SUCCESS) {
+				return ADAMOD_E_INVARG;
+			}
+			break;
+		case 'j':
+			options.journal_file_name = optarg;
+			break;
+		case 'K':
+			options.record_file_name = optarg;
+			break;
+		case 'k':
+			/* Durations of replayed calls may be scaled. */
+			options.replay_file_name = optarg;
+			if (strchr(optarg, ',') != NULL) {
+				*strchr(optarg, ',') = '\0';
+				options.replay_scale = atof(optarg
+					+ strlen(optarg) + 1);
+				if (options.replay_scale < 0) {
+					return ADAMOD_E_INVARG;
+				}
+			}
+			break;
+		case 'L':
+			if (atol(optarg) < 1) {
+				return ADAMOD_E_INVARG;
+			}
+			options.batch_latency = atol(optarg);
 			break;
 		case 'l':
 			options.log_file_name = optarg;
 			break;
+		case 'M':
+			options.transform_arg = optarg;
+			break;
+		case 'N':
+			options.rules_file_name = optarg;
+			break;
+		case 'I':
+		case 'a':
+		case 'm':
 		case 's':
-			options.search_arg = optarg;
-			if (strchr(options.search_arg, '.') == NULL) {
+			/*
+			 * Search arguments are combined in order of command line.
+			 * ISNs of ISN log are added like found records.
+			 */
+			if ((option != 'I' && strchr(optarg, '.') == NULL)
+				|| options.search_count >= SEARCH_ARGS_MAX
+				|| (options.search_count == 0 && option != 's'
+				&& option != 'I'))
+			{
 				return ADAMOD_E_INVSEARCH;
 			}
+			options.search_args[options.search_count].operation =
+				option == 'a' ? ISN_SET_INTERSECT
+				: option == 'm' ? ISN_SET_DIFFERENCE : ISN_SET_UNION;
+			options.search_args[options.search_count].isn_log =
+				option == 'I';
+			options.search_args[options.search_count++].arg = optarg;
+			break;
+		case 'X':
+			if (options.exclude_count >= EXCLUDE_FILES_MAX) {
+				return ADAMOD_E_INVARG;
+			}
+			options.exclude_file_names[options.exclude_count++] = optarg;
+			break;
+		case 'p':
+			options.purge_mode = 1;
+			break;
+		case 'Q':
+			if (codepage_open(optarg) != ADAMOD_SUCCESS) {
+				return ADAMOD_E_INVCODEPAGE;
+			}
+			break;
+		case 'P':
+			options.physical_order = 1;
+			break;
+		case 'S':
+			/* Chunk size and lease time may follow directory. */
+			options.shard_dir_name = optarg;
+			if (strchr(optarg, ',') != NULL) {
+				char *arg = strchr(optarg, ',');
+
+				*arg++ = '\0';
+				if (atol(arg) < 1) {
+					return ADAMOD_E_INVARG;
+				}
+				options.shard_size = atol(arg);
+				if (strchr(arg, ',') != NULL) {
+					options.lease_time = atol(strchr(arg, ',') + 1);
+					if (options.lease_time < 3) {
+						return ADAMOD_E_INVARG;
+					}
+				}
+			}
+			break;
+		case 'r':
+			options.range_arg = optarg;
+			if (strchr(options.range_arg, '.') == NULL) {
+				return ADAMOD_E_INVRANGE;
+			}
+			break;
+		case 'R':
+			options.range_end_arg = optarg;
+			break;
+		case 'T':
+			if (parse_time_window(optarg, &options.window_start,
+				&options.window_end) != ADAMOD_SUCCESS)
+			{
+				return ADAMOD_E_INVARG;
+			}
 			break;
 		case 't':
 			target_arg = optarg;
@@ -152,28 +505,336 @@ int parse_command_line(int argc, char *argv[])
 			options.db_id = atol(target_arg);
 			options.file_no = atol(strchr(target_arg, ',') + 1);
 			break;
+		case 'n':
+			options.load_file_name = optarg;
+			break;
+		case 'o':
+			options.output_file_name = optarg;
+			break;
+		case 'O':
+			if (export_format(optarg, &options.export_format)
+				!= ADAMOD_SUCCESS)
+			{
+				return ADAMOD_E_INVARG;
+			}
+			break;
+		case 'U':
+			options.update_file_name = optarg;
+			break;
+		case 'u':
+			options.undo_file_name = optarg;
+			break;
+		case 'J':
+			options.undo_unmarked = 1;
+			break;
+		case 'V':
+			options.verify_mode = 1;
+			break;
 		case 'v':
 			options.verbose_level++;
 			break;
+		case 'w':
+			if (atol(optarg) < 1) {
+				return ADAMOD_E_INVARG;
+			}
+			options.watchdog_time = atol(optarg);
+			break;
+		case 'W':
+			if (atol(optarg) < 1) {
+				return ADAMOD_E_INVARG;
+			}
+			options.coalesce_window = atol(optarg);
+			break;
+		case 'x':
+			options.export_mode = 1;
+			break;
+		case 'y':
+			options.sample_percent = atof(optarg);
+			if (options.sample_percent <= 0
+				|| options.sample_percent > 100.0)
+			{
+				return ADAMOD_E_INVARG;
+			}
+			break;
+		case 'Z':
+			options.trace_file_name = optarg;
+			break;
 		default:
 			return ADAMOD_E_INVARG;
 		}
 	}
 
+	/* Descriptor range is used instead of ISN and search arguments. */
+	if ((options.range_arg != NULL && (options.isn > 0
+		|| options.search_count > 0 || options.export_mode
+		|| options.physical_order
+		|| options.load_file_name != NULL
+		|| options.update_file_name != NULL
+		|| options.undo_file_name != NULL))
+		|| (options.range_end_arg != NULL && options.range_arg == NULL))
+	{
+		return ADAMOD_E_INVARG;
+	}
+
+	/* Exclusive control is used only for modification of records. */
+	if (options.exclusive_mode && (options.export_mode
+		|| options.load_file_name != NULL
+		|| options.undo_file_name != NULL))
+	{
+		return ADAMOD_E_INVARG;
+	}
+
+	/*
+	 * Refresh of file deletes all records, so it is allowed only
+	 * without selection of records and their journal. Refresh
+	 * requires exclusive control of file.
+	 */
+	if (options.purge_mode) {
+		if (!options.delete_mode || options.isn != 0
+			|| options.search_count > 0 || options.exclude_count > 0
+			|| options.range_arg != NULL
+			|| options.journal_file_name != NULL
+			|| options.update_file_name != NULL
+			|| options.load_file_name != NULL
+			|| options.undo_file_name != NULL || options.export_mode)
+		{
+			return ADAMOD_E_INVARG;
+		}
+		if (!options.dry_mode) {
+			options.exclusive_mode = 1;
+		}
+	}
+
+	/*
+	 * Shared job is divided by ranges of ISNs, so records are
+	 * selected only by search or read in sequence of ISNs. Chunks
+	 * done in dry run would be skipped by real run. Chunk taken over
+	 * after expired lease is processed again, so values computed by
+	 * transformation or rules could be applied twice.
+	 */
+	if (options.shard_dir_name != NULL && (options.isn != 0
+		|| options.dry_mode
+		|| (!options.verify_mode && (options.transform_arg != NULL
+			|| options.rules_file_name != NULL))
+		|| options.range_arg != NULL || options.physical_order
+		|| options.exclusive_mode || options.purge_mode
+		|| options.export_mode || options.load_file_name != NULL
+		|| options.update_file_name != NULL
+		|| options.undo_file_name != NULL))
+	{
+		return ADAMOD_E_INVARG;
+	}
+
+	/*
+	 * Transformation or rules are used instead of modification from
+	 * command line, they are compiled before database is opened.
+	 */
+	if (options.transform_arg != NULL && options.rules_file_name != NULL) {
+		return ADAMOD_E_INVARG;
+	}
+	if (options.transform_arg != NULL || options.rules_file_name != NULL) {
+		if (options.delete_mode || options.export_mode
+			|| options.load_file_name != NULL
+			|| options.update_file_name != NULL
+			|| options.undo_file_name != NULL || optind < argc)
+		{
+			return ADAMOD_E_INVARG;
+		}
+		if (options.transform_arg != NULL
+			&& transform_parse(options.transform_arg) != ADAMOD_SUCCESS)
+		{
+			return ADAMOD_E_INVTRANSFORM;
+		}
+		if (options.rules_file_name != NULL) {
+			result_code = transform_rules(options.rules_file_name);
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+		}
+	}
+
+	/* Calls are either recorded or replayed. */
+	if (options.record_file_name != NULL
+		&& options.replay_file_name != NULL)
+	{
+		return ADAMOD_E_INVARG;
+	}
+
+	/*
+	 * Verification only reads records, so it is not combined with
+	 * other modes and options of modification. Sample is taken only
+	 * by verification.
+	 */
+	if ((options.verify_mode && (options.delete_mode
+		|| options.export_mode || options.load_file_name != NULL
+		|| options.update_file_name != NULL
+		|| options.undo_file_name != NULL
+		|| options.journal_file_name != NULL
+		|| options.range_arg != NULL || options.exclusive_mode
+		|| options.purge_mode))
+		|| (!options.verify_mode && options.sample_percent < 100.0))
+	{
+		return ADAMOD_E_INVARG;
+	}
+
+	/*
+	 * Hash tree is built by physical scan of whole file and compared
+	 * with hash tree of source file, so records are neither selected
+	 * nor modified. Fields are specified only when hash tree is built,
+	 * comparison takes them from hash files. Update file and ISN log
+	 * can't be written to standard output together.
+	 */
+	if (options.source_hash_file_name != NULL
+		&& options.hash_file_name == NULL)
+	{
+		return ADAMOD_E_INVARG;
+	}
+	if (options.hash_file_name != NULL) {
+		if (options.dry_mode || options.delete_mode
+			|| options.export_mode || options.verify_mode
+			|| options.load_file_name != NULL
+			|| options.update_file_name != NULL
+			|| options.undo_file_name != NULL
+			|| options.journal_file_name != NULL
+			|| options.transform_arg != NULL
+			|| options.rules_file_name != NULL
+			|| options.range_arg != NULL || options.isn != 0
+			|| options.search_count > 0 || options.physical_order
+			|| options.exclusive_mode || options.purge_mode
+			|| options.shard_dir_name != NULL)
+		{
+			return ADAMOD_E_INVARG;
+		}
+		if (options.source_hash_file_name == NULL) {
+			if (options.output_file_name != NULL) {
+				return ADAMOD_E_INVARG;
+			}
+			if (optind < argc) {
+				options.hash_format_arg = argv[optind++];
+			}
+			if (options.hash_format_arg == NULL
+				|| strchr(options.hash_format_arg, '.')
+				!= options.hash_format_arg
+				+ strlen(options.hash_format_arg) - 1)
+			{
+				return ADAMOD_E_INVARG;
+			}
+		} else if (optind < argc || (options.output_file_name != NULL
+			&& strcmp(options.output_file_name, "-") == 0
+			&& (options.log_file_name == NULL
+			|| options.log_file_name[0] == '-')))
+		{
+			return ADAMOD_E_INVARG;
+		}
+		if (options.db_id < 1 || options.file_no < 1) {
+			return ADAMOD_E_INVTARGET;
+		}
+		return ADAMOD_SUCCESS;
+	}
+
+	/* Only update file is followed as endless feed. */
+	if (options.follow_mode && options.update_file_name == NULL) {
+		return ADAMOD_E_INVARG;
+	}
+
+	/* Unmarked journal entries are replayed only in undo mode. */
+	if (options.undo_unmarked && options.undo_file_name == NULL) {
+		return ADAMOD_E_INVARG;
+	}
+
+	/* Target and buffers of journal replay are taken from journal. */
+	if (options.undo_file_name != NULL) {
+		if (options.journal_file_name != NULL || optind < argc
+			|| options.search_count > 0 || options.exclude_count > 0
+			|| options.update_file_name != NULL)
+		{
+			return ADAMOD_E_INVARG;
+		}
+		return ADAMOD_SUCCESS;
+	}
+
+	/* In load mode format buffer may be taken from input file. */
+	if (options.load_file_name != NULL) {
+		if (options.delete_mode || options.export_mode
+			|| options.journal_file_name != NULL
+			|| options.search_count > 0 || options.exclude_count > 0
+			|| options.update_file_name != NULL || options.isn != 0)
+		{
+			return ADAMOD_E_INVARG;
+		}
+		if (optind < argc) {
+			options.load_arg = argv[optind++];
+			if (strchr(options.load_arg, '.') == NULL) {
+				return ADAMOD_E_INVLOAD;
+			}
+		}
+		if (options.db_id < 1 || options.file_no < 1) {
+			return ADAMOD_E_INVTARGET;
+		}
+		return ADAMOD_SUCCESS;
+	}
+
+	/* In update mode buffers are read from update file. */
+	if (options.update_file_name != NULL) {
+		if (options.delete_mode || options.export_mode
+			|| options.journal_file_name != NULL
+			|| options.search_count > 0 || options.isn != 0
+			|| options.physical_order || optind < argc)
+		{
+			return ADAMOD_E_INVARG;
+		}
+		if (options.db_id < 1 || options.file_no < 1) {
+			return ADAMOD_E_INVTARGET;
+		}
+		return ADAMOD_SUCCESS;
+	}
+
+	/* In export mode format buffer specifies exported fields. */
+	if (options.export_mode) {
+		if (options.delete_mode || options.journal_file_name != NULL) {
+			return ADAMOD_E_INVARG;
+		}
+		if (optind < argc) {
+			options.export_arg = argv[optind++];
+		}
+		if (options.export_arg == NULL
+			|| strchr(options.export_arg, '.') == NULL)
+		{
+			return ADAMOD_E_INVEXPORT;
+		}
+		if (options.db_id < 1 || options.file_no < 1) {
+			return ADAMOD_E_INVTARGET;
+		}
+		return ADAMOD_SUCCESS;
+	}
+
 	if (optind < argc && !options.delete_mode) {
 		options.modify_arg = argv[optind++];
 		if (strchr(options.modify_arg, '.') == NULL) {
 			return ADAMOD_E_INVMODIFY;
 		}
+	} else if (optind < argc && options.journal_file_name != NULL) {
+		/* In delete mode format buffer specifies journalled fields. */
+		options.journal_format_arg = argv[optind++];
+		if (strchr(options.journal_format_arg, '.') == NULL) {
+			return ADAMOD_E_INVFORMAT;
+		}
 	}
 
 	/* Chech presence of mandatory arguments. */
 	if (options.db_id < 1 || options.file_no < 1) {
 		return ADAMOD_E_INVTARGET;
 	}
-	if (options.modify_arg == NULL && !options.delete_mode) {
+	if (options.modify_arg == NULL && !transform_enabled()
+		&& !options.delete_mode)
+	{
 		return ADAMOD_E_NOMODIFY;
 	}
+	if (options.journal_format_arg == NULL && options.delete_mode
+		&& options.journal_file_name != NULL)
+	{
+		return ADAMOD_E_NOJOURNALFMT;
+	}
 
 	/* Command line parsed successfully. */
 	return ADAMOD_SUCCESS;
@@ -185,6 +846,21 @@ int parse_command_line(int argc, char *argv[])
 int main(int argc, char *argv[])
 {
 	int result_code;
+	int close_code;
+
+	/* Options not specified in command line have default values. */
+	options.log_format = ISN_LOG_TEXT;
+	options.commit_count = 1;
+	options.export_format = EXPORT_CSV;
+	options.cache_max_age = 3600;
+	options.coalesce_window = 1000;
+	options.batch_latency = 1000;
+	options.window_start = -1;
+	options.window_end = -1;
+	options.replay_scale = 1.0;
+	options.shard_size = 100000;
+	options.lease_time = 300;
+	options.sample_percent = 100.0;
 
 	/* Parse command line arguments. */
 	result_code = parse_command_line(argc, argv);
@@ -200,23 +876,111 @@ int main(int argc, char *argv[])
 	if (log_file == NULL) {
 		log_file = stdout;
 	}
+	result_code = isn_writer_open(&isn_log, log_file, options.log_format);
+	if (result_code != ADAMOD_SUCCESS) {
+		print_message(result_code);
+		return 1;
+	}
 
 	if (options.dry_mode && options.verbose_level > 1) {
 		print_message(ADAMOD_M_DRYMODE);
 	}
 
-	/* Search records in specified Adabas file and modify found records. */
-	result_code = modify_file_records();
+	/* Start recording of trace events. */
+	if (options.trace_file_name != NULL) {
+		result_code = trace_open(options.trace_file_name);
+	}
+
+	/* Start recording or replay of Adabas calls. */
+	if (result_code == ADAMOD_SUCCESS
+		&& options.record_file_name != NULL)
+	{
+		result_code = record_open(options.record_file_name);
+	} else if (result_code == ADAMOD_SUCCESS
+		&& options.replay_file_name != NULL)
+	{
+		result_code = replay_open(options.replay_file_name,
+			options.replay_scale);
+	}
+
+	/* Load ISNs of records excluded from processing. */
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = exclude_open();
+	}
+
 	if (result_code != ADAMOD_SUCCESS) {
-		print_message(result_code);
-		return 1;
+		/*
+		 * Nothing is processed when trace, recorded calls
+		 * or exclusion files can't be opened.
+		 */
+	} else if (options.undo_file_name != NULL) {
+		/* Undo modifications of records saved in journal. */
+		result_code = undo_file_records();
+	} else if (options.export_mode) {
+		/* Read records from Adabas file and write them to output. */
+		result_code = export_file_records();
+	} else if (options.verify_mode) {
+		/* Read modified fields back and compare them. */
+		result_code = verify_file_records();
+	} else if (options.source_hash_file_name != NULL) {
+		/* Compare hash trees and read records of differing ranges. */
+		result_code = compare_file_records();
+	} else if (options.hash_file_name != NULL) {
+		/* Build hash tree of file by physical scan. */
+		result_code = hash_file_records();
+	} else if (options.load_file_name != NULL) {
+		/* Add records read from input file to Adabas file. */
+		result_code = load_file_records();
+	} else {
+		/*
+		 * Search records in specified Adabas file
+		 * and modify found records.
+		 */
+		result_code = modify_file_records();
+	}
+
+	exclude_close();
+
+	/* Print numbers of reopened sessions and slow Adabas calls. */
+	session_report();
+
+	/* Print tuned sizes of transactions and read commands. */
+	if (result_code == ADAMOD_SUCCESS) {
+		tune_report();
+		transform_report();
+	}
+
+	/*
+	 * Close file of recorded calls. Mismatch of replayed calls is
+	 * reported instead of failure of call caused by it.
+	 */
+	close_code = replay_close();
+	if (close_code != ADAMOD_SUCCESS && (result_code == ADAMOD_SUCCESS
+		|| close_code == ADAMOD_E_REPLAY_MISMATCH))
+	{
+		result_code = close_code;
+	}
+
+	/* Write recorded trace events. */
+	if (trace_close() != ADAMOD_SUCCESS && result_code == ADAMOD_SUCCESS) {
+		result_code = ADAMOD_E_TRACE_IO;
 	}
 
-	/* Close log file. */
+	/* Write rest of ISN log and close log file. */
+	if (isn_writer_close(&isn_log) != ADAMOD_SUCCESS
+		&& result_code == ADAMOD_SUCCESS)
+	{
+		result_code = ADAMOD_E_LOG_IO;
+	}
 	if (log_file != stdout) {
 		fclose(log_file);
 	}
 
+	if (result_code != ADAMOD_SUCCESS) {
+		print_message(result_code);
+		return 1;
+	}
+
 	/* Print final message. */
 	if (options.verbose_level > 0) {
 		print_message(ADAMOD_M_DONE);
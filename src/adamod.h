@@ -32,6 +32,17 @@
 #include <stdio.h>
 #include <stdint.h>
 
+/* ISN of Adabas record, also used for counters of records. */
+typedef uint64_t AdamodIsn;
+
+#include "export.h"
+#include "isnlog.h"
+#include "isnset.h"
+
+/* Maximal number of search arguments and exclusion files. */
+#define SEARCH_ARGS_MAX 16
+#define EXCLUDE_FILES_MAX 16
+
 /* Codes of application states. */
 typedef enum {
 	ADAMOD_SUCCESS = 0,
@@ -42,31 +53,128 @@ typedef enum {
 	ADAMOD_E_INVSEARCH,
 	ADAMOD_E_INVMODIFY,
 	ADAMOD_E_NOMODIFY,
+	ADAMOD_E_NOJOURNALFMT,
+	ADAMOD_E_INVFORMAT,
+	ADAMOD_E_INVJOURNAL,
+	ADAMOD_E_JOURNAL_IO,
+	ADAMOD_E_NOMEMORY,
+	ADAMOD_E_LOG_IO,
+	ADAMOD_E_INVISNLOG,
+	ADAMOD_E_INVEXPORT,
+	ADAMOD_E_OUTPUT_IO,
+	ADAMOD_E_INVRECORD,
+	ADAMOD_E_INVLOAD,
+	ADAMOD_E_INPUT_IO,
+	ADAMOD_E_CACHE_IO,
+	ADAMOD_E_INVRANGE,
+	ADAMOD_E_INVUPDATE,
+	ADAMOD_E_TRACE_IO,
+	ADAMOD_E_REPLAY_IO,
+	ADAMOD_E_INVREPLAY,
+	ADAMOD_E_REPLAY_MISMATCH,
+	ADAMOD_E_EXCLUSIVE,
+	ADAMOD_E_SHARD_IO,
+	ADAMOD_E_SHARD_LOST,
+	ADAMOD_E_INVCODEPAGE,
+	ADAMOD_E_INVTRANSFORM,
+	ADAMOD_E_TRANSFORM,
+	ADAMOD_E_INVRULES,
+	ADAMOD_E_RULES_IO,
+	ADAMOD_E_VERIFY,
+	ADAMOD_E_INVHASH,
+	ADAMOD_E_HASH_IO,
+	ADAMOD_E_DIVERGENT,
 	ADAMOD_E_ADABAS_OP,
 	ADAMOD_E_ADABAS_CL,
 	ADAMOD_E_ADABAS_S1,
+	ADAMOD_E_ADABAS_L1,
 	ADAMOD_E_ADABAS_L2,
+	ADAMOD_E_ADABAS_L3,
 	ADAMOD_E_ADABAS_A1,
 	ADAMOD_E_ADABAS_ET,
 	ADAMOD_E_ADABAS_E1,
+	ADAMOD_E_ADABAS_L4,
+	ADAMOD_E_ADABAS_N2,
+	ADAMOD_E_ADABAS_N1,
+	ADAMOD_E_ADABAS_C1,
+	ADAMOD_E_ADABAS_LF,
+	ADAMOD_E_ADABAS_BT,
 
 	ADAMOD_M_DRYMODE,
+	ADAMOD_M_STOPPED,
+	ADAMOD_M_HOLD_QUEUE,
+	ADAMOD_M_NOT_FOUND,
 	ADAMOD_M_DONE
 } AdamodStateCode;
 
+/* Search argument combined with result of previous searches. */
+struct SearchArg {
+	IsnSetOperation operation;
+	const char *arg;
+	/* ISNs are read from ISN log instead of search. */
+	int isn_log;
+};
+
 /* Application options structure. */
 struct Options {
 	int verbose_level;
 	int dry_mode;
 	int delete_mode;
+	int export_mode;
 	const char *log_file_name;
+	IsnLogFormat log_format;
+	const char *journal_file_name;
+	const char *undo_file_name;
+	int undo_unmarked;
+	unsigned int commit_count;
+	unsigned int commit_max;
+	const char *output_file_name;
+	ExportFormat export_format;
+	const char *load_file_name;
+	const char *cache_dir_name;
+	long cache_max_age;
+	const char *update_file_name;
+	unsigned int coalesce_window;
+	int follow_mode;
+	long batch_latency;
+	int window_start;
+	int window_end;
+	const char *trace_file_name;
+	const char *record_file_name;
+	const char *replay_file_name;
+	double replay_scale;
+	int exclusive_mode;
+	int purge_mode;
+	const char *shard_dir_name;
+	unsigned long shard_size;
+	long lease_time;
+	const char *transform_arg;
+	const char *rules_file_name;
+	int verify_mode;
+	double sample_percent;
+	const char *hash_file_name;
+	const char *source_hash_file_name;
+	uint16_t source_db_id;
+	uint16_t source_file_no;
+	long reconnect_time;
+	long watchdog_time;
 
 	uint16_t db_id;
 	uint16_t file_no;
 
-	uint32_t isn;
-	const char *search_arg;
+	AdamodIsn isn;
+	struct SearchArg search_args[SEARCH_ARGS_MAX];
+	int search_count;
+	const char *exclude_file_names[EXCLUDE_FILES_MAX];
+	int exclude_count;
+	const char *range_arg;
+	const char *range_end_arg;
+	int physical_order;
 	const char *modify_arg;
+	const char *journal_format_arg;
+	const char *export_arg;
+	const char *load_arg;
+	const char *hash_format_arg;
 };
 
 /* Application options variable in module 'adamod'. */
@@ -74,5 +182,7 @@ extern struct Options options;
 
 /* Log file. */
 extern FILE *log_file;
+/* Log of processed ISNs. */
+extern struct IsnWriter isn_log;
 
 #endif /* ADAMOD_H */
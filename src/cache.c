@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adamod.h"
+#include "cache.h"
+#include "journal.h"
+
+/* Signature at the beginning of search cache file. */
+#define CACHE_SIGNATURE "ADAMODC1"
+#define CACHE_SIGNATURE_LEN 8
+/* Length of cache file header (signature, creation time, target). */
+#define CACHE_HEADER_LEN 24
+
+char *cache_file_name(const char *search_arg);
+
+/*
+ * Make name of cache file in cache directory from target and hash
+ * of search argument.
+ */
+char *cache_file_name(const char *search_arg)
+{
+	/* 64-bit FNV-1a hash. */
+	uint64_t hash = ((uint64_t) 0xCBF29CE4UL << 32) | 0x84222325UL;
+	const uint64_t prime = ((uint64_t) 1 << 40) | 0x1B3;
+	const unsigned char *p;
+	char *file_name;
+
+	for (p = (const unsigned char *) search_arg; *p != '\0'; p++) {
+		hash = (hash ^ *p) * prime;
+	}
+
+	file_name = malloc(strlen(options.cache_dir_name) + 48);
+	if (file_name != NULL) {
+		sprintf(file_name, "%s/adamod-%u-%u-%08lx%08lx.isc",
+			options.cache_dir_name, (unsigned int) options.db_id,
+			(unsigned int) options.file_no,
+			(unsigned long) (hash >> 32),
+			(unsigned long) (hash & 0xFFFFFFFFUL));
+	}
+
+	return file_name;
+}
+
+/*
+ * Load cached ISN set of search argument. Missing, expired or
+ * invalid cache file is a cache miss (found is set to 0).
+ */
+int cache_load(const char *search_arg, struct IsnSet *set, int *found)
+{
+	FILE *file;
+	char *file_name;
+	unsigned char buf[CACHE_HEADER_LEN];
+	uint32_t arg_len = strlen(search_arg);
+	char *arg = NULL;
+	time_t now;
+	uint64_t created;
+
+	*found = 0;
+	if (options.cache_dir_name == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	file_name = cache_file_name(search_arg);
+	if (file_name == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	file = fopen(file_name, "rb");
+	free(file_name);
+	if (file == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	/* Check signature, age and key of cached search. */
+	time(&now);
+	if (fread(buf, CACHE_HEADER_LEN, 1, file) == 1
+		&& memcmp(buf, CACHE_SIGNATURE, CACHE_SIGNATURE_LEN) == 0)
+	{
+		created = get_uint64(buf + 8);
+		if (created <= (uint64_t) now
+			&& (uint64_t) now - created < (uint64_t) options.cache_max_age
+			&& get_uint16(buf + 16) == options.db_id
+			&& get_uint16(buf + 18) == options.file_no
+			&& get_uint32(buf + 20) == arg_len)
+		{
+			arg = malloc(arg_len + 1);
+		}
+	}
+	if (arg != NULL && fread(arg, arg_len, 1, file) == 1
+		&& memcmp(arg, search_arg, arg_len) == 0
+		&& isn_set_read(set, file) == ADAMOD_SUCCESS)
+	{
+		*found = 1;
+		if (options.verbose_level > 1) {
+			fprintf(stderr, "Cached search result used (%lu seconds old)\n",
+				(unsigned long) ((uint64_t) now - created));
+		}
+	}
+	free(arg);
+	fclose(file);
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Save ISN set of search argument in cache. File is written under
+ * temporary name and renamed, so readers never see partial file.
+ */
+int cache_save(const char *search_arg, const struct IsnSet *set)
+{
+	FILE *file;
+	char *file_name, *temp_name;
+	unsigned char buf[CACHE_HEADER_LEN];
+	uint32_t arg_len = strlen(search_arg);
+	int result_code;
+
+	if (options.cache_dir_name == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	file_name = cache_file_name(search_arg);
+	if (file_name == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	temp_name = malloc(strlen(file_name) + 5);
+	if (temp_name == NULL) {
+		free(file_name);
+		return ADAMOD_E_NOMEMORY;
+	}
+	sprintf(temp_name, "%s.tmp", file_name);
+
+	file = fopen(temp_name, "wb");
+	if (file == NULL) {
+		free(file_name);
+		free(temp_name);
+		return ADAMOD_E_CACHE_IO;
+	}
+
+	memcpy(buf, CACHE_SIGNATURE, CACHE_SIGNATURE_LEN);
+	put_uint64(buf + 8, (uint64_t) time(NULL));
+	put_uint16(buf + 16, options.db_id);
+	put_uint16(buf + 18, options.file_no);
+	put_uint32(buf + 20, arg_len);
+	fwrite(buf, CACHE_HEADER_LEN, 1, file);
+	fwrite(search_arg, arg_len, 1, file);
+	result_code = isn_set_write(set, file);
+	if (fclose(file) != 0) {
+		result_code = ADAMOD_E_CACHE_IO;
+	}
+
+	/* Existing file must be removed before renaming on some systems. */
+	if (result_code == ADAMOD_SUCCESS) {
+		remove(file_name);
+		if (rename(temp_name, file_name) != 0) {
+			result_code = ADAMOD_E_CACHE_IO;
+		}
+	}
+	if (result_code != ADAMOD_SUCCESS) {
+		remove(temp_name);
+		result_code = ADAMOD_E_CACHE_IO;
+	}
+
+	free(file_name);
+	free(temp_name);
+
+	return result_code;
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adamod.h"
+#include "coalesce.h"
+#include "format.h"
+
+/* Maximal number of fields in format buffer of modification. */
+#define MODIFICATION_FIELDS_MAX 256
+/* Initial number of slots in hash index of records. */
+#define INDEX_MIN_SIZE 1024
+/* Multiplier of Fibonacci hashing (2^64 divided by golden ratio). */
+#define HASH_MULTIPLIER (((uint64_t) 0x9E3779B9UL << 32) | 0x7F4A7C15UL)
+
+uint32_t index_slot(const struct Coalescer *coalescer, AdamodIsn isn);
+int index_grow(struct Coalescer *coalescer);
+void *grow_buffer(void *buf, uint32_t *allocated, uint32_t required,
+	size_t item_size);
+
+/*
+ * Find slot of hash index holding record with specified ISN or empty
+ * slot where such record should be placed.
+ */
+uint32_t index_slot(const struct Coalescer *coalescer, AdamodIsn isn)
+{
+	uint32_t mask = coalescer->index_size - 1;
+	uint32_t slot = (uint32_t) ((isn * HASH_MULTIPLIER) >> 32) & mask;
+
+	while (coalescer->index[slot] != 0
+		&& coalescer->records[coalescer->index[slot] - 1].isn != isn)
+	{
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/*
+ * Double size of hash index and place all pending records in it again.
+ * Index is kept at most half full, so probe sequences remain short.
+ */
+int index_grow(struct Coalescer *coalescer)
+{
+	uint32_t *index;
+	uint32_t record_no;
+
+	index = calloc(coalescer->index_size > 0
+		? coalescer->index_size * 2 : INDEX_MIN_SIZE, sizeof(uint32_t));
+	if (index == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	free(coalescer->index);
+	coalescer->index = index;
+	coalescer->index_size = coalescer->index_size > 0
+		? coalescer->index_size * 2 : INDEX_MIN_SIZE;
+	for (record_no = 0; record_no < coalescer->count; record_no++) {
+		coalescer->index[index_slot(coalescer,
+			coalescer->records[record_no].isn)] = record_no + 1;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Grow buffer to hold at least specified number of items. Returns
+ * buffer (possibly moved) or NULL when memory can't be allocated.
+ */
+void *grow_buffer(void *buf, uint32_t *allocated, uint32_t required,
+	size_t item_size)
+{
+	uint32_t size = *allocated > 0 ? *allocated : 64;
+
+	if (required <= *allocated) {
+		return buf;
+	}
+	while (size < required) {
+		size *= 2;
+	}
+
+	buf = realloc(buf, size * item_size);
+	if (buf != NULL) {
+		*allocated = size;
+	}
+
+	return buf;
+}
+
+/*
+ * Initialize empty coalescer.
+ */
+void coalescer_init(struct Coalescer *coalescer)
+{
+	memset(coalescer, 0, sizeof(struct Coalescer));
+}
+
+/*
+ * Free memory of coalescer.
+ */
+void coalescer_free(struct Coalescer *coalescer)
+{
+	free(coalescer->records);
+	free(coalescer->index);
+	free(coalescer->fields);
+	free(coalescer->values);
+	free(coalescer->format_buf);
+	free(coalescer->record_buf);
+	coalescer_init(coalescer);
+}
+
+/*
+ * Add modification of record (specified by ISN) to pending records.
+ * Every field of format buffer must have explicit length, so values
+ * of fields can be taken from record buffer. Values of fields already
+ * pending for the record are replaced by new ones.
+ */
+int coalescer_add(struct Coalescer *coalescer, AdamodIsn isn,
+	const char *format_buf, uint32_t format_buf_len,
+	const char *record_buf, uint32_t record_buf_len)
+{
+	struct FormatField modification[MODIFICATION_FIELDS_MAX];
+	int modification_count;
+	int field_no;
+	int value_count = 0;
+	uint32_t record_len = 0;
+	uint32_t slot;
+	struct CoalescedRecord *record;
+	struct CoalescedField *field;
+	char *values;
+	uint32_t pending_no;
+
+	/* Check that record buffer consists of values of all fields. */
+	modification_count = format_parse(format_buf, format_buf_len,
+		modification, MODIFICATION_FIELDS_MAX);
+	if (modification_count < 1) {
+		return ADAMOD_E_INVUPDATE;
+	}
+	for (field_no = 0; field_no < modification_count; field_no++) {
+		if (modification[field_no].length < 1) {
+			return ADAMOD_E_INVUPDATE;
+		}
+		if (modification[field_no].format != FIELD_SPACING) {
+			value_count++;
+		}
+		record_len += modification[field_no].length;
+	}
+	if (value_count == 0 || record_len != record_buf_len) {
+		return ADAMOD_E_INVUPDATE;
+	}
+
+	/* Find pending record or add new one. */
+	if ((coalescer->count + 1) * 2 > coalescer->index_size
+		&& index_grow(coalescer) != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_NOMEMORY;
+	}
+	slot = index_slot(coalescer, isn);
+	if (coalescer->index[slot] == 0) {
+		record = grow_buffer(coalescer->records, &coalescer->allocated,
+			coalescer->count + 1, sizeof(struct CoalescedRecord));
+		if (record == NULL) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		coalescer->records = record;
+		record = &coalescer->records[coalescer->count++];
+		record->isn = isn;
+		record->first_field = 0;
+		record->last_field = 0;
+		record->field_count = 0;
+		coalescer->index[slot] = coalescer->count;
+	} else {
+		record = &coalescer->records[coalescer->index[slot] - 1];
+		coalescer->merged++;
+	}
+
+	/* Keep values of fields (spacing elements are skipped). */
+	field = grow_buffer(coalescer->fields, &coalescer->fields_allocated,
+		coalescer->field_count + modification_count,
+		sizeof(struct CoalescedField));
+	if (field == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	coalescer->fields = field;
+	values = grow_buffer(coalescer->values, &coalescer->values_allocated,
+		coalescer->values_len + record_buf_len, 1);
+	if (values == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	coalescer->values = values;
+
+	for (field_no = 0; field_no < modification_count; field_no++) {
+		if (modification[field_no].format == FIELD_SPACING) {
+			record_buf += modification[field_no].length;
+			continue;
+		}
+
+		/* Field of the same name takes place of earlier value. */
+		field = NULL;
+		pending_no = record->first_field;
+		while (record->field_count > 0) {
+			if (strcmp(coalescer->fields[pending_no].name,
+				modification[field_no].name) == 0)
+			{
+				field = &coalescer->fields[pending_no];
+				break;
+			}
+			if (coalescer->fields[pending_no].next == 0) {
+				break;
+			}
+			pending_no = coalescer->fields[pending_no].next;
+		}
+
+		/* New fields are appended to fields of record. */
+		if (field == NULL) {
+			field = &coalescer->fields[coalescer->field_count];
+			strcpy(field->name, modification[field_no].name);
+			field->next = 0;
+			if (record->field_count > 0) {
+				coalescer->fields[record->last_field].next =
+					coalescer->field_count;
+			} else {
+				record->first_field = coalescer->field_count;
+			}
+			record->last_field = coalescer->field_count;
+			record->field_count++;
+			coalescer->field_count++;
+		}
+
+		field->length = modification[field_no].length;
+		field->format = modification[field_no].format;
+		field->value_pos = coalescer->values_len;
+		memcpy(coalescer->values + coalescer->values_len, record_buf,
+			field->length);
+		coalescer->values_len += field->length;
+
+		record_buf += modification[field_no].length;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Get number of pending records.
+ */
+uint32_t coalescer_count(const struct Coalescer *coalescer)
+{
+	return coalescer->count;
+}
+
+/*
+ * Get ISN and merged format and record buffers of pending record
+ * (specified by its number in order of first appearance). Buffers
+ * belong to coalescer and are valid until next call.
+ */
+int coalescer_get(struct Coalescer *coalescer, uint32_t record_no,
+	AdamodIsn *isn, char **format_buf, uint32_t *format_buf_len,
+	char **record_buf, uint32_t *record_buf_len)
+{
+	const struct CoalescedRecord *record = &coalescer->records[record_no];
+	const struct CoalescedField *field;
+	char *buf;
+	uint32_t field_no;
+	uint32_t pending_no;
+	uint32_t format_len = 1;
+	uint32_t record_len = 0;
+
+	/* Element of format buffer is ",name,length,format". */
+	pending_no = record->first_field;
+	for (field_no = 0; field_no < record->field_count; field_no++) {
+		field = &coalescer->fields[pending_no];
+		format_len += strlen(field->name) + 16;
+		record_len += field->length;
+		pending_no = field->next;
+	}
+	buf = grow_buffer(coalescer->format_buf, &coalescer->format_buf_size,
+		format_len, 1);
+	if (buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	coalescer->format_buf = buf;
+	buf = grow_buffer(coalescer->record_buf, &coalescer->record_buf_size,
+		record_len, 1);
+	if (buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	coalescer->record_buf = buf;
+
+	/* Build format and record buffers from the last values of fields. */
+	format_len = 0;
+	record_len = 0;
+	pending_no = record->first_field;
+	for (field_no = 0; field_no < record->field_count; field_no++) {
+		field = &coalescer->fields[pending_no];
+		if (field->format != 0) {
+			format_len += sprintf(coalescer->format_buf + format_len,
+				"%s%s,%d,%c", field_no > 0 ? "," : "", field->name,
+				field->length, field->format);
+		} else {
+			format_len += sprintf(coalescer->format_buf + format_len,
+				"%s%s,%d", field_no > 0 ? "," : "", field->name,
+				field->length);
+		}
+		memcpy(coalescer->record_buf + record_len,
+			coalescer->values + field->value_pos, field->length);
+		record_len += field->length;
+		pending_no = field->next;
+	}
+	coalescer->format_buf[format_len++] = '.';
+
+	*isn = record->isn;
+	*format_buf = coalescer->format_buf;
+	*format_buf_len = format_len;
+	*record_buf = coalescer->record_buf;
+	*record_buf_len = record_len;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Remove all pending records (memory is kept for next records).
+ */
+void coalescer_clear(struct Coalescer *coalescer)
+{
+	if (coalescer->index != NULL) {
+		memset(coalescer->index, 0,
+			coalescer->index_size * sizeof(uint32_t));
+	}
+	coalescer->count = 0;
+	coalescer->field_count = 0;
+	coalescer->values_len = 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(COALESCE_H)
+#define COALESCE_H
+
+#include <stdint.h>
+#include "format.h"
+
+/*
+ * Coalescer keeps pending modifications of records until they are
+ * dispatched. Modifications of the same record are merged field by
+ * field (the last value of every field wins), so every record is
+ * updated by one command. Pending records are found by ISN with
+ * open-addressing hash index.
+ */
+
+/* Field value of pending modification. */
+struct CoalescedField {
+	char name[FIELD_NAME_LEN + 1];
+	int length;
+	char format;
+	/* Position of field value in buffer of values. */
+	uint32_t value_pos;
+	/* Number of next field of the same record (0 - last field). */
+	uint32_t next;
+};
+
+/* Pending modification of record. */
+struct CoalescedRecord {
+	AdamodIsn isn;
+	uint32_t first_field;
+	uint32_t last_field;
+	uint32_t field_count;
+};
+
+/* Pending modifications of records in order of their first appearance. */
+struct Coalescer {
+	struct CoalescedRecord *records;
+	uint32_t count;
+	uint32_t allocated;
+
+	/* Hash index of records (number of record + 1, 0 - empty slot). */
+	uint32_t *index;
+	uint32_t index_size;
+
+	struct CoalescedField *fields;
+	uint32_t field_count;
+	uint32_t fields_allocated;
+
+	char *values;
+	uint32_t values_len;
+	uint32_t values_allocated;
+
+	/* Format and record buffers of merged modification. */
+	char *format_buf;
+	char *record_buf;
+	uint32_t format_buf_size;
+	uint32_t record_buf_size;
+
+	/* Number of modifications merged into pending records. */
+	AdamodIsn merged;
+};
+
+/* Initialize empty coalescer. */
+void coalescer_init(struct Coalescer *coalescer);
+/* Free memory of coalescer. */
+void coalescer_free(struct Coalescer *coalescer);
+/* Add modification of record (specified by ISN) to pending records. */
+int coalescer_add(struct Coalescer *coalescer, AdamodIsn isn,
+	const char *format_buf, uint32_t format_buf_len,
+	const char *record_buf, uint32_t record_buf_len);
+/* Get number of pending records. */
+uint32_t coalescer_count(const struct Coalescer *coalescer);
+/* Get ISN and merged format and record buffers of pending record. */
+int coalescer_get(struct Coalescer *coalescer, uint32_t record_no,
+	AdamodIsn *isn, char **format_buf, uint32_t *format_buf_len,
+	char **record_buf, uint32_t *record_buf_len);
+/* Remove all pending records. */
+void coalescer_clear(struct Coalescer *coalescer);
+
+#endif /* COALESCE_H */
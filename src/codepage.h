@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(CODEPAGE_H)
+#define CODEPAGE_H
+
+#include <stdint.h>
+#include "fdt.h"
+
+/*
+ * Alphanumeric values are translated between local codepage (of
+ * command line, input and output files) and codepage of database
+ * with 256-byte translation tables built once from Unicode mappings
+ * of both codepages.
+ */
+
+/* Build translation tables from "dbcodepage[,localcodepage]". */
+int codepage_open(const char *arg);
+/* Check whether values are translated. */
+int codepage_enabled(void);
+/* Translate buffer from local codepage to codepage of database. */
+void codepage_to_db(unsigned char *buf, uint32_t len);
+/* Translate buffer from codepage of database to local codepage. */
+void codepage_to_local(unsigned char *buf, uint32_t len);
+/* Convert letters of buffer in local codepage to upper or lower case. */
+void codepage_case(unsigned char *buf, uint32_t len, int upper);
+/* Get Unicode value of byte in local codepage (0xFFFD if unmapped). */
+uint16_t codepage_unicode(unsigned char c);
+/* Translate alphanumeric fields of record buffer described by layout. */
+int codepage_record(const struct RecordLayout *layout,
+	unsigned char *record_buf, uint32_t record_buf_len, int to_db);
+
+#endif /* CODEPAGE_H */
@@ -0,0 +1,1004 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adacall.h"
+#include "adamod.h"
+#include "compare.h"
+#include "control.h"
+#include "journal.h"
+#include "messages.h"
+#include "modify.h"
+#include "search.h"
+#include "tune.h"
+
+/* Signature of hash file. */
+#define HASH_SIGNATURE "ADAMODH1"
+#define HASH_SIGNATURE_LEN 8
+/*
+ * Length of hash file header (signature, target, ISNs per leaf, fanout,
+ * length of format buffer, number of leaves).
+ */
+#define HASH_HEADER_LEN 32
+/* Number of ISNs in range of leaf. */
+#define HASH_LEAF_ISNS 64
+/* Number of children of node. */
+#define HASH_FANOUT 16
+/* Maximal number of levels of hash tree. */
+#define HASH_LEVELS_MAX 16
+/* Initial number of leaves of built hash tree. */
+#define HASH_LEAVES_INIT 1024
+/* Size of record buffer for multi-fetch reading. */
+#define RECORD_BUF_SIZE (256 * 1024)
+/* Maximal length of line of update file (see module 'update'). */
+#define UPDATE_LINE_MAX 65535
+
+/* Hash tree read from hash file. */
+struct HashTree {
+	FILE *file;
+	uint16_t db_id;
+	uint16_t file_no;
+	char *format_buf;
+	uint32_t format_len;
+	int level_count;
+	uint64_t level_sizes[HASH_LEVELS_MAX];
+	long level_offsets[HASH_LEVELS_MAX];
+};
+
+/* Records of leaf read from one of files. */
+struct LeafRecords {
+	uint32_t count;
+	AdamodIsn isns[HASH_LEAF_ISNS];
+	uint32_t offsets[HASH_LEAF_ISNS];
+	uint32_t lens[HASH_LEAF_ISNS];
+	unsigned char *buf;
+	uint32_t len;
+	uint32_t size;
+};
+
+uint64_t hash_add_bytes(uint64_t hash, const unsigned char *buf, uint32_t len);
+uint64_t hash_record(AdamodIsn isn, const unsigned char *record,
+	uint32_t record_len);
+uint64_t hash_children(const uint64_t *children);
+int add_record_hash(AdamodIsn isn, uint64_t hash);
+int hash_scan(void);
+int write_hashes(FILE *file, const uint64_t *hashes, uint64_t count);
+int hash_write(void);
+int tree_open(struct HashTree *tree, const char *file_name,
+	uint16_t db_id, uint16_t file_no);
+void tree_close(struct HashTree *tree);
+int tree_block(struct HashTree *tree, int level, uint64_t first,
+	uint64_t *hashes);
+int read_leaf(const struct HashTree *tree, AdamodIsn first_isn,
+	struct LeafRecords *records);
+int report_divergent(AdamodIsn isn, int source_no, int in_target);
+int compare_leaf(uint64_t leaf_no);
+int compare_block(int level, uint64_t first);
+int open_databases(void);
+int close_databases(void);
+
+/* Hashes of leaves of built hash tree. */
+static uint64_t *leaf_hashes = NULL;
+static uint64_t leaf_count = 0;
+static uint64_t leaf_size = 0;
+
+/* Hash trees of source and target files. */
+static struct HashTree source_tree;
+static struct HashTree target_tree;
+
+/* Records of compared leaf. */
+static struct LeafRecords source_records;
+static struct LeafRecords target_records;
+
+/* Record buffer for multi-fetch reading. */
+static unsigned char *record_buf = NULL;
+
+/* Update file with values of divergent records of source file. */
+static FILE *update_file = NULL;
+
+/* Statistics. */
+static AdamodIsn rec_no = 0;
+static AdamodIsn divergent_records = 0;
+static AdamodIsn unwritten_records = 0;
+static unsigned long divergent_leaves = 0;
+static unsigned long long compared_hashes = 0;
+static time_t prev_time;
+
+/*
+ * Add bytes to 64-bit FNV-1a hash.
+ */
+uint64_t hash_add_bytes(uint64_t hash, const unsigned char *buf, uint32_t len)
+{
+	const uint64_t prime = ((uint64_t) 1 << 40) | 0x1B3;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ buf[i]) * prime;
+	}
+
+	return hash;
+}
+
+/*
+ * Hash ISN and fields of record. Hashes of records of leaf are added,
+ * so hash of leaf doesn't depend on order of reading.
+ */
+uint64_t hash_record(AdamodIsn isn, const unsigned char *record,
+	uint32_t record_len)
+{
+	uint64_t hash = ((uint64_t) 0xCBF29CE4UL << 32) | 0x84222325UL;
+	unsigned char isn_buf[8];
+
+	put_uint64(isn_buf, (uint64_t) isn);
+	hash = hash_add_bytes(hash, isn_buf, sizeof(isn_buf));
+
+	return hash_add_bytes(hash, record, record_len);
+}
+
+/*
+ * Hash children of node. Node without records has zero hash, so trees
+ * of files with different numbers of leaves are compared as if they
+ * were padded with empty leaves.
+ */
+uint64_t hash_children(const uint64_t *children)
+{
+	uint64_t hash = ((uint64_t) 0xCBF29CE4UL << 32) | 0x84222325UL;
+	unsigned char buf[HASH_FANOUT * 8];
+	int i, empty = 1;
+
+	for (i = 0; i < HASH_FANOUT; i++) {
+		put_uint64(buf + i * 8, children[i]);
+		if (children[i] != 0) {
+			empty = 0;
+		}
+	}
+
+	return empty ? 0 : hash_add_bytes(hash, buf, sizeof(buf));
+}
+
+/*
+ * Add hash of record to hash of its leaf.
+ */
+int add_record_hash(AdamodIsn isn, uint64_t hash)
+{
+	uint64_t leaf_no = (uint64_t) isn / HASH_LEAF_ISNS;
+	uint64_t *hashes;
+	uint64_t size;
+
+	if (leaf_no >= leaf_size) {
+		for (size = leaf_size; size <= leaf_no; size *= 2) {
+		}
+		hashes = realloc(leaf_hashes, (size_t) size * sizeof(uint64_t));
+		if (hashes == NULL) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		memset(hashes + leaf_size, 0,
+			(size_t) (size - leaf_size) * sizeof(uint64_t));
+		leaf_hashes = hashes;
+		leaf_size = size;
+	}
+
+	leaf_hashes[leaf_no] += hash;
+	if (leaf_no >= leaf_count) {
+		leaf_count = leaf_no + 1;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read all records of file in physical sequence with multi-fetch and
+ * add their hashes to leaves.
+ */
+int hash_scan(void)
+{
+	int result_code;
+	uint32_t format_len = strlen(options.hash_format_arg);
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+	unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+	uint32_t entry_count, entry_no, record_pos;
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L2 (Read Physical Sequence): read records in sequence
+	 * they are stored in Data Storage.
+	 */
+	acbx_init(&acbx, "L2", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOH", 4);
+	abd_init(&fb_abd, ABD_FORMAT, (char *) options.hash_format_arg,
+		format_len, format_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, RECORD_BUF_SIZE, 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	while (1) {
+		/* Pause or stop processing on request. */
+		result_code = check_control();
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxisl = tune_fetch_size(MULTIFETCH_MAX, MULTIFETCH_MAX);
+
+		/* Execute Adabas direct call command L2. */
+		if (adabas_call(&acbx, 3, abds) != ADA_NORMAL) {
+			/* Exit loop when all records readed. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				return ADAMOD_SUCCESS;
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_L2;
+		}
+
+		tune_fetch(adabas_call_usec());
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count > MULTIFETCH_MAX) {
+			return ADAMOD_E_INVRECORD;
+		}
+
+		record_pos = 0;
+		for (entry_no = 0; entry_no < entry_count; entry_no++) {
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response == ADA_EOF) {
+				return ADAMOD_SUCCESS;
+			}
+			if (entry.response != ADA_NORMAL) {
+				continue;
+			}
+			if (record_pos + entry.record_len > RECORD_BUF_SIZE) {
+				return ADAMOD_E_INVRECORD;
+			}
+
+			/* Records listed in exclusion files are not hashed. */
+			if (!isn_excluded(entry.isn)) {
+				result_code = add_record_hash(entry.isn,
+					hash_record(entry.isn, record_buf + record_pos,
+					entry.record_len));
+				if (result_code != ADAMOD_SUCCESS) {
+					return result_code;
+				}
+			}
+			record_pos += entry.record_len;
+
+			rec_no++;
+			print_progress(rec_no, &prev_time);
+		}
+	}
+}
+
+/*
+ * Write hashes of level of hash tree.
+ */
+int write_hashes(FILE *file, const uint64_t *hashes, uint64_t count)
+{
+	unsigned char buf[8];
+	uint64_t i;
+
+	for (i = 0; i < count; i++) {
+		put_uint64(buf, hashes[i]);
+		if (fwrite(buf, sizeof(buf), 1, file) != 1) {
+			return ADAMOD_E_HASH_IO;
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Write hash tree to hash file: header, format buffer and levels of
+ * tree from leaves up to root. File is written under temporary name
+ * and renamed, so comparison never reads partial file.
+ */
+int hash_write(void)
+{
+	FILE *file;
+	char *temp_name;
+	unsigned char buf[HASH_HEADER_LEN];
+	uint32_t format_len = strlen(options.hash_format_arg);
+	uint64_t *level = leaf_hashes;
+	uint64_t count = leaf_count;
+	uint64_t node_no;
+	int result_code;
+
+	temp_name = malloc(strlen(options.hash_file_name) + 5);
+	if (temp_name == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	sprintf(temp_name, "%s.tmp", options.hash_file_name);
+
+	file = fopen(temp_name, "wb");
+	if (file == NULL) {
+		free(temp_name);
+		return ADAMOD_E_HASH_IO;
+	}
+
+	memcpy(buf, HASH_SIGNATURE, HASH_SIGNATURE_LEN);
+	put_uint16(buf + 8, options.db_id);
+	put_uint16(buf + 10, options.file_no);
+	put_uint32(buf + 12, HASH_LEAF_ISNS);
+	put_uint32(buf + 16, HASH_FANOUT);
+	put_uint32(buf + 20, format_len);
+	put_uint64(buf + 24, leaf_count);
+	fwrite(buf, HASH_HEADER_LEN, 1, file);
+	fwrite(options.hash_format_arg, format_len, 1, file);
+	result_code = write_hashes(file, level, count);
+
+	/*
+	 * Nodes of upper level replace nodes of lower one in place,
+	 * children beyond end of level are empty.
+	 */
+	while (result_code == ADAMOD_SUCCESS && count > 1) {
+		for (node_no = 0; node_no * HASH_FANOUT < count; node_no++) {
+			uint64_t children[HASH_FANOUT];
+			uint64_t child_no;
+			int i;
+
+			for (i = 0; i < HASH_FANOUT; i++) {
+				child_no = node_no * HASH_FANOUT + i;
+				children[i] = child_no < count ? level[child_no] : 0;
+			}
+			level[node_no] = hash_children(children);
+		}
+		count = node_no;
+		result_code = write_hashes(file, level, count);
+	}
+
+	if (fclose(file) != 0) {
+		result_code = ADAMOD_E_HASH_IO;
+	}
+
+	/* Existing file must be removed before renaming on some systems. */
+	if (result_code == ADAMOD_SUCCESS) {
+		remove(options.hash_file_name);
+		if (rename(temp_name, options.hash_file_name) != 0) {
+			result_code = ADAMOD_E_HASH_IO;
+		}
+	}
+	if (result_code != ADAMOD_SUCCESS) {
+		remove(temp_name);
+	}
+
+	free(temp_name);
+
+	return result_code;
+}
+
+/*
+ * Open hash file built for specified file and locate levels of its
+ * hash tree.
+ */
+int tree_open(struct HashTree *tree, const char *file_name,
+	uint16_t db_id, uint16_t file_no)
+{
+	unsigned char buf[HASH_HEADER_LEN];
+	uint64_t size;
+	long offset;
+
+	tree->format_buf = NULL;
+	tree->file = fopen(file_name, "rb");
+	if (tree->file == NULL) {
+		return ADAMOD_E_HASH_IO;
+	}
+
+	if (fread(buf, HASH_HEADER_LEN, 1, tree->file) != 1
+		|| memcmp(buf, HASH_SIGNATURE, HASH_SIGNATURE_LEN) != 0
+		|| get_uint32(buf + 12) != HASH_LEAF_ISNS
+		|| get_uint32(buf + 16) != HASH_FANOUT)
+	{
+		return ADAMOD_E_INVHASH;
+	}
+
+	/* Hash tree must be built for compared file. */
+	tree->db_id = get_uint16(buf + 8);
+	tree->file_no = get_uint16(buf + 10);
+	if (tree->db_id != db_id || tree->file_no != file_no) {
+		fprintf(stderr, "Hash file %s is built for database %u, "
+			"file %u\n", file_name, (unsigned int) tree->db_id,
+			(unsigned int) tree->file_no);
+		return ADAMOD_E_INVHASH;
+	}
+
+	tree->format_len = get_uint32(buf + 20);
+	size = get_uint64(buf + 24);
+	if (tree->format_len == 0 || tree->format_len > UPDATE_LINE_MAX
+		|| size == 0)
+	{
+		return ADAMOD_E_INVHASH;
+	}
+	tree->format_buf = malloc(tree->format_len + 1);
+	if (tree->format_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	if (fread(tree->format_buf, tree->format_len, 1, tree->file) != 1) {
+		return ADAMOD_E_INVHASH;
+	}
+	tree->format_buf[tree->format_len] = '\0';
+
+	/* Every level has node per children of lower level up to root. */
+	offset = HASH_HEADER_LEN + (long) tree->format_len;
+	tree->level_count = 0;
+	while (1) {
+		if (tree->level_count >= HASH_LEVELS_MAX
+			|| size > (uint64_t) (LONG_MAX - offset) / 8)
+		{
+			return ADAMOD_E_INVHASH;
+		}
+		tree->level_sizes[tree->level_count] = size;
+		tree->level_offsets[tree->level_count++] = offset;
+		offset += (long) size * 8;
+		if (size == 1) {
+			break;
+		}
+		size = (size + HASH_FANOUT - 1) / HASH_FANOUT;
+	}
+
+	/* Truncated hash file is invalid. */
+	if (fseek(tree->file, 0, SEEK_END) != 0
+		|| ftell(tree->file) != offset)
+	{
+		return ADAMOD_E_INVHASH;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Close hash file.
+ */
+void tree_close(struct HashTree *tree)
+{
+	if (tree->file != NULL) {
+		fclose(tree->file);
+		tree->file = NULL;
+	}
+	free(tree->format_buf);
+	tree->format_buf = NULL;
+}
+
+/*
+ * Read hashes of nodes of level starting with specified one (children
+ * of one node). Nodes beyond end of level are empty. Levels above
+ * root of lower tree have it as first child of their first node.
+ */
+int tree_block(struct HashTree *tree, int level, uint64_t first,
+	uint64_t *hashes)
+{
+	unsigned char buf[HASH_FANOUT * 8];
+	uint64_t children[HASH_FANOUT];
+	size_t count, i;
+	int result_code;
+
+	memset(hashes, 0, HASH_FANOUT * sizeof(uint64_t));
+
+	if (level >= tree->level_count) {
+		if (first == 0) {
+			result_code = tree_block(tree, level - 1, 0, children);
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+			hashes[0] = hash_children(children);
+		}
+		return ADAMOD_SUCCESS;
+	}
+
+	if (first >= tree->level_sizes[level]) {
+		return ADAMOD_SUCCESS;
+	}
+	count = tree->level_sizes[level] - first < HASH_FANOUT
+		? (size_t) (tree->level_sizes[level] - first) : HASH_FANOUT;
+	if (fseek(tree->file, tree->level_offsets[level] + (long) first * 8,
+		SEEK_SET) != 0 || fread(buf, 8, count, tree->file) != count)
+	{
+		return ADAMOD_E_HASH_IO;
+	}
+	for (i = 0; i < count; i++) {
+		hashes[i] = get_uint64(buf + i * 8);
+	}
+	compared_hashes += count;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read records of leaf range of ISNs from file of hash tree with
+ * multi-fetch in sequence of ISNs.
+ */
+int read_leaf(const struct HashTree *tree, AdamodIsn first_isn,
+	struct LeafRecords *records)
+{
+	AdamodIsn isn = first_isn > 0 ? first_isn : 1;
+	AdamodIsn last_isn = first_isn + HASH_LEAF_ISNS - 1;
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+	unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+	uint32_t entry_count, entry_no, record_pos;
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L1 (Read Record) with option 'I': read record with
+	 * specified ISN or with the next higher one.
+	 */
+	acbx_init(&acbx, "L1", tree->db_id, tree->file_no);
+	memcpy(acbx.acbxcid, "AMOH", 4);
+	abd_init(&fb_abd, ABD_FORMAT, tree->format_buf, tree->format_len,
+		tree->format_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, RECORD_BUF_SIZE, 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	records->count = 0;
+	records->len = 0;
+	while (isn <= last_isn) {
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxcop[1] = 'I';
+		acbx.acbxisn = isn;
+		acbx.acbxisl = last_isn - isn + 1;
+
+		/* Execute Adabas direct call command L1. */
+		if (adabas_call(&acbx, 3, abds) != ADA_NORMAL) {
+			/* There are no records after read ones. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				return ADAMOD_SUCCESS;
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_L1;
+		}
+
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count == 0 || entry_count > MULTIFETCH_MAX) {
+			return ADAMOD_E_INVRECORD;
+		}
+
+		record_pos = 0;
+		for (entry_no = 0; entry_no < entry_count; entry_no++) {
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response == ADA_EOF || entry.isn > last_isn) {
+				return ADAMOD_SUCCESS;
+			}
+			isn = entry.isn + 1;
+			if (entry.response != ADA_NORMAL) {
+				continue;
+			}
+			if (record_pos + entry.record_len > RECORD_BUF_SIZE
+				|| records->count >= HASH_LEAF_ISNS)
+			{
+				return ADAMOD_E_INVRECORD;
+			}
+
+			/* Records of leaf are kept until both files are read. */
+			if (records->len + entry.record_len > records->size) {
+				uint32_t size = records->size > 0 ? records->size
+					: RECORD_BUF_SIZE;
+				unsigned char *buf;
+
+				while (records->len + entry.record_len > size) {
+					size *= 2;
+				}
+				buf = realloc(records->buf, size);
+				if (buf == NULL) {
+					return ADAMOD_E_NOMEMORY;
+				}
+				records->buf = buf;
+				records->size = size;
+			}
+			memcpy(records->buf + records->len, record_buf + record_pos,
+				entry.record_len);
+			records->isns[records->count] = entry.isn;
+			records->offsets[records->count] = records->len;
+			records->lens[records->count++] = entry.record_len;
+			records->len += entry.record_len;
+			record_pos += entry.record_len;
+
+			rec_no++;
+			print_progress(rec_no, &prev_time);
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Count divergent record and write its ISN to ISN log. Values of record
+ * existing in both files are written to update file from source one.
+ */
+int report_divergent(AdamodIsn isn, int source_no, int in_target)
+{
+	const unsigned char *record;
+	uint32_t record_len;
+
+	if (isn_excluded(isn)) {
+		return ADAMOD_SUCCESS;
+	}
+	divergent_records++;
+
+	if (options.verbose_level > 1) {
+		fprintf(stderr, "\rRecord %llu %s\n", (unsigned long long) isn,
+			source_no < 0 ? "is missing in source file"
+			: !in_target ? "is missing in target file" : "differs");
+	}
+
+	if (isn_writer_put(&isn_log, isn) != ADAMOD_SUCCESS) {
+		return ADAMOD_E_LOG_IO;
+	}
+
+	if (update_file == NULL || source_no < 0 || !in_target) {
+		return ADAMOD_SUCCESS;
+	}
+
+	/*
+	 * Line of update file is ended with line feed, so record buffer
+	 * can't contain it or end with carriage return.
+	 */
+	record = source_records.buf + source_records.offsets[source_no];
+	record_len = source_records.lens[source_no];
+	if (memchr(record, '\n', record_len) != NULL
+		|| (record_len > 0 && record[record_len - 1] == '\r')
+		|| record_len + source_tree.format_len + 24 > UPDATE_LINE_MAX)
+	{
+		unwritten_records++;
+		if (options.verbose_level > 1) {
+			fprintf(stderr, "\rRecord %llu can't be written to "
+				"update file\n", (unsigned long long) isn);
+		}
+		return ADAMOD_SUCCESS;
+	}
+
+	fprintf(update_file, "%llu %s", (unsigned long long) isn,
+		source_tree.format_buf);
+	fwrite(record, record_len, 1, update_file);
+	fputc('\n', update_file);
+	if (ferror(update_file)) {
+		return ADAMOD_E_OUTPUT_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read records of divergent leaf from both files and report records
+ * which differ or exist only in one of files.
+ */
+int compare_leaf(uint64_t leaf_no)
+{
+	AdamodIsn first_isn = (AdamodIsn) (leaf_no * HASH_LEAF_ISNS);
+	AdamodIsn source_isn, target_isn;
+	uint32_t source_no = 0, target_no = 0;
+	int result_code;
+
+	divergent_leaves++;
+
+	result_code = read_leaf(&source_tree, first_isn, &source_records);
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = read_leaf(&target_tree, first_isn, &target_records);
+	}
+
+	/* Records of both files are merged in sequence of ISNs. */
+	while (result_code == ADAMOD_SUCCESS
+		&& (source_no < source_records.count
+		|| target_no < target_records.count))
+	{
+		source_isn = source_no < source_records.count
+			? source_records.isns[source_no] : ~(AdamodIsn) 0;
+		target_isn = target_no < target_records.count
+			? target_records.isns[target_no] : ~(AdamodIsn) 0;
+
+		if (source_isn < target_isn) {
+			result_code = report_divergent(source_isn, source_no++, 0);
+		} else if (target_isn < source_isn) {
+			result_code = report_divergent(target_isn, -1, 1);
+			target_no++;
+		} else {
+			if (source_records.lens[source_no]
+				!= target_records.lens[target_no]
+				|| memcmp(source_records.buf
+				+ source_records.offsets[source_no],
+				target_records.buf + target_records.offsets[target_no],
+				source_records.lens[source_no]) != 0)
+			{
+				result_code = report_divergent(source_isn, source_no, 1);
+			}
+			source_no++;
+			target_no++;
+		}
+	}
+
+	return result_code;
+}
+
+/*
+ * Compare hashes of children of one node in both trees and descend
+ * into differing ones.
+ */
+int compare_block(int level, uint64_t first)
+{
+	uint64_t source_hashes[HASH_FANOUT];
+	uint64_t target_hashes[HASH_FANOUT];
+	int i;
+	int result_code;
+
+	/* Pause or stop processing on request. */
+	result_code = check_control();
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = tree_block(&source_tree, level, first, source_hashes);
+	}
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = tree_block(&target_tree, level, first, target_hashes);
+	}
+
+	for (i = 0; i < HASH_FANOUT && result_code == ADAMOD_SUCCESS; i++) {
+		if (source_hashes[i] == target_hashes[i]) {
+			continue;
+		}
+		result_code = level == 0 ? compare_leaf(first + i)
+			: compare_block(level - 1, (first + i) * HASH_FANOUT);
+	}
+
+	return result_code;
+}
+
+/*
+ * Open source and target databases for reading. Files of the same
+ * database are opened together.
+ */
+int open_databases(void)
+{
+	char db_options[30];
+
+	if (options.source_db_id == options.db_id) {
+		if (options.source_file_no == options.file_no) {
+			sprintf(db_options, "ACC=%d.", options.file_no);
+		} else {
+			sprintf(db_options, "ACC=%d,%d.", options.source_file_no,
+				options.file_no);
+		}
+		return db_open(options.db_id, db_options) != ADA_NORMAL
+			? ADAMOD_E_ADABAS_OP : ADAMOD_SUCCESS;
+	}
+
+	sprintf(db_options, "ACC=%d.", options.source_file_no);
+	if (db_open(options.source_db_id, db_options) != ADA_NORMAL) {
+		return ADAMOD_E_ADABAS_OP;
+	}
+	sprintf(db_options, "ACC=%d.", options.file_no);
+	if (db_open(options.db_id, db_options) != ADA_NORMAL) {
+		db_close(options.source_db_id);
+		return ADAMOD_E_ADABAS_OP;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Close source and target databases.
+ */
+int close_databases(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+
+	if (options.source_db_id != options.db_id
+		&& db_close(options.source_db_id) != ADA_NORMAL)
+	{
+		result_code = ADAMOD_E_ADABAS_CL;
+	}
+	if (db_close(options.db_id) != ADA_NORMAL) {
+		result_code = ADAMOD_E_ADABAS_CL;
+	}
+
+	return result_code;
+}
+
+/*
+ * Build hash tree of specified fields of all records in Adabas file
+ * and write it to hash file.
+ */
+int hash_file_records(void)
+{
+	int return_code;
+	char db_options[30];
+	time_t start_time;
+
+	record_buf = malloc(RECORD_BUF_SIZE);
+	leaf_hashes = calloc(HASH_LEAVES_INIT, sizeof(uint64_t));
+	if (record_buf == NULL || leaf_hashes == NULL) {
+		free(record_buf);
+		free(leaf_hashes);
+		return ADAMOD_E_NOMEMORY;
+	}
+	leaf_size = HASH_LEAVES_INIT;
+	leaf_count = 1;
+
+	/* Open Adabas database for reading. */
+	sprintf(db_options, "ACC=%d.", options.file_no);
+	if (db_open(options.db_id, db_options) != ADA_NORMAL) {
+		free(record_buf);
+		free(leaf_hashes);
+		return ADAMOD_E_ADABAS_OP;
+	}
+
+	/* Processing may be paused and stopped by signals. */
+	control_init();
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	return_code = hash_scan();
+
+	/* Close Adabas database. */
+	if (db_close(options.db_id) != ADA_NORMAL
+		&& return_code == ADAMOD_SUCCESS)
+	{
+		return_code = ADAMOD_E_ADABAS_CL;
+	}
+
+	/* Hash tree of stopped scan is incomplete. */
+	if (return_code == ADAMOD_SUCCESS) {
+		return_code = hash_write();
+	}
+	free(record_buf);
+	free(leaf_hashes);
+
+	if (return_code == ADAMOD_SUCCESS) {
+		fprintf(stderr, "\rHashed records: %llu, leaves: %llu\n",
+			(unsigned long long) rec_no,
+			(unsigned long long) leaf_count);
+		print_summary(rec_no, start_time);
+	}
+
+	return return_code;
+}
+
+/*
+ * Compare hash trees of source and target files and read records of
+ * differing leaves from both files. ISNs of divergent records are
+ * written to ISN log, values of source records to update file.
+ */
+int compare_file_records(void)
+{
+	int return_code;
+	time_t start_time;
+	int level_count;
+
+	/* Hash trees are compared only when they hash the same fields. */
+	return_code = tree_open(&source_tree, options.source_hash_file_name,
+		options.source_db_id, options.source_file_no);
+	if (return_code == ADAMOD_SUCCESS) {
+		return_code = tree_open(&target_tree, options.hash_file_name,
+			options.db_id, options.file_no);
+	}
+	if (return_code == ADAMOD_SUCCESS
+		&& (source_tree.format_len != target_tree.format_len
+		|| memcmp(source_tree.format_buf, target_tree.format_buf,
+		source_tree.format_len) != 0))
+	{
+		fprintf(stderr, "Hash files are built for different fields\n");
+		return_code = ADAMOD_E_INVHASH;
+	}
+
+	/* Update file is written to standard output by default. */
+	if (return_code == ADAMOD_SUCCESS && options.output_file_name != NULL) {
+		update_file = strcmp(options.output_file_name, "-") != 0
+			? fopen(options.output_file_name, "wb") : stdout;
+		if (update_file == NULL) {
+			return_code = ADAMOD_E_OUTPUT_IO;
+		}
+	}
+
+	record_buf = malloc(RECORD_BUF_SIZE);
+	if (return_code == ADAMOD_SUCCESS && record_buf == NULL) {
+		return_code = ADAMOD_E_NOMEMORY;
+	}
+
+	if (return_code == ADAMOD_SUCCESS) {
+		return_code = open_databases();
+	}
+	if (return_code != ADAMOD_SUCCESS) {
+		if (update_file != NULL && update_file != stdout) {
+			fclose(update_file);
+		}
+		tree_close(&source_tree);
+		tree_close(&target_tree);
+		free(record_buf);
+		return return_code;
+	}
+
+	/* Processing may be paused and stopped by signals. */
+	control_init();
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	/* Comparison starts from the root of higher tree. */
+	level_count = source_tree.level_count > target_tree.level_count
+		? source_tree.level_count : target_tree.level_count;
+	return_code = compare_block(level_count - 1, 0);
+
+	/* Close Adabas databases. */
+	if (close_databases() != ADAMOD_SUCCESS
+		&& return_code == ADAMOD_SUCCESS)
+	{
+		return_code = ADAMOD_E_ADABAS_CL;
+	}
+	if (update_file != NULL) {
+		if ((update_file != stdout ? fclose(update_file)
+			: fflush(update_file)) != 0 && return_code == ADAMOD_SUCCESS)
+		{
+			return_code = ADAMOD_E_OUTPUT_IO;
+		}
+	}
+	tree_close(&source_tree);
+	tree_close(&target_tree);
+	free(source_records.buf);
+	free(target_records.buf);
+	free(record_buf);
+
+	if (return_code == ADAMOD_SUCCESS || return_code == ADAMOD_M_STOPPED) {
+		fprintf(stderr, "\rCompared hashes: %llu, divergent ranges: %lu, "
+			"divergent records: %llu\n", compared_hashes,
+			divergent_leaves, (unsigned long long) divergent_records);
+		if (unwritten_records > 0) {
+			fprintf(stderr, "Records not written to update file: %llu\n",
+				(unsigned long long) unwritten_records);
+		}
+		print_summary(rec_no, start_time);
+	}
+
+	/* Divergent records are reported as failure. */
+	if (return_code == ADAMOD_SUCCESS && divergent_records > 0) {
+		return_code = ADAMOD_E_DIVERGENT;
+	}
+
+	return return_code;
+}
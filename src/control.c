@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(_WIN32)
+/* Function sigaction() and flag SA_RESETHAND need X/Open sources. */
+#define _XOPEN_SOURCE 500
+#endif
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "adamod.h"
+#include "control.h"
+#include "timer.h"
+#include "trace.h"
+
+/* Interval of checking state of paused processing. */
+#define CONTROL_POLL_USEC 500000
+
+void control_signal(int signal_no);
+int in_time_window(void);
+
+/* Requests received with signals. */
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t pause_requested = 0;
+
+/*
+ * Handle signal controlling processing: SIGINT and SIGTERM stop
+ * processing, SIGUSR1 pauses it and SIGUSR2 resumes it.
+ */
+void control_signal(int signal_no)
+{
+	if (signal_no == SIGINT || signal_no == SIGTERM) {
+		stop_requested = 1;
+	}
+#if defined(SIGUSR1)
+	if (signal_no == SIGUSR1) {
+		pause_requested = 1;
+	} else if (signal_no == SIGUSR2) {
+		pause_requested = 0;
+	}
+#endif
+}
+
+/*
+ * Install handlers of signals controlling processing. Handler of stop
+ * signals is reset after first signal, so repeated signal terminates
+ * process at once. Interrupted reads and waits are not restarted.
+ */
+void control_init(void)
+{
+#if defined(_WIN32)
+	signal(SIGINT, control_signal);
+	signal(SIGTERM, control_signal);
+#else
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	sigemptyset(&action.sa_mask);
+	action.sa_handler = control_signal;
+	action.sa_flags = SA_RESETHAND;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	action.sa_flags = 0;
+	sigaction(SIGUSR1, &action, NULL);
+	sigaction(SIGUSR2, &action, NULL);
+#endif
+}
+
+/*
+ * Check whether current time is inside of allowed time window
+ * (checked once a second).
+ */
+int in_time_window(void)
+{
+	static time_t check_time = 0;
+	static int inside = 1;
+	time_t now;
+	struct tm *local;
+	int minutes;
+
+	if (options.window_start < 0) {
+		return 1;
+	}
+
+	time(&now);
+	if (now == check_time) {
+		return inside;
+	}
+	check_time = now;
+
+	local = localtime(&now);
+	minutes = local->tm_hour * 60 + local->tm_min;
+	if (options.window_start <= options.window_end) {
+		inside = minutes >= options.window_start
+			&& minutes < options.window_end;
+	} else {
+		/* Window crosses midnight. */
+		inside = minutes >= options.window_start
+			|| minutes < options.window_end;
+	}
+
+	return inside;
+}
+
+/*
+ * Get requested state of processing.
+ */
+ControlState control_state(void)
+{
+	if (stop_requested) {
+		return CONTROL_STOP;
+	}
+	if (pause_requested || !in_time_window()) {
+		return CONTROL_PAUSE;
+	}
+
+	return CONTROL_RUN;
+}
+
+/*
+ * Wait while processing is paused. Function poll (if any) is called
+ * on every check of state. Returns state of processing after pause.
+ */
+ControlState control_wait(void (*poll)(void))
+{
+	ControlState state;
+	uint64_t start_usec = timer_usec();
+
+	if (options.verbose_level > 0) {
+		fputs("\rProcessing paused\n", stderr);
+	}
+	while ((state = control_state()) == CONTROL_PAUSE) {
+		if (poll != NULL) {
+			poll();
+		}
+		timer_sleep(CONTROL_POLL_USEC);
+	}
+	trace_span("pause", "wait", start_usec, timer_usec());
+	if (state == CONTROL_RUN && options.verbose_level > 0) {
+		fputs("Processing resumed\n", stderr);
+	}
+
+	return state;
+}
+
+/*
+ * Parse time window "HH:MM-HH:MM" into minutes since midnight.
+ */
+int parse_time_window(const char *str, int *start, int *end)
+{
+	unsigned int start_hour, start_minute, end_hour, end_minute;
+	char tail;
+
+	if (sscanf(str, "%u:%u-%u:%u%c", &start_hour, &start_minute,
+		&end_hour, &end_minute, &tail) != 4
+		|| start_hour > 23 || start_minute > 59
+		|| end_hour > 24 || end_minute > 59
+		|| (end_hour == 24 && end_minute > 0))
+	{
+		return ADAMOD_E_INVARG;
+	}
+
+	*start = start_hour * 60 + start_minute;
+	*end = end_hour * 60 + end_minute;
+	if (*start == *end) {
+		return ADAMOD_E_INVARG;
+	}
+
+	return ADAMOD_SUCCESS;
+}
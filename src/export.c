@@ -0,0 +1,926 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adacall.h"
+#include "adamod.h"
+#include "codepage.h"
+#include "export.h"
+#include "format.h"
+#include "messages.h"
+#include "search.h"
+#include "tune.h"
+
+/* Size of output file buffer. */
+#define OUTPUT_BUF_SIZE (1024 * 1024)
+/* Size of record buffer for multi-fetch reading. */
+#define RECORD_BUF_SIZE (256 * 1024)
+/* Maximal number of exported fields. */
+#define EXPORT_FIELDS_MAX 1024
+
+int export_open(void);
+int export_close(void);
+int export_record(AdamodIsn isn, unsigned char *record,
+	uint32_t record_len);
+void export_value(const struct FormatField *field,
+	const unsigned char *value, int value_len);
+void export_string(const unsigned char *value, int value_len);
+void export_number(const struct FormatField *field,
+	const unsigned char *value, int value_len);
+void export_hex(const unsigned char *value, int value_len);
+int fetch_records(ACBX *acbx, int abd_count, ABD **abds,
+	AdamodStateCode error_code);
+int export_isn(AdamodIsn isn);
+int export_search(void);
+uint32_t selected_span(const struct IsnSet *set, AdamodIsn isn);
+int export_selected(const struct IsnSet *set);
+int export_select(void);
+int export_scan(void);
+
+/* Names of export formats. */
+static const char *export_format_names[] = { "csv", "json", "binary",
+	NULL };
+
+/* Output file and its buffer. */
+static FILE *output_file = NULL;
+static char *output_buf = NULL;
+
+/* Format buffer of exported fields and fields parsed from it. */
+static char *format_buf = NULL;
+static uint32_t format_buf_len = 0;
+static struct FormatField fields[EXPORT_FIELDS_MAX];
+static int field_count = 0;
+
+/* Buffers for multi-fetch reading. */
+static unsigned char *record_buf = NULL;
+static unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+
+/* Selected records exported in physical sequence (if any). */
+static const struct IsnSet *selection = NULL;
+
+/* Counter of exported records and time of last progress message. */
+static AdamodIsn rec_no = 0;
+static time_t prev_time;
+
+/*
+ * Get format of exported records by its name.
+ */
+int export_format(const char *name, ExportFormat *format)
+{
+	int format_no;
+
+	for (format_no = 0; export_format_names[format_no] != NULL;
+		format_no++)
+	{
+		if (strcmp(name, export_format_names[format_no]) == 0) {
+			*format = (ExportFormat) format_no;
+			return ADAMOD_SUCCESS;
+		}
+	}
+
+	return ADAMOD_E_INVARG;
+}
+
+/*
+ * Open output file and write header of exported data.
+ */
+int export_open(void)
+{
+	int field_no;
+
+	if (options.output_file_name != NULL
+		&& strcmp(options.output_file_name, "-") != 0)
+	{
+		output_file = fopen(options.output_file_name, "wb");
+		if (output_file == NULL) {
+			return ADAMOD_E_OUTPUT_IO;
+		}
+	} else {
+		output_file = stdout;
+	}
+
+	/* Exported data is written with large sequential writes. */
+	output_buf = malloc(OUTPUT_BUF_SIZE);
+	if (output_buf != NULL) {
+		setvbuf(output_file, output_buf, _IOFBF, OUTPUT_BUF_SIZE);
+	}
+
+	if (options.export_format == EXPORT_BINARY) {
+		/*
+		 * Binary export starts with signature and format buffer,
+		 * followed by records (8-byte ISN, 4-byte record length and
+		 * record buffer), all numbers in little-endian byte order.
+		 */
+		unsigned char buf[4];
+
+		buf[0] = (unsigned char) (format_buf_len & 0xFF);
+		buf[1] = (unsigned char) ((format_buf_len >> 8) & 0xFF);
+		buf[2] = (unsigned char) ((format_buf_len >> 16) & 0xFF);
+		buf[3] = (unsigned char) (format_buf_len >> 24);
+		fwrite(EXPORT_SIGNATURE, EXPORT_SIGNATURE_LEN, 1, output_file);
+		fwrite(buf, sizeof(buf), 1, output_file);
+		fwrite(format_buf, format_buf_len, 1, output_file);
+	} else if (options.export_format == EXPORT_CSV) {
+		/* CSV header contains names of exported fields. */
+		fputs("ISN", output_file);
+		for (field_no = 0; field_no < field_count; field_no++) {
+			if (fields[field_no].format != FIELD_SPACING) {
+				fprintf(output_file, ",%s", fields[field_no].name);
+			}
+		}
+		fputc('\n', output_file);
+	}
+
+	return ferror(output_file) ? ADAMOD_E_OUTPUT_IO : ADAMOD_SUCCESS;
+}
+
+/*
+ * Write rest of exported data and close output file.
+ */
+int export_close(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+
+	if (output_file == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	if (fflush(output_file) != 0 || ferror(output_file)) {
+		result_code = ADAMOD_E_OUTPUT_IO;
+	}
+
+	/* Buffer of standard output stays in use until exit. */
+	if (output_file != stdout) {
+		if (fclose(output_file) != 0) {
+			result_code = ADAMOD_E_OUTPUT_IO;
+		}
+		free(output_buf);
+	}
+	output_file = NULL;
+	output_buf = NULL;
+
+	return result_code;
+}
+
+/*
+ * Write record to output in selected export format.
+ */
+int export_record(AdamodIsn isn, unsigned char *record,
+	uint32_t record_len)
+{
+	uint32_t pos = 0;
+	int field_no;
+	int separator = 0;
+
+	/* Skip records listed in exclusion files or not selected. */
+	if (isn_excluded(isn)
+		|| (selection != NULL && !isn_set_contains(selection, isn)))
+	{
+		return ADAMOD_SUCCESS;
+	}
+
+	/* Increase records counter. */
+	rec_no++;
+
+	/* Log ISN of record for high verbose levels. */
+	if (options.verbose_level > 2
+		&& isn_writer_put(&isn_log, isn) != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_LOG_IO;
+	}
+
+	if (options.export_format == EXPORT_BINARY) {
+		unsigned char buf[12];
+		int byte_no;
+
+		for (byte_no = 0; byte_no < 8; byte_no++) {
+			buf[byte_no] = (unsigned char) ((isn >> (byte_no * 8))
+				& 0xFF);
+		}
+		for (byte_no = 0; byte_no < 4; byte_no++) {
+			buf[8 + byte_no] = (unsigned char)
+				((record_len >> (byte_no * 8)) & 0xFF);
+		}
+		fwrite(buf, sizeof(buf), 1, output_file);
+		fwrite(record, record_len, 1, output_file);
+	} else {
+		if (options.export_format == EXPORT_JSON) {
+			fprintf(output_file, "{\"ISN\":%llu",
+				(unsigned long long) isn);
+		} else {
+			fprintf(output_file, "%llu", (unsigned long long) isn);
+		}
+		separator = 1;
+
+		/* Split record buffer into values of fields. */
+		for (field_no = 0; field_no < field_count; field_no++) {
+			const struct FormatField *field = &fields[field_no];
+			unsigned char *value = record + pos;
+			int value_len = field->length;
+
+			if (field->length == 0) {
+				/* Variable length value starts with its length. */
+				if (pos >= record_len || record[pos] < 1) {
+					return ADAMOD_E_INVRECORD;
+				}
+				value = record + pos + 1;
+				value_len = record[pos] - 1;
+				pos++;
+			}
+			if (pos + value_len > record_len) {
+				return ADAMOD_E_INVRECORD;
+			}
+			pos += value_len;
+
+			if (field->format == FIELD_SPACING) {
+				continue;
+			}
+
+			/* Alphanumeric values are translated to local codepage. */
+			if (field->format == 'A' || field->format == 0) {
+				codepage_to_local(value, value_len);
+			}
+
+			if (separator) {
+				fputc(',', output_file);
+			}
+			if (options.export_format == EXPORT_JSON) {
+				fprintf(output_file, "\"%s\":", field->name);
+			}
+			export_value(field, value, value_len);
+		}
+
+		if (options.export_format == EXPORT_JSON) {
+			fputc('}', output_file);
+		}
+		fputc('\n', output_file);
+	}
+
+	if (ferror(output_file)) {
+		return ADAMOD_E_OUTPUT_IO;
+	}
+
+	/* Print process status. */
+	print_progress(rec_no, &prev_time);
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Write value of field according to its format.
+ */
+void export_value(const struct FormatField *field,
+	const unsigned char *value, int value_len)
+{
+	switch (field->format) {
+	case 'U':
+	case 'P':
+	case 'F':
+	case 'G':
+		export_number(field, value, value_len);
+		break;
+	case 'B':
+	case 'W':
+		export_hex(value, value_len);
+		break;
+	default:
+		/* Alphanumeric value without trailing blanks. */
+		while (value_len > 0 && (value[value_len - 1] == ' '
+			|| value[value_len - 1] == '\0'))
+		{
+			value_len--;
+		}
+		export_string(value, value_len);
+		break;
+	}
+}
+
+/*
+ * Write string value quoted for CSV or JSON. JSON text is encoded
+ * in UTF-8, so characters of local codepage above 127 are converted.
+ */
+void export_string(const unsigned char *value, int value_len)
+{
+	int i;
+	uint16_t unicode;
+
+	if (options.export_format == EXPORT_JSON) {
+		fputc('"', output_file);
+		for (i = 0; i < value_len; i++) {
+			if (value[i] == '"' || value[i] == '\\') {
+				fputc('\\', output_file);
+				fputc(value[i], output_file);
+			} else if (value[i] < 0x20) {
+				fprintf(output_file, "\\u%04X", value[i]);
+			} else if (value[i] >= 0x80) {
+				unicode = codepage_unicode(value[i]);
+				if (unicode < 0x800) {
+					fputc(0xC0 | (unicode >> 6), output_file);
+				} else {
+					fputc(0xE0 | (unicode >> 12), output_file);
+					fputc(0x80 | ((unicode >> 6) & 0x3F), output_file);
+				}
+				fputc(0x80 | (unicode & 0x3F), output_file);
+			} else {
+				fputc(value[i], output_file);
+			}
+		}
+		fputc('"', output_file);
+		return;
+	}
+
+	/* CSV value is quoted only when it contains special characters. */
+	for (i = 0; i < value_len; i++) {
+		if (value[i] == ',' || value[i] == '"' || value[i] == '\n'
+			|| value[i] == '\r')
+		{
+			break;
+		}
+	}
+	if (i == value_len) {
+		fwrite(value, value_len, 1, output_file);
+		return;
+	}
+
+	fputc('"', output_file);
+	for (i = 0; i < value_len; i++) {
+		if (value[i] == '"') {
+			fputc('"', output_file);
+		}
+		fputc(value[i], output_file);
+	}
+	fputc('"', output_file);
+}
+
+/*
+ * Write numeric value (unpacked, packed, fixed point or floating point).
+ */
+void export_number(const struct FormatField *field,
+	const unsigned char *value, int value_len)
+{
+	char digits[64];
+	int digit_count = 0;
+	int negative = 0;
+	int i;
+
+	if (value_len < 1) {
+		fputc('0', output_file);
+		return;
+	}
+
+	if (field->format == 'F') {
+		/* Fixed point values are stored in native byte order. */
+		long long number;
+
+		if (value_len == 1) {
+			number = (signed char) value[0];
+		} else if (value_len == 2) {
+			int16_t n;
+			memcpy(&n, value, 2);
+			number = n;
+		} else if (value_len == 4) {
+			int32_t n;
+			memcpy(&n, value, 4);
+			number = n;
+		} else if (value_len == 8) {
+			int64_t n;
+			memcpy(&n, value, 8);
+			number = n;
+		} else {
+			export_hex(value, value_len);
+			return;
+		}
+		fprintf(output_file, "%lld", number);
+		return;
+	}
+
+	if (field->format == 'G') {
+		/* Floating point values are stored in native format. */
+		if (value_len == 4) {
+			float n;
+			memcpy(&n, value, 4);
+			fprintf(output_file, "%.9g", (double) n);
+		} else if (value_len == 8) {
+			double n;
+			memcpy(&n, value, 8);
+			fprintf(output_file, "%.17g", n);
+		} else {
+			export_hex(value, value_len);
+		}
+		return;
+	}
+
+	if (field->format == 'U') {
+		/*
+		 * Unpacked decimal: one digit per byte, sign in zone
+		 * of last byte.
+		 */
+		for (i = 0; i < value_len && digit_count < 63; i++) {
+			digits[digit_count++] = (char) ('0' + (value[i] & 0x0F));
+		}
+		negative = (value[value_len - 1] & 0xF0) == 0x70
+			|| (value[value_len - 1] & 0xF0) == 0xD0;
+	} else {
+		/* Packed decimal: two digits per byte, sign in last nibble. */
+		for (i = 0; i < value_len && digit_count < 62; i++) {
+			digits[digit_count++] = (char) ('0' + (value[i] >> 4));
+			if (i < value_len - 1) {
+				digits[digit_count++] = (char)
+					('0' + (value[i] & 0x0F));
+			}
+		}
+		negative = (value[value_len - 1] & 0x0F) == 0x0B
+			|| (value[value_len - 1] & 0x0F) == 0x0D;
+	}
+	digits[digit_count] = '\0';
+
+	/* Skip leading zeros (keep at least one digit). */
+	for (i = 0; i < digit_count - 1 && digits[i] == '0'; i++) {
+	}
+	if (negative && strspn(digits + i, "0") != strlen(digits + i)) {
+		fputc('-', output_file);
+	}
+	fputs(digits + i, output_file);
+}
+
+/*
+ * Write binary value in hexadecimal representation.
+ */
+void export_hex(const unsigned char *value, int value_len)
+{
+	int i;
+
+	if (options.export_format == EXPORT_JSON) {
+		fputc('"', output_file);
+	}
+	for (i = 0; i < value_len; i++) {
+		fprintf(output_file, "%02X", value[i]);
+	}
+	if (options.export_format == EXPORT_JSON) {
+		fputc('"', output_file);
+	}
+}
+
+/*
+ * Execute multi-fetch read command repeatedly and export all
+ * returned records.
+ */
+int fetch_records(ACBX *acbx, int abd_count, ABD **abds,
+	AdamodStateCode error_code)
+{
+	int result_code;
+	uint32_t entry_count;
+	uint32_t entry_no;
+	uint32_t record_pos;
+
+	while (1) {
+		/*
+		 * Command option 1 'M' (multi-fetch): ISN lower limit
+		 * specifies maximal number of records returned by command.
+		 */
+		acbx->acbxcop[0] = 'M';
+		acbx->acbxisl = tune_fetch_size(MULTIFETCH_MAX, MULTIFETCH_MAX);
+
+		/* Execute Adabas direct call command. */
+		if (adabas_call(acbx, abd_count, abds) != ADA_NORMAL) {
+			/* Exit loop when all records readed. */
+			if (acbx->acbxrsp == ADA_EOF) {
+				break;
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(acbx);
+			}
+			return error_code;
+		}
+
+		tune_fetch(adabas_call_usec());
+
+		/* Records are placed in record buffer one after another. */
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count > MULTIFETCH_MAX) {
+			return ADAMOD_E_INVRECORD;
+		}
+
+		record_pos = 0;
+		for (entry_no = 0; entry_no < entry_count; entry_no++) {
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response == ADA_EOF) {
+				return ADAMOD_SUCCESS;
+			}
+			if (entry.response == ADA_NORMAL) {
+				if (record_pos + entry.record_len > RECORD_BUF_SIZE) {
+					return ADAMOD_E_INVRECORD;
+				}
+				result_code = export_record(entry.isn,
+					record_buf + record_pos, entry.record_len);
+				if (result_code != ADAMOD_SUCCESS) {
+					return result_code;
+				}
+				record_pos += entry.record_len;
+			} else if (options.verbose_level > 1) {
+				/* Record may be deleted after search. */
+				fprintf(stderr, "\rRecord %lu skipped, "
+					"response code %lu\n",
+					(unsigned long) entry.isn,
+					(unsigned long) entry.response);
+			}
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Export one record specified by ISN.
+ */
+int export_isn(AdamodIsn isn)
+{
+	ACBX acbx;
+	ABD fb_abd, rb_abd;
+	ABD *abds[2];
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L1 (Read ISN): read record with specified ISN.
+	 */
+	acbx_init(&acbx, "L1", options.db_id, options.file_no);
+	acbx.acbxisn = isn;
+	abd_init(&fb_abd, ABD_FORMAT, format_buf, format_buf_len,
+		format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, RECORD_BUF_SIZE, 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+
+	/* Execute Adabas direct call command L1. */
+	if (adabas_call(&acbx, 2, abds) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_L1;
+	}
+
+	return export_record(isn, record_buf,
+		(uint32_t) rb_abd.abdrecv);
+}
+
+/*
+ * Export records found according to specified search argument.
+ */
+int export_search(void)
+{
+	ACBX acbx;
+	ABD fb_abd, sb_abd, vb_abd, ib_abd, rb_abd, mb_abd;
+	ABD *abds[4];
+
+	/*
+	 * Get search and value buffers from command line argument
+	 * (split argument by delimiter '.').
+	 */
+	char *search_buf = (char *) options.search_args[0].arg;
+	char *value_buf = strchr(search_buf, '.') + 1;
+	uint32_t search_buf_len = value_buf - search_buf;
+	uint32_t value_buf_len = strlen(value_buf);
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command S1 (Find Records): select a set of records which
+	 * satisfy given search criteria. ISN buffer is empty, so whole
+	 * ISN list is saved by nucleus under command identifier.
+	 */
+	acbx_init(&acbx, "S1", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOX", 4);
+	abd_init(&fb_abd, ABD_FORMAT, (char *) ".", 1, 1);
+	abd_init(&sb_abd, ABD_SEARCH, search_buf, search_buf_len,
+		search_buf_len);
+	abd_init(&vb_abd, ABD_VALUE, value_buf, value_buf_len, value_buf_len);
+	abd_init(&ib_abd, ABD_ISN, NULL, 0, 0);
+	abds[0] = &fb_abd;
+	abds[1] = &sb_abd;
+	abds[2] = &vb_abd;
+	abds[3] = &ib_abd;
+
+	/* Execute Adabas direct call command S1. */
+	if (adabas_call(&acbx, 4, abds) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_S1;
+	}
+
+	/* Print number of found records. */
+	if (options.verbose_level > 0) {
+		fprintf(stderr, "Found records: %llu\n",
+			(unsigned long long) acbx.acbxisq);
+	}
+	if (acbx.acbxisq == 0) {
+		return ADAMOD_SUCCESS;
+	}
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L1 with option 'N' (Read ISN, GET NEXT): read records
+	 * with ISNs from saved ISN list.
+	 */
+	acbx_init(&acbx, "L1", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOX", 4);
+	acbx.acbxcop[1] = 'N';
+	abd_init(&fb_abd, ABD_FORMAT, format_buf, format_buf_len,
+		format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, RECORD_BUF_SIZE, 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	return fetch_records(&acbx, 3, abds, ADAMOD_E_ADABAS_L1);
+}
+
+/*
+ * Get number of records read with multi-fetch from selected ISN:
+ * records are read up to the last selected ISN, before which at least
+ * half of ISNs are selected, so sparse records are read one by one.
+ */
+uint32_t selected_span(const struct IsnSet *set, AdamodIsn isn)
+{
+	struct IsnSetIterator iterator;
+	AdamodIsn selected_isn, end_isn = isn;
+	uint32_t fetch_size, selected_count = 0;
+
+	fetch_size = tune_fetch_size(MULTIFETCH_MAX, MULTIFETCH_MAX);
+	isn_set_seek(set, &iterator, isn);
+	while (isn_set_next(set, &iterator, &selected_isn)
+		&& selected_isn - isn < fetch_size)
+	{
+		selected_count++;
+		if (selected_count * 2 >= selected_isn - isn + 1) {
+			end_isn = selected_isn;
+		}
+	}
+
+	return (uint32_t) (end_isn - isn + 1);
+}
+
+/*
+ * Export selected records in order of ISNs. Spans of selected ISNs
+ * are read with multi-fetch, records not selected are skipped.
+ */
+int export_selected(const struct IsnSet *set)
+{
+	int result_code;
+	AdamodIsn isn;
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+	struct IsnSetIterator iterator;
+	uint32_t entry_count, entry_no, record_pos;
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L1 (Read Record) with option 'I': read record with
+	 * specified ISN or with the next higher one.
+	 */
+	acbx_init(&acbx, "L1", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOX", 4);
+	abd_init(&fb_abd, ABD_FORMAT, format_buf, format_buf_len,
+		format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, RECORD_BUF_SIZE, 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	isn_set_iterate(&iterator);
+	while (isn_set_next(set, &iterator, &isn)) {
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxcop[1] = 'I';
+		acbx.acbxisn = isn;
+		acbx.acbxisl = selected_span(set, isn);
+
+		/* Execute Adabas direct call command L1. */
+		if (adabas_call(&acbx, 3, abds) != ADA_NORMAL) {
+			/* There are no records after read ones. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				break;
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_L1;
+		}
+
+		tune_fetch(adabas_call_usec());
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count == 0 || entry_count > MULTIFETCH_MAX) {
+			return ADAMOD_E_INVRECORD;
+		}
+
+		record_pos = 0;
+		for (entry_no = 0; entry_no < entry_count; entry_no++) {
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response == ADA_EOF) {
+				return ADAMOD_SUCCESS;
+			}
+			if (entry.response != ADA_NORMAL) {
+				continue;
+			}
+			if (record_pos + entry.record_len > RECORD_BUF_SIZE) {
+				return ADAMOD_E_INVRECORD;
+			}
+			if (isn_set_contains(set, entry.isn)) {
+				result_code = export_record(entry.isn,
+					record_buf + record_pos, entry.record_len);
+				if (result_code != ADAMOD_SUCCESS) {
+					return result_code;
+				}
+			}
+			record_pos += entry.record_len;
+			if (entry.isn > isn) {
+				isn = entry.isn;
+			}
+		}
+
+		/* Reading is continued from next selected ISN. */
+		isn_set_seek(set, &iterator, isn + 1);
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Export records selected by combination of multiple search arguments.
+ */
+int export_select(void)
+{
+	int result_code;
+	struct IsnSet set;
+
+	result_code = select_isn_set(&set);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	if (options.physical_order) {
+		/* Selected records are picked from scan of Data Storage. */
+		selection = &set;
+		result_code = export_scan();
+		selection = NULL;
+	} else {
+		result_code = export_selected(&set);
+	}
+	isn_set_free(&set);
+
+	return result_code;
+}
+
+/*
+ * Export all records of file in physical sequence.
+ */
+int export_scan(void)
+{
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L2 (Read Physical Sequence): read records in sequence
+	 * they are stored in Data Storage.
+	 */
+	acbx_init(&acbx, "L2", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOX", 4);
+	abd_init(&fb_abd, ABD_FORMAT, format_buf, format_buf_len,
+		format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, RECORD_BUF_SIZE, 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	return fetch_records(&acbx, 3, abds, ADAMOD_E_ADABAS_L2);
+}
+
+/*
+ * Read records from specified Adabas file and write them to output.
+ */
+int export_file_records(void)
+{
+	int return_code;
+	char db_options[30];
+	time_t start_time;
+	int field_no;
+
+	format_buf = (char *) options.export_arg;
+	format_buf_len = strlen(options.export_arg);
+
+	/* Values of fields can be split only when their lengths known. */
+	if (options.export_format != EXPORT_BINARY) {
+		field_count = format_parse(format_buf, format_buf_len, fields,
+			EXPORT_FIELDS_MAX);
+		if (field_count < 1) {
+			return ADAMOD_E_INVEXPORT;
+		}
+		for (field_no = 0; field_no < field_count; field_no++) {
+			if (fields[field_no].length < 0) {
+				return ADAMOD_E_INVEXPORT;
+			}
+		}
+	}
+
+	record_buf = malloc(RECORD_BUF_SIZE);
+	if (record_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	return_code = export_open();
+	if (return_code != ADAMOD_SUCCESS) {
+		export_close();
+		free(record_buf);
+		return return_code;
+	}
+
+	/* Open Adabas database for reading. */
+	sprintf(db_options, "ACC=%d.", options.file_no);
+	if (db_open(options.db_id, db_options) != ADA_NORMAL) {
+		export_close();
+		free(record_buf);
+		return ADAMOD_E_ADABAS_OP;
+	}
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	if (options.isn > 0) {
+		/* When ISN specified, export just one record by ISN. */
+		return_code = export_isn(options.isn);
+	} else if (options.search_count == 1
+		&& options.cache_dir_name == NULL && !options.physical_order
+		&& !options.search_args[0].isn_log)
+	{
+		/* Export records found by search argument. */
+		return_code = export_search();
+	} else if (options.search_count > 0) {
+		/* Export records selected by combined or cached searches. */
+		return_code = export_select();
+	} else {
+		/* Export all records of file. */
+		return_code = export_scan();
+	}
+
+	/* Close Adabas database. */
+	if (db_close(options.db_id) != ADA_NORMAL) {
+		return_code = ADAMOD_E_ADABAS_CL;
+	}
+
+	if (export_close() != ADAMOD_SUCCESS
+		&& return_code == ADAMOD_SUCCESS)
+	{
+		return_code = ADAMOD_E_OUTPUT_IO;
+	}
+	free(record_buf);
+
+	/* Print used time. */
+	if (return_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
+	return return_code;
+}
@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adacall.h"
+#include "adamod.h"
+#include "fdt.h"
+#include "journal.h"
+#include "messages.h"
+
+/*
+ * Record buffer of command LF (standard format) contains number of
+ * fields (2 bytes in native byte order) followed by 8-byte entry for
+ * every field: name (2 bytes), level, standard length, standard format,
+ * options and 2 reserved bytes.
+ */
+#define LF_HEADER_LEN 2
+#define LF_ENTRY_LEN 8
+/* Size of record buffer of command LF. */
+#define LF_BUF_SIZE (LF_HEADER_LEN + 4096 * LF_ENTRY_LEN)
+
+/* Signature at the beginning of field definitions cache file. */
+#define FDT_SIGNATURE "ADAMODF1"
+#define FDT_SIGNATURE_LEN 8
+/* Length of cache file header (signature, creation time, target, length). */
+#define FDT_HEADER_LEN 24
+
+char *fdt_file_name(void);
+int fdt_cache_load(unsigned char *buf, uint32_t *buf_len, int *found);
+int fdt_cache_save(const unsigned char *buf, uint32_t buf_len);
+int fdt_read(unsigned char *buf, uint32_t *buf_len);
+int fdt_parse(struct FieldTable *table, const unsigned char *buf,
+	uint32_t buf_len);
+int layout_error(const char *name, const char *reason);
+int layout_add(struct RecordLayout *layout, const char *name, int length,
+	char format);
+int value_valid(char format, const unsigned char *value, uint32_t length);
+
+/*
+ * Make name of field definitions cache file in cache directory.
+ */
+char *fdt_file_name(void)
+{
+	char *file_name;
+
+	file_name = malloc(strlen(options.cache_dir_name) + 32);
+	if (file_name != NULL) {
+		sprintf(file_name, "%s/adamod-%u-%u.fdt", options.cache_dir_name,
+			(unsigned int) options.db_id, (unsigned int) options.file_no);
+	}
+
+	return file_name;
+}
+
+/*
+ * Load cached record buffer of command LF. Missing, expired or
+ * invalid cache file is a cache miss (found is set to 0).
+ */
+int fdt_cache_load(unsigned char *buf, uint32_t *buf_len, int *found)
+{
+	FILE *file;
+	char *file_name;
+	unsigned char header[FDT_HEADER_LEN];
+	time_t now;
+	uint64_t created;
+
+	*found = 0;
+	if (options.cache_dir_name == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	file_name = fdt_file_name();
+	if (file_name == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	file = fopen(file_name, "rb");
+	free(file_name);
+	if (file == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	/* Check signature, age and target of cached definitions. */
+	time(&now);
+	if (fread(header, FDT_HEADER_LEN, 1, file) == 1
+		&& memcmp(header, FDT_SIGNATURE, FDT_SIGNATURE_LEN) == 0)
+	{
+		created = get_uint64(header + 8);
+		*buf_len = get_uint32(header + 20);
+		if (created <= (uint64_t) now
+			&& (uint64_t) now - created < (uint64_t) options.cache_max_age
+			&& get_uint16(header + 16) == options.db_id
+			&& get_uint16(header + 18) == options.file_no
+			&& *buf_len <= LF_BUF_SIZE
+			&& fread(buf, *buf_len, 1, file) == 1)
+		{
+			*found = 1;
+		}
+	}
+	fclose(file);
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Save record buffer of command LF in cache. File is written under
+ * temporary name and renamed, so readers never see partial file.
+ */
+int fdt_cache_save(const unsigned char *buf, uint32_t buf_len)
+{
+	FILE *file;
+	char *file_name, *temp_name;
+	unsigned char header[FDT_HEADER_LEN];
+	int result_code = ADAMOD_SUCCESS;
+
+	if (options.cache_dir_name == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	file_name = fdt_file_name();
+	if (file_name == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	temp_name = malloc(strlen(file_name) + 5);
+	if (temp_name == NULL) {
+		free(file_name);
+		return ADAMOD_E_NOMEMORY;
+	}
+	sprintf(temp_name, "%s.tmp", file_name);
+
+	file = fopen(temp_name, "wb");
+	if (file == NULL) {
+		free(file_name);
+		free(temp_name);
+		return ADAMOD_E_CACHE_IO;
+	}
+
+	memcpy(header, FDT_SIGNATURE, FDT_SIGNATURE_LEN);
+	put_uint64(header + 8, (uint64_t) time(NULL));
+	put_uint16(header + 16, options.db_id);
+	put_uint16(header + 18, options.file_no);
+	put_uint32(header + 20, buf_len);
+	if (fwrite(header, FDT_HEADER_LEN, 1, file) != 1
+		|| fwrite(buf, buf_len, 1, file) != 1)
+	{
+		result_code = ADAMOD_E_CACHE_IO;
+	}
+	if (fclose(file) != 0) {
+		result_code = ADAMOD_E_CACHE_IO;
+	}
+
+	/* Existing file must be removed before renaming on some systems. */
+	if (result_code == ADAMOD_SUCCESS) {
+		remove(file_name);
+		if (rename(temp_name, file_name) != 0) {
+			result_code = ADAMOD_E_CACHE_IO;
+		}
+	}
+	if (result_code != ADAMOD_SUCCESS) {
+		remove(temp_name);
+	}
+
+	free(file_name);
+	free(temp_name);
+
+	return result_code;
+}
+
+/*
+ * Read field definitions of file with command LF.
+ */
+int fdt_read(unsigned char *buf, uint32_t *buf_len)
+{
+	ACBX acbx;
+	ABD rb_abd;
+	ABD *abds[1];
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command LF (Read Field Definitions): read field definition
+	 * table of file.
+	 */
+	acbx_init(&acbx, "LF", options.db_id, options.file_no);
+	abd_init(&rb_abd, ABD_RECORD, buf, LF_BUF_SIZE, 0);
+	abds[0] = &rb_abd;
+
+	/* Execute Adabas direct call command LF. */
+	if (adabas_call(&acbx, 1, abds) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_LF;
+	}
+	*buf_len = (uint32_t) rb_abd.abdrecv;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Parse record buffer of command LF into field definition table.
+ */
+int fdt_parse(struct FieldTable *table, const unsigned char *buf,
+	uint32_t buf_len)
+{
+	uint16_t count;
+	int field_no;
+
+	if (buf_len < LF_HEADER_LEN) {
+		return ADAMOD_E_ADABAS_LF;
+	}
+	memcpy(&count, buf, LF_HEADER_LEN);
+	if (LF_HEADER_LEN + (uint32_t) count * LF_ENTRY_LEN > buf_len) {
+		return ADAMOD_E_ADABAS_LF;
+	}
+
+	table->fields = malloc((count > 0 ? count : 1) * sizeof(struct FieldDef));
+	if (table->fields == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	table->count = count;
+
+	for (field_no = 0; field_no < count; field_no++) {
+		const unsigned char *entry = buf + LF_HEADER_LEN
+			+ field_no * LF_ENTRY_LEN;
+		struct FieldDef *field = table->fields + field_no;
+
+		memcpy(field->name, entry, 2);
+		field->level = entry[2];
+		field->length = entry[3];
+		field->format = (char) entry[4];
+		field->options = entry[5];
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Load field definitions of target file. Definitions are read with
+ * command LF once and then taken from cache directory (if specified)
+ * until they are older than maximal age of cache.
+ */
+int fdt_load(struct FieldTable *table)
+{
+	unsigned char *buf;
+	uint32_t buf_len = 0;
+	int found;
+	int result_code;
+
+	table->fields = NULL;
+	table->count = 0;
+
+	buf = malloc(LF_BUF_SIZE);
+	if (buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	result_code = fdt_cache_load(buf, &buf_len, &found);
+	if (result_code == ADAMOD_SUCCESS && !found) {
+		result_code = fdt_read(buf, &buf_len);
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = fdt_cache_save(buf, buf_len);
+		}
+	} else if (result_code == ADAMOD_SUCCESS && options.verbose_level > 1) {
+		fputs("Cached field definitions used\n", stderr);
+	}
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = fdt_parse(table, buf, buf_len);
+	}
+	free(buf);
+
+	return result_code;
+}
+
+/*
+ * Free field definitions.
+ */
+void fdt_free(struct FieldTable *table)
+{
+	free(table->fields);
+	table->fields = NULL;
+	table->count = 0;
+}
+
+/*
+ * Find definition of field by name (occurrence number of name is
+ * ignored).
+ */
+const struct FieldDef *fdt_find(const struct FieldTable *table,
+	const char *name)
+{
+	int field_no;
+
+	for (field_no = 0; field_no < table->count; field_no++) {
+		if (memcmp(table->fields[field_no].name, name, 2) == 0) {
+			return table->fields + field_no;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Report field which doesn't match its definition.
+ */
+int layout_error(const char *name, const char *reason)
+{
+	if (options.verbose_level > 0) {
+		fprintf(stderr, "Field %s: %s\n", name, reason);
+	}
+
+	return ADAMOD_E_INVMODIFY;
+}
+
+/*
+ * Add field to record buffer layout, checking its length for format.
+ */
+int layout_add(struct RecordLayout *layout, const char *name, int length,
+	char format)
+{
+	struct LayoutField *field;
+
+	if (layout->count >= LAYOUT_FIELDS_MAX) {
+		return layout_error(name, "too many fields");
+	}
+
+	switch (format) {
+	case 'A':
+	case 'B':
+	case 'W':
+	case FIELD_SPACING:
+		break;
+	case 'F':
+		if (length != 1 && length != 2 && length != 4 && length != 8) {
+			return layout_error(name, "invalid length of fixed point");
+		}
+		break;
+	case 'G':
+		if (length != 4 && length != 8) {
+			return layout_error(name, "invalid length of floating point");
+		}
+		break;
+	case 'P':
+		if (length < 1 || length > 15) {
+			return layout_error(name, "invalid length of packed field");
+		}
+		break;
+	case 'U':
+		if (length < 1 || length > 29) {
+			return layout_error(name, "invalid length of unpacked field");
+		}
+		break;
+	default:
+		return layout_error(name, "unknown format");
+	}
+
+	field = layout->fields + layout->count++;
+	strcpy(field->name, name);
+	field->offset = layout->record_len;
+	field->length = length;
+	field->format = format;
+	layout->record_len += length;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Compile format buffer into layout of record buffer with field
+ * definitions. Standard lengths and formats are taken from definitions,
+ * groups are expanded into their elementary fields. Returns
+ * ADAMOD_E_INVFORMAT when format buffer contains elements which are
+ * not compiled (they are checked by Adabas only).
+ */
+int layout_compile(const struct FieldTable *table, const char *format_buf,
+	uint32_t format_buf_len, struct RecordLayout *layout)
+{
+	struct FormatField fields[LAYOUT_FIELDS_MAX];
+	int field_count, field_no, child_no;
+	int variable = 0;
+	int result_code = ADAMOD_SUCCESS;
+
+	layout->count = 0;
+	layout->record_len = 0;
+
+	field_count = format_parse(format_buf, (int) format_buf_len, fields,
+		LAYOUT_FIELDS_MAX);
+	if (field_count < 0) {
+		return ADAMOD_E_INVFORMAT;
+	}
+
+	for (field_no = 0; field_no < field_count
+		&& result_code == ADAMOD_SUCCESS; field_no++)
+	{
+		const struct FormatField *field = fields + field_no;
+		const struct FieldDef *def;
+
+		if (field->format == FIELD_SPACING) {
+			result_code = layout_add(layout, "", field->length,
+				FIELD_SPACING);
+			continue;
+		}
+
+		def = fdt_find(table, field->name);
+		if (def == NULL) {
+			return layout_error(field->name, "not defined in file");
+		}
+
+		if (def->format != ' ') {
+			/* Elementary field with standard or specified length. */
+			int length = field->length >= 0 ? field->length : def->length;
+
+			if (length == 0) {
+				variable = 1;
+			}
+			result_code = layout_add(layout, field->name, length,
+				field->format != 0 ? field->format : def->format);
+			continue;
+		}
+
+		/* Group is expanded into its elementary fields. */
+		if (field->length >= 0 || field->format != 0) {
+			return layout_error(field->name,
+				"length or format of group specified");
+		}
+		for (child_no = (int) (def - table->fields) + 1;
+			child_no < table->count && result_code == ADAMOD_SUCCESS
+			&& table->fields[child_no].level > def->level; child_no++)
+		{
+			const struct FieldDef *child = table->fields + child_no;
+			char name[FIELD_NAME_LEN + 1];
+
+			if (child->format == ' ') {
+				continue;
+			}
+
+			/* Fields of periodic group get occurrence of group. */
+			sprintf(name, "%c%c%.*s", child->name[0], child->name[1],
+				FIELD_NAME_LEN - 2, field->name + 2);
+			if (child->length == 0) {
+				variable = 1;
+			}
+			result_code = layout_add(layout, name, child->length,
+				child->format);
+		}
+	}
+
+	if (variable) {
+		layout->record_len = 0;
+	}
+
+	return result_code;
+}
+
+/*
+ * Check whether value is valid for format (packed and unpacked
+ * values must consist of digits and sign).
+ */
+int value_valid(char format, const unsigned char *value, uint32_t length)
+{
+	uint32_t i;
+
+	if (format == 'P') {
+		for (i = 0; i < length; i++) {
+			if ((value[i] >> 4) > 9
+				|| (i < length - 1 && (value[i] & 0x0F) > 9)
+				|| (i == length - 1 && (value[i] & 0x0F) < 0x0A))
+			{
+				return 0;
+			}
+		}
+	} else if (format == 'U') {
+		/* Sign of negative value is in zone of last digit. */
+		for (i = 0; i < length; i++) {
+			if ((value[i] & 0x0F) > 9 || ((value[i] & 0xF0) != 0x30
+				&& (i < length - 1 || (value[i] & 0xF0) != 0x70)))
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Check length of record buffer and values of its fields against
+ * record buffer layout. Value of variable length field is preceded
+ * by length byte (including the byte itself).
+ */
+int layout_check(const struct RecordLayout *layout,
+	const unsigned char *record_buf, uint32_t record_buf_len)
+{
+	uint32_t pos = 0, value_len;
+	int field_no;
+
+	for (field_no = 0; field_no < layout->count; field_no++) {
+		const struct LayoutField *field = layout->fields + field_no;
+
+		value_len = (uint32_t) field->length;
+		if (field->length == 0) {
+			if (pos >= record_buf_len || record_buf[pos] < 1) {
+				return layout_error(field->name,
+					"missing length of value");
+			}
+			value_len = record_buf[pos++] - 1;
+		}
+		if (pos + value_len > record_buf_len) {
+			return layout_error(field->name,
+				"value is beyond end of record buffer");
+		}
+		if (!value_valid(field->format, record_buf + pos, value_len)) {
+			return layout_error(field->name, "invalid value for format");
+		}
+		pos += value_len;
+	}
+
+	if (pos != record_buf_len) {
+		if (options.verbose_level > 0) {
+			fprintf(stderr, "Record buffer length %lu doesn't match "
+				"format buffer (%lu)\n", (unsigned long) record_buf_len,
+				(unsigned long) pos);
+		}
+		return ADAMOD_E_INVMODIFY;
+	}
+
+	return ADAMOD_SUCCESS;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(FDT_H)
+#define FDT_H
+
+#include <stdint.h>
+#include "format.h"
+
+/*
+ * Field definitions of file are read once with command LF and kept
+ * in cache directory. Format buffer is compiled with them into layout
+ * of record buffer, so errors in format and record buffers are found
+ * before any record is modified.
+ */
+
+/* Maximal number of fields in compiled format buffer. */
+#define LAYOUT_FIELDS_MAX 256
+
+/* Definition of field in field definition table. */
+struct FieldDef {
+	char name[2];
+	unsigned char level;
+	/* Standard length (0 - variable length). */
+	unsigned char length;
+	/* Standard format (' ' - group). */
+	char format;
+	unsigned char options;
+};
+
+/* Field definition table of file. */
+struct FieldTable {
+	struct FieldDef *fields;
+	int count;
+};
+
+/* Field of record buffer described by compiled format buffer. */
+struct LayoutField {
+	char name[FIELD_NAME_LEN + 1];
+	/* Offset of value in record buffer of fixed length fields. */
+	uint32_t offset;
+	/* Length of value (0 - length byte precedes value). */
+	int length;
+	char format;
+};
+
+/* Record buffer layout compiled from format buffer. */
+struct RecordLayout {
+	struct LayoutField fields[LAYOUT_FIELDS_MAX];
+	int count;
+	/* Length of record buffer (0 - fields of variable length). */
+	uint32_t record_len;
+};
+
+/* Load field definitions of target file (from cache or with LF). */
+int fdt_load(struct FieldTable *table);
+/* Free field definitions. */
+void fdt_free(struct FieldTable *table);
+/* Find definition of field by name (NULL when not defined). */
+const struct FieldDef *fdt_find(const struct FieldTable *table,
+	const char *name);
+
+/* Compile format buffer into record buffer layout. */
+int layout_compile(const struct FieldTable *table, const char *format_buf,
+	uint32_t format_buf_len, struct RecordLayout *layout);
+/* Check length of record buffer and values of its fields. */
+int layout_check(const struct RecordLayout *layout,
+	const unsigned char *record_buf, uint32_t record_buf_len);
+
+#endif /* FDT_H */
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "format.h"
+
+/* Maximal length of format buffer element. */
+#define ELEMENT_MAX_LEN 32
+/* Maximal number of fields in format buffer. */
+#define FIELDS_MAX_COUNT 1024
+
+/*
+ * Parse format buffer into list of fields of record buffer.
+ * Supported elements are fields with optional length and format
+ * ("AA", "AA,8", "AA,8,A"), occurrence ranges of periodic fields
+ * ("AB1-5,4,P") and spacing elements ("10X"). Returns number of fields
+ * or -1 when format buffer contains unsupported elements.
+ */
+int format_parse(const char *format_buf, int format_buf_len,
+	struct FormatField *fields, int max_fields)
+{
+	char element[ELEMENT_MAX_LEN + 1];
+	int element_len;
+	/* Fields of current element (set by name, length and format). */
+	int first_field = 0;
+	int field_count = 0;
+	int expect_length = 0;
+	int expect_format = 0;
+	int pos;
+	int field_no;
+
+	for (pos = 0; pos <= format_buf_len; pos++) {
+		/* Collect next element of format buffer. */
+		element_len = 0;
+		while (pos < format_buf_len && format_buf[pos] != ','
+			&& format_buf[pos] != '.')
+		{
+			if (element_len >= ELEMENT_MAX_LEN) {
+				return -1;
+			}
+			if (format_buf[pos] != ' ') {
+				element[element_len++] = format_buf[pos];
+			}
+			pos++;
+		}
+		element[element_len] = '\0';
+
+		if (element_len == 0) {
+			/* Empty element is allowed only at the end of buffer. */
+			if (pos < format_buf_len && format_buf[pos] != '.') {
+				return -1;
+			}
+		} else if (expect_length
+			&& strspn(element, "0123456789") == (size_t) element_len)
+		{
+			/* Length of fields of current element. */
+			for (field_no = first_field; field_no < field_count;
+				field_no++)
+			{
+				fields[field_no].length = atoi(element);
+			}
+			expect_length = 0;
+		} else if (expect_format && element_len == 1
+			&& isalpha((unsigned char) element[0]))
+		{
+			/* Format of fields of current element. */
+			for (field_no = first_field; field_no < field_count;
+				field_no++)
+			{
+				fields[field_no].format = (char)
+					toupper((unsigned char) element[0]);
+			}
+			expect_length = 0;
+			expect_format = 0;
+		} else if (isdigit((unsigned char) element[0])
+			&& toupper((unsigned char) element[element_len - 1]) == 'X'
+			&& strspn(element, "0123456789")
+				== (size_t) element_len - 1)
+		{
+			/* Spacing element "nX". */
+			if (field_count >= max_fields) {
+				return -1;
+			}
+			fields[field_count].name[0] = '\0';
+			fields[field_count].length = atoi(element);
+			fields[field_count].format = FIELD_SPACING;
+			field_count++;
+			expect_length = 0;
+			expect_format = 0;
+		} else if (element_len >= 2 && isalpha((unsigned char) element[0])
+			&& strspn(element + 2, "0123456789-")
+				== (size_t) element_len - 2)
+		{
+			/* Field name with optional occurrence range. */
+			const char *dash = strchr(element, '-');
+			int first_occurrence = atoi(element + 2);
+			int last_occurrence = dash != NULL
+				? atoi(dash + 1) : first_occurrence;
+			int occurrence;
+
+			if (last_occurrence < first_occurrence) {
+				return -1;
+			}
+
+			first_field = field_count;
+			for (occurrence = first_occurrence;
+				occurrence <= last_occurrence; occurrence++)
+			{
+				if (field_count >= max_fields) {
+					return -1;
+				}
+				if (occurrence > 0) {
+					sprintf(fields[field_count].name, "%c%c%d",
+						element[0], element[1], occurrence);
+				} else {
+					fields[field_count].name[0] = element[0];
+					fields[field_count].name[1] = element[1];
+					fields[field_count].name[2] = '\0';
+				}
+				fields[field_count].length = -1;
+				fields[field_count].format = 0;
+				field_count++;
+			}
+			expect_length = 1;
+			expect_format = 1;
+		} else {
+			return -1;
+		}
+
+		/* Stop at terminating period. */
+		if (pos < format_buf_len && format_buf[pos] == '.') {
+			break;
+		}
+	}
+
+	return field_count;
+}
+
+/*
+ * Calculate length of record buffer described by format buffer.
+ * Returns -1 when record buffer length can not be calculated without
+ * field definitions (standard or variable lengths of fields).
+ */
+int format_record_length(const char *format_buf, int format_buf_len)
+{
+	struct FormatField fields[FIELDS_MAX_COUNT];
+	int field_count;
+	int field_no;
+	int record_len = 0;
+
+	field_count = format_parse(format_buf, format_buf_len, fields,
+		FIELDS_MAX_COUNT);
+	if (field_count < 0) {
+		return -1;
+	}
+
+	for (field_no = 0; field_no < field_count; field_no++) {
+		if (fields[field_no].length < 1) {
+			return -1;
+		}
+		record_len += fields[field_no].length;
+	}
+
+	return record_len;
+}
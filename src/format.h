@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(FORMAT_H)
+#define FORMAT_H
+
+/* Maximal length of field name with occurrence number. */
+#define FIELD_NAME_LEN 15
+
+/* Field format of spacing element "nX". */
+#define FIELD_SPACING 'X'
+
+/* Field of record buffer described by format buffer element. */
+struct FormatField {
+	/* Field name with occurrence number (empty for spacing). */
+	char name[FIELD_NAME_LEN + 1];
+	/* Length of field (0 - variable length, -1 - standard length). */
+	int length;
+	/* Format of field (0 - standard format). */
+	char format;
+};
+
+/* Parse format buffer into list of fields of record buffer. */
+int format_parse(const char *format_buf, int format_buf_len,
+	struct FormatField *fields, int max_fields);
+/* Calculate length of record buffer described by format buffer. */
+int format_record_length(const char *format_buf, int format_buf_len);
+
+#endif /* FORMAT_H */
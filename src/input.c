@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+/* Functions read() and select() are declared only for POSIX sources. */
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "adamod.h"
+#include "input.h"
+
+/*
+ * Open input stream of file ("-" - standard input).
+ */
+int input_open(struct InputStream *input, const char *file_name)
+{
+	input->fifo = 0;
+
+	if (strcmp(file_name, "-") == 0) {
+		input->file_name = NULL;
+		input->fd = 0;
+#if defined(_WIN32)
+		_setmode(input->fd, _O_BINARY);
+#endif
+		return ADAMOD_SUCCESS;
+	}
+
+	input->file_name = file_name;
+#if defined(_WIN32)
+	input->fd = _open(file_name, _O_RDONLY | _O_BINARY);
+#else
+	input->fd = open(file_name, O_RDONLY);
+#endif
+	if (input->fd < 0) {
+		return ADAMOD_E_INPUT_IO;
+	}
+
+#if !defined(_WIN32)
+	{
+		struct stat file_stat;
+
+		if (fstat(input->fd, &file_stat) == 0
+			&& S_ISFIFO(file_stat.st_mode))
+		{
+			input->fifo = 1;
+		}
+	}
+#endif
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Wait for data in input stream for specified time (returns 1 when
+ * data or end of stream can be read, 0 on timeout, -1 on error).
+ * Without select() on pipes (Windows) stream is always ready.
+ */
+int input_wait(struct InputStream *input, uint64_t timeout_usec)
+{
+#if defined(_WIN32)
+	(void) input;
+	(void) timeout_usec;
+
+	return 1;
+#else
+	fd_set fds;
+	struct timeval timeout;
+
+	FD_ZERO(&fds);
+	FD_SET(input->fd, &fds);
+	timeout.tv_sec = (long) (timeout_usec / 1000000);
+	timeout.tv_usec = (long) (timeout_usec % 1000000);
+
+	return select(input->fd + 1, &fds, NULL, NULL, &timeout);
+#endif
+}
+
+/*
+ * Read available data from input stream (returns number of bytes read,
+ * 0 at the end of stream or -1 on error).
+ */
+long input_read(struct InputStream *input, char *buf, unsigned int size)
+{
+#if defined(_WIN32)
+	return _read(input->fd, buf, size);
+#else
+	return (long) read(input->fd, buf, size);
+#endif
+}
+
+/*
+ * Reopen named pipe after all its writers closed it. Opening blocks
+ * until next writer opens the pipe.
+ */
+int input_reopen(struct InputStream *input)
+{
+	const char *file_name = input->file_name;
+
+	input_close(input);
+
+	return input_open(input, file_name);
+}
+
+/*
+ * Close input stream.
+ */
+void input_close(struct InputStream *input)
+{
+	if (input->file_name != NULL && input->fd >= 0) {
+#if defined(_WIN32)
+		_close(input->fd);
+#else
+		close(input->fd);
+#endif
+	}
+	input->fd = -1;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(INPUT_H)
+#define INPUT_H
+
+#include <stdint.h>
+
+/*
+ * Input stream is read with unbuffered reads of file descriptor, so
+ * it can be waited for new data with timeout (FIFO or standard input
+ * fed by other process).
+ */
+
+/* Input stream. */
+struct InputStream {
+	/* File name (NULL for standard input). */
+	const char *file_name;
+	int fd;
+	/* Stream is named pipe, which is reopened for next writer. */
+	int fifo;
+};
+
+/* Open input stream of file ("-" - standard input). */
+int input_open(struct InputStream *input, const char *file_name);
+/* Wait for data in input stream (returns 1 - ready, 0 - timeout). */
+int input_wait(struct InputStream *input, uint64_t timeout_usec);
+/* Read available data (returns number of bytes, 0 at the end). */
+long input_read(struct InputStream *input, char *buf, unsigned int size);
+/* Reopen named pipe and wait for its next writer. */
+int input_reopen(struct InputStream *input);
+/* Close input stream. */
+void input_close(struct InputStream *input);
+
+#endif /* INPUT_H */
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adamod.h"
+#include "isnlog.h"
+
+/*
+ * Binary ISN logs start with signature followed by format letter:
+ * 'Q' - ISNs as 8-byte little-endian values,
+ * 'D' - differences of adjacent ISNs as zigzag-encoded varints.
+ * Text ISN logs contain one decimal ISN per line.
+ */
+#define ISN_LOG_SIGNATURE "ADAMODI"
+#define ISN_LOG_SIGNATURE_LEN 7
+
+/* Size of ISN log buffer. */
+#define ISN_LOG_BUF_SIZE (1024 * 1024)
+/* Maximal length of one encoded ISN. */
+#define ISN_LOG_MAX_ENTRY_LEN 24
+
+/* Names of ISN log formats. */
+static const char *isn_log_format_names[] = { "text", "binary", "delta",
+	NULL };
+
+/*
+ * Parse decimal ISN.
+ */
+int parse_isn(const char *str, AdamodIsn *isn)
+{
+	*isn = 0;
+	if (*str == '\0') {
+		return ADAMOD_E_INVARG;
+	}
+
+	for (; *str != '\0'; str++) {
+		if (*str < '0' || *str > '9'
+			|| *isn > (UINT64_MAX - (*str - '0')) / 10)
+		{
+			return ADAMOD_E_INVARG;
+		}
+		*isn = *isn * 10 + (*str - '0');
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Get format of ISN log by its name.
+ */
+int isn_log_format(const char *name, IsnLogFormat *format)
+{
+	int format_no;
+
+	for (format_no = 0; isn_log_format_names[format_no] != NULL;
+		format_no++)
+	{
+		if (strcmp(name, isn_log_format_names[format_no]) == 0) {
+			*format = (IsnLogFormat) format_no;
+			return ADAMOD_SUCCESS;
+		}
+	}
+
+	return ADAMOD_E_INVARG;
+}
+
+/*
+ * Start writing ISN log of specified format to file.
+ */
+int isn_writer_open(struct IsnWriter *writer, FILE *file,
+	IsnLogFormat format)
+{
+	writer->file = file;
+	writer->format = format;
+	writer->buf_len = 0;
+	writer->prev_isn = 0;
+
+	/*
+	 * ISNs are collected in large buffer and written to file
+	 * with one call when buffer is full.
+	 */
+	writer->buf = malloc(ISN_LOG_BUF_SIZE);
+	if (writer->buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	if (format != ISN_LOG_TEXT) {
+		memcpy(writer->buf, ISN_LOG_SIGNATURE, ISN_LOG_SIGNATURE_LEN);
+		writer->buf[ISN_LOG_SIGNATURE_LEN] =
+			format == ISN_LOG_BINARY ? 'Q' : 'D';
+		writer->buf_len = ISN_LOG_SIGNATURE_LEN + 1;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Append ISN to log.
+ */
+int isn_writer_put(struct IsnWriter *writer, AdamodIsn isn)
+{
+	unsigned char *p;
+
+	if (writer->buf_len + ISN_LOG_MAX_ENTRY_LEN > ISN_LOG_BUF_SIZE) {
+		if (isn_writer_flush(writer) != ADAMOD_SUCCESS) {
+			return ADAMOD_E_LOG_IO;
+		}
+	}
+
+	p = writer->buf + writer->buf_len;
+	if (writer->format == ISN_LOG_TEXT) {
+		unsigned char digits[ISN_LOG_MAX_ENTRY_LEN];
+		int digit_count = 0;
+
+		/* Decimal digits are produced in reverse order. */
+		do {
+			digits[digit_count++] = (unsigned char) ('0' + isn % 10);
+			isn /= 10;
+		} while (isn > 0);
+		while (digit_count > 0) {
+			*p++ = digits[--digit_count];
+		}
+		*p++ = '\n';
+	} else if (writer->format == ISN_LOG_BINARY) {
+		int byte_no;
+
+		for (byte_no = 0; byte_no < 8; byte_no++) {
+			*p++ = (unsigned char) (isn & 0xFF);
+			isn >>= 8;
+		}
+	} else {
+		/*
+		 * Difference from previous ISN is zigzag-encoded (so ISNs
+		 * in physical order are also compact) and written as varint.
+		 */
+		AdamodIsn value = isn >= writer->prev_isn
+			? (isn - writer->prev_isn) << 1
+			: ((writer->prev_isn - isn) << 1) - 1;
+
+		writer->prev_isn = isn;
+		while (value >= 0x80) {
+			*p++ = (unsigned char) ((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		*p++ = (unsigned char) value;
+	}
+	writer->buf_len = p - writer->buf;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Write buffered ISNs to log file.
+ */
+int isn_writer_flush(struct IsnWriter *writer)
+{
+	if (writer->buf_len > 0) {
+		if (fwrite(writer->buf, writer->buf_len, 1, writer->file) != 1) {
+			return ADAMOD_E_LOG_IO;
+		}
+		writer->buf_len = 0;
+	}
+
+	if (fflush(writer->file) != 0) {
+		return ADAMOD_E_LOG_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Finish writing ISN log.
+ */
+int isn_writer_close(struct IsnWriter *writer)
+{
+	int result_code = ADAMOD_SUCCESS;
+
+	if (writer->buf != NULL) {
+		result_code = isn_writer_flush(writer);
+		free(writer->buf);
+		writer->buf = NULL;
+	}
+
+	return result_code;
+}
+
+/*
+ * Start reading ISN log of any format from file.
+ */
+int isn_reader_open(struct IsnReader *reader, FILE *file)
+{
+	unsigned char buf[ISN_LOG_SIGNATURE_LEN + 1];
+	int c;
+
+	reader->file = file;
+	reader->format = ISN_LOG_TEXT;
+	reader->prev_isn = 0;
+
+	/* Logs without signature are text logs. */
+	c = fgetc(file);
+	if (c == EOF) {
+		return ADAMOD_SUCCESS;
+	}
+	ungetc(c, file);
+	if (c != ISN_LOG_SIGNATURE[0]) {
+		return ADAMOD_SUCCESS;
+	}
+
+	if (fread(buf, sizeof(buf), 1, file) != 1
+		|| memcmp(buf, ISN_LOG_SIGNATURE, ISN_LOG_SIGNATURE_LEN) != 0)
+	{
+		return ADAMOD_E_INVISNLOG;
+	}
+	if (buf[ISN_LOG_SIGNATURE_LEN] == 'Q') {
+		reader->format = ISN_LOG_BINARY;
+	} else if (buf[ISN_LOG_SIGNATURE_LEN] == 'D') {
+		reader->format = ISN_LOG_DELTA;
+	} else {
+		return ADAMOD_E_INVISNLOG;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read next ISN from log (returns 0 at the end of log).
+ */
+int isn_reader_next(struct IsnReader *reader, AdamodIsn *isn)
+{
+	int c;
+
+	if (reader->format == ISN_LOG_TEXT) {
+		/* Skip separators and read decimal digits of ISN. */
+		do {
+			c = fgetc(reader->file);
+		} while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+		if (c == EOF) {
+			return 0;
+		}
+
+		*isn = 0;
+		while (c >= '0' && c <= '9') {
+			*isn = *isn * 10 + (c - '0');
+			c = fgetc(reader->file);
+		}
+		if (c != '\n' && c != '\r' && c != ' ' && c != '\t'
+			&& c != EOF)
+		{
+			return -1;
+		}
+	} else if (reader->format == ISN_LOG_BINARY) {
+		unsigned char buf[8];
+		int byte_no;
+
+		if (fread(buf, sizeof(buf), 1, reader->file) != 1) {
+			return 0;
+		}
+		*isn = 0;
+		for (byte_no = 7; byte_no >= 0; byte_no--) {
+			*isn = (*isn << 8) | buf[byte_no];
+		}
+	} else {
+		AdamodIsn value = 0;
+		int shift = 0;
+
+		do {
+			c = fgetc(reader->file);
+			if (c == EOF) {
+				return shift == 0 ? 0 : -1;
+			}
+			value |= (AdamodIsn) (c & 0x7F) << shift;
+			shift += 7;
+		} while ((c & 0x80) != 0 && shift < 70);
+
+		/* Decode zigzag-encoded difference from previous ISN. */
+		reader->prev_isn = (value & 1) == 0
+			? reader->prev_isn + (value >> 1)
+			: reader->prev_isn - ((value + 1) >> 1);
+		*isn = reader->prev_isn;
+	}
+
+	return 1;
+}
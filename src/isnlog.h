@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(ISNLOG_H)
+#define ISNLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Formats of ISN log. */
+typedef enum {
+	ISN_LOG_TEXT = 0,
+	ISN_LOG_BINARY,
+	ISN_LOG_DELTA
+} IsnLogFormat;
+
+/* ISN log writer. */
+struct IsnWriter {
+	FILE *file;
+	IsnLogFormat format;
+	unsigned char *buf;
+	size_t buf_len;
+	AdamodIsn prev_isn;
+};
+
+/* ISN log reader. */
+struct IsnReader {
+	FILE *file;
+	IsnLogFormat format;
+	AdamodIsn prev_isn;
+};
+
+/* Parse decimal ISN. */
+int parse_isn(const char *str, AdamodIsn *isn);
+/* Get format of ISN log by its name. */
+int isn_log_format(const char *name, IsnLogFormat *format);
+
+/* Start writing ISN log of specified format to file. */
+int isn_writer_open(struct IsnWriter *writer, FILE *file,
+	IsnLogFormat format);
+/* Append ISN to log. */
+int isn_writer_put(struct IsnWriter *writer, AdamodIsn isn);
+/* Write buffered ISNs to log file. */
+int isn_writer_flush(struct IsnWriter *writer);
+/* Finish writing ISN log. */
+int isn_writer_close(struct IsnWriter *writer);
+
+/* Start reading ISN log of any format from file. */
+int isn_reader_open(struct IsnReader *reader, FILE *file);
+/* Read next ISN from log (returns 0 at the end of log). */
+int isn_reader_next(struct IsnReader *reader, AdamodIsn *isn);
+
+#endif /* ISNLOG_H */
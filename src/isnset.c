@@ -0,0 +1,979 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adamod.h"
+#include "isnset.h"
+#include "journal.h"
+
+/* Number of ISN bits stored in container. */
+#define CONTAINER_BITS 16
+/* Number of ISNs which may be stored in container. */
+#define CONTAINER_SIZE (1UL << CONTAINER_BITS)
+/* Number of 32-bit words in bitmap container. */
+#define BITMAP_WORDS (CONTAINER_SIZE / 32)
+/* Maximal number of ISNs in array container. */
+#define ARRAY_MAX 4096
+/* Length of container header in ISN set file. */
+#define CONTAINER_HEADER_LEN 20
+
+uint32_t bit_count(uint32_t word);
+size_t container_bytes(const struct IsnSetContainer *container);
+int container_find(const struct IsnSet *set, AdamodIsn key,
+	uint32_t *index);
+int container_insert(struct IsnSet *set, uint32_t index, AdamodIsn key);
+int container_copy(struct IsnSetContainer *target,
+	const struct IsnSetContainer *source);
+void container_to_bitmap(const struct IsnSetContainer *container,
+	uint32_t *words);
+int container_from_bitmap(struct IsnSetContainer *container,
+	const uint32_t *words);
+int container_make_bitmap(struct IsnSetContainer *container);
+int container_add(struct IsnSetContainer *container, uint16_t value);
+int container_contains(const struct IsnSetContainer *container,
+	uint16_t value);
+int container_valid(const struct IsnSetContainer *container);
+
+/*
+ * Count bits set in word.
+ */
+uint32_t bit_count(uint32_t word)
+{
+	uint32_t count = 0;
+
+	while (word != 0) {
+		word &= word - 1;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Get number of bytes used by container data.
+ */
+size_t container_bytes(const struct IsnSetContainer *container)
+{
+	if (container->type == ISN_SET_ARRAY) {
+		return container->allocated * sizeof(uint16_t);
+	}
+	if (container->type == ISN_SET_BITMAP) {
+		return BITMAP_WORDS * sizeof(uint32_t);
+	}
+
+	/* Run container keeps start and length of every run. */
+	return container->allocated * 2 * sizeof(uint16_t);
+}
+
+/*
+ * Find container with specified key (returns 0 and position where
+ * container should be inserted when it's not found).
+ */
+int container_find(const struct IsnSet *set, AdamodIsn key,
+	uint32_t *index)
+{
+	uint32_t low = 0, high = set->count;
+
+	/* ISNs are mostly added in ascending order. */
+	if (set->count == 0 || set->containers[set->count - 1].key < key) {
+		*index = set->count;
+		return 0;
+	}
+
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+
+		if (set->containers[middle].key < key) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	*index = low;
+	return low < set->count && set->containers[low].key == key;
+}
+
+/*
+ * Insert empty container with specified key at specified position.
+ */
+int container_insert(struct IsnSet *set, uint32_t index, AdamodIsn key)
+{
+	struct IsnSetContainer *container;
+
+	if (set->count == set->allocated) {
+		uint32_t allocated = set->allocated > 0
+			? set->allocated * 2 : 16;
+
+		container = realloc(set->containers,
+			allocated * sizeof(struct IsnSetContainer));
+		if (container == NULL) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		set->containers = container;
+		set->allocated = allocated;
+	}
+
+	container = set->containers + index;
+	memmove(container + 1, container,
+		(set->count - index) * sizeof(struct IsnSetContainer));
+	set->count++;
+
+	container->key = key;
+	container->type = ISN_SET_ARRAY;
+	container->cardinality = 0;
+	container->size = 0;
+	container->allocated = 0;
+	container->data = NULL;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Copy container with its data.
+ */
+int container_copy(struct IsnSetContainer *target,
+	const struct IsnSetContainer *source)
+{
+	size_t bytes;
+
+	*target = *source;
+	if (source->type != ISN_SET_BITMAP) {
+		target->allocated = source->size;
+	}
+
+	bytes = container_bytes(target);
+	target->data = malloc(bytes > 0 ? bytes : 1);
+	if (target->data == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	memcpy(target->data, source->data, bytes);
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Expand ISNs of container into bitmap.
+ */
+void container_to_bitmap(const struct IsnSetContainer *container,
+	uint32_t *words)
+{
+	uint32_t i, value;
+
+	if (container->type == ISN_SET_BITMAP) {
+		memcpy(words, container->data, BITMAP_WORDS * sizeof(uint32_t));
+		return;
+	}
+
+	memset(words, 0, BITMAP_WORDS * sizeof(uint32_t));
+	if (container->type == ISN_SET_ARRAY) {
+		const uint16_t *values = container->data;
+
+		for (i = 0; i < container->size; i++) {
+			words[values[i] >> 5] |= 1UL << (values[i] & 31);
+		}
+	} else {
+		const uint16_t *runs = container->data;
+
+		for (i = 0; i < container->size; i++) {
+			uint32_t last = (uint32_t) runs[i * 2] + runs[i * 2 + 1];
+
+			for (value = runs[i * 2]; value <= last; value++) {
+				words[value >> 5] |= 1UL << (value & 31);
+			}
+		}
+	}
+}
+
+/*
+ * Store ISNs of bitmap in container using the smallest representation.
+ */
+int container_from_bitmap(struct IsnSetContainer *container,
+	const uint32_t *words)
+{
+	uint32_t cardinality = 0, run_count = 0, carry = 0;
+	uint32_t i, value, count;
+	size_t array_bytes, bitmap_bytes, run_bytes;
+	IsnSetContainerType type;
+	void *data;
+
+	/* Run starts where bit is set and previous bit is not. */
+	for (i = 0; i < BITMAP_WORDS; i++) {
+		cardinality += bit_count(words[i]);
+		run_count += bit_count(words[i] & ~((words[i] << 1) | carry));
+		carry = words[i] >> 31;
+	}
+
+	if (cardinality == 0) {
+		free(container->data);
+		container->type = ISN_SET_ARRAY;
+		container->cardinality = 0;
+		container->size = 0;
+		container->allocated = 0;
+		container->data = NULL;
+		return ADAMOD_SUCCESS;
+	}
+
+	bitmap_bytes = BITMAP_WORDS * sizeof(uint32_t);
+	array_bytes = cardinality <= ARRAY_MAX
+		? cardinality * sizeof(uint16_t) : bitmap_bytes + 1;
+	run_bytes = run_count * 2 * sizeof(uint16_t);
+	if (run_bytes < array_bytes && run_bytes < bitmap_bytes) {
+		type = ISN_SET_RUN;
+		count = run_count;
+		data = malloc(run_bytes);
+	} else if (array_bytes < bitmap_bytes) {
+		type = ISN_SET_ARRAY;
+		count = cardinality;
+		data = malloc(array_bytes);
+	} else {
+		type = ISN_SET_BITMAP;
+		count = BITMAP_WORDS;
+		data = malloc(bitmap_bytes);
+	}
+	if (data == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	if (type == ISN_SET_BITMAP) {
+		memcpy(data, words, bitmap_bytes);
+	} else {
+		uint16_t *values = data;
+		uint32_t n = 0;
+
+		for (value = 0; value < CONTAINER_SIZE;) {
+			uint32_t start;
+
+			/* Skip empty words. */
+			if ((value & 31) == 0 && words[value >> 5] == 0) {
+				value += 32;
+				continue;
+			}
+			if (((words[value >> 5] >> (value & 31)) & 1) == 0) {
+				value++;
+				continue;
+			}
+
+			if (type == ISN_SET_ARRAY) {
+				values[n++] = (uint16_t) value++;
+				continue;
+			}
+
+			start = value;
+			while (value < CONTAINER_SIZE
+				&& ((words[value >> 5] >> (value & 31)) & 1) != 0)
+			{
+				value++;
+			}
+			values[n++] = (uint16_t) start;
+			values[n++] = (uint16_t) (value - 1 - start);
+		}
+	}
+
+	free(container->data);
+	container->type = type;
+	container->cardinality = cardinality;
+	container->size = count;
+	container->allocated = count;
+	container->data = data;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Convert container to bitmap representation.
+ */
+int container_make_bitmap(struct IsnSetContainer *container)
+{
+	uint32_t *words = malloc(BITMAP_WORDS * sizeof(uint32_t));
+
+	if (words == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	container_to_bitmap(container, words);
+
+	free(container->data);
+	container->type = ISN_SET_BITMAP;
+	container->size = BITMAP_WORDS;
+	container->allocated = BITMAP_WORDS;
+	container->data = words;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Add value to container.
+ */
+int container_add(struct IsnSetContainer *container, uint16_t value)
+{
+	int result_code;
+	uint32_t *words;
+
+	if (container->type == ISN_SET_ARRAY) {
+		uint16_t *values = container->data;
+		uint32_t low = 0, high = container->size;
+
+		/* Find position of value in sorted array. */
+		if (container->size > 0 && values[container->size - 1] < value) {
+			low = container->size;
+		} else {
+			while (low < high) {
+				uint32_t middle = low + (high - low) / 2;
+
+				if (values[middle] < value) {
+					low = middle + 1;
+				} else {
+					high = middle;
+				}
+			}
+			if (low < container->size && values[low] == value) {
+				return ADAMOD_SUCCESS;
+			}
+		}
+
+		if (container->size < ARRAY_MAX) {
+			if (container->size == container->allocated) {
+				uint32_t allocated = container->allocated > 0
+					? container->allocated * 2 : 4;
+
+				if (allocated > ARRAY_MAX) {
+					allocated = ARRAY_MAX;
+				}
+				values = realloc(values, allocated * sizeof(uint16_t));
+				if (values == NULL) {
+					return ADAMOD_E_NOMEMORY;
+				}
+				container->data = values;
+				container->allocated = allocated;
+			}
+
+			memmove(values + low + 1, values + low,
+				(container->size - low) * sizeof(uint16_t));
+			values[low] = value;
+			container->size++;
+			container->cardinality++;
+			return ADAMOD_SUCCESS;
+		}
+	}
+
+	/* Full array and run containers are converted to bitmap. */
+	if (container->type != ISN_SET_BITMAP) {
+		result_code = container_make_bitmap(container);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+
+	words = container->data;
+	if (((words[value >> 5] >> (value & 31)) & 1) == 0) {
+		words[value >> 5] |= 1UL << (value & 31);
+		container->cardinality++;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Check whether value is in container.
+ */
+int container_contains(const struct IsnSetContainer *container,
+	uint16_t value)
+{
+	const uint16_t *values = container->data;
+	uint32_t low = 0, high = container->size;
+
+	if (container->type == ISN_SET_BITMAP) {
+		const uint32_t *words = container->data;
+
+		return (words[value >> 5] >> (value & 31)) & 1;
+	}
+
+	if (container->type == ISN_SET_ARRAY) {
+		while (low < high) {
+			uint32_t middle = low + (high - low) / 2;
+
+			if (values[middle] < value) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+		return low < container->size && values[low] == value;
+	}
+
+	/* Find the last run starting at or before value. */
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+
+		if (values[middle * 2] <= value) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low > 0 && value <= (uint32_t) values[(low - 1) * 2]
+		+ values[(low - 1) * 2 + 1];
+}
+
+/*
+ * Initialize empty ISN set.
+ */
+void isn_set_init(struct IsnSet *set)
+{
+	set->containers = NULL;
+	set->count = 0;
+	set->allocated = 0;
+}
+
+/*
+ * Free memory of ISN set.
+ */
+void isn_set_free(struct IsnSet *set)
+{
+	uint32_t i;
+
+	for (i = 0; i < set->count; i++) {
+		free(set->containers[i].data);
+	}
+	free(set->containers);
+	isn_set_init(set);
+}
+
+/*
+ * Add ISN to set.
+ */
+int isn_set_add(struct IsnSet *set, AdamodIsn isn)
+{
+	int result_code;
+	AdamodIsn key = isn >> CONTAINER_BITS;
+	uint32_t index;
+
+	if (set->count > 0 && set->containers[set->count - 1].key == key) {
+		index = set->count - 1;
+	} else if (!container_find(set, key, &index)) {
+		result_code = container_insert(set, index, key);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+
+	return container_add(set->containers + index,
+		(uint16_t) (isn & (CONTAINER_SIZE - 1)));
+}
+
+/*
+ * Check whether ISN is in set.
+ */
+int isn_set_contains(const struct IsnSet *set, AdamodIsn isn)
+{
+	uint32_t index;
+
+	if (!container_find(set, isn >> CONTAINER_BITS, &index)) {
+		return 0;
+	}
+
+	return container_contains(set->containers + index,
+		(uint16_t) (isn & (CONTAINER_SIZE - 1)));
+}
+
+/*
+ * Get number of ISNs in set.
+ */
+AdamodIsn isn_set_count(const struct IsnSet *set)
+{
+	AdamodIsn count = 0;
+	uint32_t i;
+
+	for (i = 0; i < set->count; i++) {
+		count += set->containers[i].cardinality;
+	}
+
+	return count;
+}
+
+/*
+ * Get number of bytes used by set.
+ */
+size_t isn_set_memory(const struct IsnSet *set)
+{
+	size_t bytes = set->allocated * sizeof(struct IsnSetContainer);
+	uint32_t i;
+
+	for (i = 0; i < set->count; i++) {
+		bytes += container_bytes(set->containers + i);
+	}
+
+	return bytes;
+}
+
+/*
+ * Combine set with other set (result is stored in first set).
+ * Containers with the same key are combined word by word as bitmaps.
+ */
+int isn_set_combine(struct IsnSet *set, const struct IsnSet *other,
+	IsnSetOperation operation)
+{
+	struct IsnSetContainer *result;
+	uint32_t result_count = 0, i = 0, j = 0, k;
+	uint32_t allocated = set->count + other->count + 1;
+	uint32_t *words, *other_words;
+	int result_code = ADAMOD_SUCCESS;
+
+	result = malloc(allocated * sizeof(struct IsnSetContainer));
+	words = malloc(2 * BITMAP_WORDS * sizeof(uint32_t));
+	if (result == NULL || words == NULL) {
+		free(result);
+		free(words);
+		return ADAMOD_E_NOMEMORY;
+	}
+	other_words = words + BITMAP_WORDS;
+
+	while (result_code == ADAMOD_SUCCESS
+		&& (i < set->count || j < other->count))
+	{
+		struct IsnSetContainer *container = set->containers + i;
+
+		if (j >= other->count || (i < set->count
+			&& container->key < other->containers[j].key))
+		{
+			/* Container is only in first set. */
+			if (operation == ISN_SET_INTERSECT) {
+				free(container->data);
+			} else {
+				result[result_count++] = *container;
+			}
+			i++;
+		} else if (i >= set->count
+			|| other->containers[j].key < container->key)
+		{
+			/* Container is only in other set. */
+			if (operation == ISN_SET_UNION) {
+				result_code = container_copy(result + result_count,
+					other->containers + j);
+				if (result_code == ADAMOD_SUCCESS) {
+					result_count++;
+				}
+			}
+			j++;
+		} else {
+			/* Container is in both sets. */
+			container_to_bitmap(container, words);
+			container_to_bitmap(other->containers + j, other_words);
+			for (k = 0; k < BITMAP_WORDS; k++) {
+				if (operation == ISN_SET_UNION) {
+					words[k] |= other_words[k];
+				} else if (operation == ISN_SET_INTERSECT) {
+					words[k] &= other_words[k];
+				} else {
+					words[k] &= ~other_words[k];
+				}
+			}
+
+			result_code = container_from_bitmap(container, words);
+			if (result_code != ADAMOD_SUCCESS) {
+				break;
+			}
+			if (container->cardinality > 0) {
+				result[result_count++] = *container;
+			}
+			i++;
+			j++;
+		}
+	}
+
+	/* On failure both processed and rest containers are freed. */
+	if (result_code != ADAMOD_SUCCESS) {
+		for (; i < set->count; i++) {
+			free(set->containers[i].data);
+		}
+		for (k = 0; k < result_count; k++) {
+			free(result[k].data);
+		}
+		result_count = 0;
+	}
+
+	free(words);
+	free(set->containers);
+	set->containers = result;
+	set->count = result_count;
+	set->allocated = allocated;
+
+	return result_code;
+}
+
+/*
+ * Convert containers of set to the smallest representation.
+ */
+int isn_set_optimize(struct IsnSet *set)
+{
+	uint32_t *words = malloc(BITMAP_WORDS * sizeof(uint32_t));
+	uint32_t i;
+	int result_code = ADAMOD_SUCCESS;
+
+	if (words == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	for (i = 0; i < set->count && result_code == ADAMOD_SUCCESS; i++) {
+		container_to_bitmap(set->containers + i, words);
+		result_code = container_from_bitmap(set->containers + i, words);
+	}
+	free(words);
+
+	return result_code;
+}
+
+/*
+ * Write set to file. Every container is written with its header (key,
+ * type, number of ISNs and number of entries) and data, all numbers
+ * in little-endian byte order.
+ */
+int isn_set_write(const struct IsnSet *set, FILE *file)
+{
+	unsigned char buf[BITMAP_WORDS * sizeof(uint32_t)];
+	uint32_t i, j, count;
+
+	put_uint32(buf, set->count);
+	fwrite(buf, 4, 1, file);
+
+	for (i = 0; i < set->count; i++) {
+		const struct IsnSetContainer *container = set->containers + i;
+
+		put_uint64(buf, container->key);
+		put_uint32(buf + 8, (uint32_t) container->type);
+		put_uint32(buf + 12, container->cardinality);
+		put_uint32(buf + 16, container->size);
+		fwrite(buf, CONTAINER_HEADER_LEN, 1, file);
+
+		if (container->type == ISN_SET_BITMAP) {
+			const uint32_t *words = container->data;
+
+			for (j = 0; j < BITMAP_WORDS; j++) {
+				put_uint32(buf + j * 4, words[j]);
+			}
+			count = BITMAP_WORDS * 4;
+		} else {
+			const uint16_t *values = container->data;
+
+			count = container->type == ISN_SET_RUN
+				? container->size * 2 : container->size;
+			for (j = 0; j < count; j++) {
+				put_uint16(buf + j * 2, values[j]);
+			}
+			count *= 2;
+		}
+		fwrite(buf, count, 1, file);
+	}
+
+	return ferror(file) ? ADAMOD_E_OUTPUT_IO : ADAMOD_SUCCESS;
+}
+
+/*
+ * Check values of array or run container read from file: values and
+ * runs must be ordered, runs must not cross end of container and
+ * their lengths must add up to cardinality.
+ */
+int container_valid(const struct IsnSetContainer *container)
+{
+	const uint16_t *values = container->data;
+	uint32_t j, end = 0, cardinality = 0;
+
+	if (container->type == ISN_SET_ARRAY) {
+		for (j = 1; j < container->size; j++) {
+			if (values[j] <= values[j - 1]) {
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	for (j = 0; j < container->size; j++) {
+		uint32_t start = values[j * 2];
+		uint32_t length = (uint32_t) values[j * 2 + 1] + 1;
+
+		if ((j > 0 && start <= end) || start + length > CONTAINER_SIZE) {
+			return 0;
+		}
+		end = start + length - 1;
+		cardinality += length;
+	}
+
+	return cardinality == container->cardinality;
+}
+
+/*
+ * Read set written by isn_set_write() from file.
+ */
+int isn_set_read(struct IsnSet *set, FILE *file)
+{
+	unsigned char buf[BITMAP_WORDS * sizeof(uint32_t)];
+	uint32_t i, j, count, container_count;
+	struct IsnSetContainer *container;
+
+	isn_set_init(set);
+	if (fread(buf, 4, 1, file) != 1) {
+		return ADAMOD_E_INPUT_IO;
+	}
+	container_count = get_uint32(buf);
+
+	for (i = 0; i < container_count; i++) {
+		AdamodIsn key;
+
+		if (fread(buf, CONTAINER_HEADER_LEN, 1, file) != 1) {
+			break;
+		}
+
+		/* Keys of containers must be in ascending order. */
+		key = get_uint64(buf);
+		if ((set->count > 0 && set->containers[set->count - 1].key >= key)
+			|| container_insert(set, set->count, key) != ADAMOD_SUCCESS)
+		{
+			break;
+		}
+		container = set->containers + set->count - 1;
+		container->type = (IsnSetContainerType) get_uint32(buf + 8);
+		container->cardinality = get_uint32(buf + 12);
+		container->size = get_uint32(buf + 16);
+
+		/* Check size of container data. */
+		if (container->type == ISN_SET_BITMAP) {
+			count = BITMAP_WORDS * 4;
+			if (container->size != BITMAP_WORDS) {
+				break;
+			}
+		} else if (container->type == ISN_SET_ARRAY) {
+			count = container->size * 2;
+			if (container->size != container->cardinality
+				|| container->size > ARRAY_MAX)
+			{
+				break;
+			}
+		} else if (container->type == ISN_SET_RUN) {
+			/* Runs are written only when they are smaller than bitmap. */
+			if (container->size > sizeof(buf) / 4) {
+				break;
+			}
+			count = container->size * 4;
+		} else {
+			break;
+		}
+		if (container->size == 0 || container->cardinality == 0
+			|| container->cardinality > CONTAINER_SIZE)
+		{
+			break;
+		}
+
+		container->allocated = container->size;
+		container->data = malloc(count);
+		if (container->data == NULL
+			|| fread(buf, count, 1, file) != 1)
+		{
+			break;
+		}
+
+		if (container->type == ISN_SET_BITMAP) {
+			uint32_t *words = container->data;
+
+			for (j = 0; j < BITMAP_WORDS; j++) {
+				words[j] = get_uint32(buf + j * 4);
+			}
+		} else {
+			uint16_t *values = container->data;
+
+			for (j = 0; j < count / 2; j++) {
+				values[j] = get_uint16(buf + j * 2);
+			}
+			if (!container_valid(container)) {
+				break;
+			}
+		}
+	}
+
+	if (i < container_count) {
+		isn_set_free(set);
+		return ADAMOD_E_INPUT_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Add ISNs from ISN log file of any format to set.
+ */
+int isn_set_load(struct IsnSet *set, const char *file_name)
+{
+	FILE *file;
+	struct IsnReader reader;
+	AdamodIsn isn;
+	int result_code;
+	int status;
+
+	file = fopen(file_name, "rb");
+	if (file == NULL) {
+		return ADAMOD_E_INPUT_IO;
+	}
+
+	result_code = isn_reader_open(&reader, file);
+	while (result_code == ADAMOD_SUCCESS
+		&& (status = isn_reader_next(&reader, &isn)) != 0)
+	{
+		if (status < 0) {
+			result_code = ADAMOD_E_INVISNLOG;
+		} else {
+			result_code = isn_set_add(set, isn);
+		}
+	}
+	fclose(file);
+
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return isn_set_optimize(set);
+}
+
+/*
+ * Start iteration over ISNs of set in ascending order.
+ */
+void isn_set_iterate(struct IsnSetIterator *iterator)
+{
+	iterator->container_no = 0;
+	iterator->pos = 0;
+	iterator->offset = 0;
+}
+
+/*
+ * Position iteration at the first ISN of set not less than ISN,
+ * so next ISN returned by isn_set_next() is that ISN.
+ */
+void isn_set_seek(const struct IsnSet *set, struct IsnSetIterator *iterator,
+	AdamodIsn isn)
+{
+	const struct IsnSetContainer *container;
+	const uint16_t *values;
+	uint16_t value = (uint16_t) (isn & (CONTAINER_SIZE - 1));
+	uint32_t low, high;
+
+	isn_set_iterate(iterator);
+	container_find(set, isn >> CONTAINER_BITS, &iterator->container_no);
+	if (iterator->container_no == set->count) {
+		return;
+	}
+	container = set->containers + iterator->container_no;
+	if (container->key != isn >> CONTAINER_BITS) {
+		/* All ISNs of following container are greater. */
+		return;
+	}
+
+	if (container->type == ISN_SET_BITMAP) {
+		iterator->pos = value;
+		return;
+	}
+
+	/*
+	 * Find the first value (or the first run ending with value)
+	 * not less than ISN.
+	 */
+	values = container->data;
+	low = 0;
+	high = container->size;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		uint32_t last = container->type == ISN_SET_ARRAY
+			? values[middle]
+			: (uint32_t) values[middle * 2] + values[middle * 2 + 1];
+
+		if (last < value) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	iterator->pos = low;
+	if (container->type == ISN_SET_RUN && low < container->size
+		&& values[low * 2] < value)
+	{
+		iterator->offset = value - values[low * 2];
+	}
+}
+
+/*
+ * Get next ISN of set (returns 0 at the end of set).
+ */
+int isn_set_next(const struct IsnSet *set, struct IsnSetIterator *iterator,
+	AdamodIsn *isn)
+{
+	while (iterator->container_no < set->count) {
+		const struct IsnSetContainer *container =
+			set->containers + iterator->container_no;
+		const uint16_t *values = container->data;
+		AdamodIsn base = container->key << CONTAINER_BITS;
+
+		if (container->type == ISN_SET_ARRAY) {
+			if (iterator->pos < container->size) {
+				*isn = base + values[iterator->pos++];
+				return 1;
+			}
+		} else if (container->type == ISN_SET_BITMAP) {
+			const uint32_t *words = container->data;
+
+			while (iterator->pos < CONTAINER_SIZE) {
+				uint32_t word = words[iterator->pos >> 5]
+					>> (iterator->pos & 31);
+
+				if (word == 0) {
+					/* Skip rest of word. */
+					iterator->pos = (iterator->pos | 31) + 1;
+				} else if ((word & 1) == 0) {
+					iterator->pos++;
+				} else {
+					*isn = base + iterator->pos++;
+					return 1;
+				}
+			}
+		} else if (iterator->pos < container->size) {
+			/* Run is stored as start and length minus one. */
+			*isn = base + values[iterator->pos * 2] + iterator->offset;
+			if (iterator->offset == values[iterator->pos * 2 + 1]) {
+				iterator->pos++;
+				iterator->offset = 0;
+			} else {
+				iterator->offset++;
+			}
+			return 1;
+		}
+
+		iterator->container_no++;
+		iterator->pos = 0;
+		iterator->offset = 0;
+	}
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(ISNSET_H)
+#define ISNSET_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * ISN set is a sorted list of containers, each holding low 16 bits of
+ * ISNs with the same high bits. Container keeps its ISNs as sorted
+ * array, bitmap or list of runs, whichever is the smallest.
+ */
+
+/* Types of ISN set containers. */
+typedef enum {
+	ISN_SET_ARRAY = 0,
+	ISN_SET_BITMAP,
+	ISN_SET_RUN
+} IsnSetContainerType;
+
+/* Operations on ISN sets. */
+typedef enum {
+	ISN_SET_UNION = 0,
+	ISN_SET_INTERSECT,
+	ISN_SET_DIFFERENCE
+} IsnSetOperation;
+
+/* Container of ISNs with the same high bits. */
+struct IsnSetContainer {
+	AdamodIsn key;
+	IsnSetContainerType type;
+	uint32_t cardinality;
+	uint32_t size;
+	uint32_t allocated;
+	void *data;
+};
+
+/* Set of ISNs. */
+struct IsnSet {
+	struct IsnSetContainer *containers;
+	uint32_t count;
+	uint32_t allocated;
+};
+
+/* Position of ISN set iteration. */
+struct IsnSetIterator {
+	uint32_t container_no;
+	uint32_t pos;
+	uint32_t offset;
+};
+
+/* Initialize empty ISN set. */
+void isn_set_init(struct IsnSet *set);
+/* Free memory of ISN set. */
+void isn_set_free(struct IsnSet *set);
+/* Add ISN to set. */
+int isn_set_add(struct IsnSet *set, AdamodIsn isn);
+/* Check whether ISN is in set. */
+int isn_set_contains(const struct IsnSet *set, AdamodIsn isn);
+/* Get number of ISNs in set. */
+AdamodIsn isn_set_count(const struct IsnSet *set);
+/* Get number of bytes used by set. */
+size_t isn_set_memory(const struct IsnSet *set);
+/* Combine set with other set (result is stored in first set). */
+int isn_set_combine(struct IsnSet *set, const struct IsnSet *other,
+	IsnSetOperation operation);
+/* Convert containers of set to the smallest representation. */
+int isn_set_optimize(struct IsnSet *set);
+/* Write set to file. */
+int isn_set_write(const struct IsnSet *set, FILE *file);
+/* Read set written by isn_set_write() from file. */
+int isn_set_read(struct IsnSet *set, FILE *file);
+/* Add ISNs from ISN log file of any format to set. */
+int isn_set_load(struct IsnSet *set, const char *file_name);
+
+/* Start iteration over ISNs of set in ascending order. */
+void isn_set_iterate(struct IsnSetIterator *iterator);
+/* Position iteration at the first ISN of set not less than ISN. */
+void isn_set_seek(const struct IsnSet *set, struct IsnSetIterator *iterator,
+	AdamodIsn isn);
+/* Get next ISN of set (returns 0 at the end of set). */
+int isn_set_next(const struct IsnSet *set, struct IsnSetIterator *iterator,
+	AdamodIsn *isn);
+
+#endif /* ISNSET_H */
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+/*
+ * Functions fseeko() and fsync() are declared only for POSIX sources,
+ * offsets of large journals need 64-bit off_t.
+ */
+#define _POSIX_C_SOURCE 200112L
+#define _FILE_OFFSET_BITS 64
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adamod.h"
+#include "journal.h"
+
+/* Signature at the beginning of journal file. */
+#define JOURNAL_SIGNATURE "ADAMODJ1"
+#define JOURNAL_SIGNATURE_LEN 8
+/* Length of journal header without format buffer. */
+#define JOURNAL_HEADER_LEN (JOURNAL_SIGNATURE_LEN + 2 + 2 + 1 + 4)
+/* Length of journal entry header (ISN and image length). */
+#define JOURNAL_ENTRY_LEN 12
+/*
+ * Entries without image are markers of transactions: before-images
+ * written before commit marker belong to committed transaction, ones
+ * written before rollback marker belong to backed out transaction.
+ */
+#define JOURNAL_COMMIT 'C'
+#define JOURNAL_ROLLBACK 'R'
+/* Size of journal file buffer. */
+#define JOURNAL_BUF_SIZE (1024 * 1024)
+
+/* Journal file. */
+static FILE *journal_file = NULL;
+/* Buffer of journal file. */
+static char *journal_buf = NULL;
+/* Offsets of entries in journal opened for replay. */
+static uint64_t *entry_offsets = NULL;
+
+int journal_mark(char mark);
+int journal_seek(uint64_t offset);
+
+/*
+ * Store 16-bit value in little-endian byte order.
+ */
+void put_uint16(unsigned char *buf, uint16_t value)
+{
+	buf[0] = (unsigned char) (value & 0xFF);
+	buf[1] = (unsigned char) (value >> 8);
+}
+
+/*
+ * Store 32-bit value in little-endian byte order.
+ */
+void put_uint32(unsigned char *buf, uint32_t value)
+{
+	put_uint16(buf, (uint16_t) (value & 0xFFFF));
+	put_uint16(buf + 2, (uint16_t) (value >> 16));
+}
+
+/*
+ * Load 16-bit value stored in little-endian byte order.
+ */
+uint16_t get_uint16(const unsigned char *buf)
+{
+	return (uint16_t) (buf[0] | (buf[1] << 8));
+}
+
+/*
+ * Load 32-bit value stored in little-endian byte order.
+ */
+uint32_t get_uint32(const unsigned char *buf)
+{
+	return get_uint16(buf) | ((uint32_t) get_uint16(buf + 2) << 16);
+}
+
+/*
+ * Store 64-bit value in little-endian byte order.
+ */
+void put_uint64(unsigned char *buf, uint64_t value)
+{
+	put_uint32(buf, (uint32_t) (value & 0xFFFFFFFF));
+	put_uint32(buf + 4, (uint32_t) (value >> 32));
+}
+
+/*
+ * Load 64-bit value stored in little-endian byte order.
+ */
+uint64_t get_uint64(const unsigned char *buf)
+{
+	return get_uint32(buf) | ((uint64_t) get_uint32(buf + 4) << 32);
+}
+
+/*
+ * Create journal file and write its header.
+ */
+int journal_create(const char *file_name, const struct JournalHeader *header)
+{
+	unsigned char buf[JOURNAL_HEADER_LEN];
+
+	journal_file = fopen(file_name, "wb");
+	if (journal_file == NULL) {
+		return ADAMOD_E_JOURNAL_IO;
+	}
+
+	/*
+	 * Journal is written with large sequential writes,
+	 * file buffer is flushed only at the end of transaction.
+	 */
+	journal_buf = malloc(JOURNAL_BUF_SIZE);
+	if (journal_buf != NULL) {
+		setvbuf(journal_file, journal_buf, _IOFBF, JOURNAL_BUF_SIZE);
+	}
+
+	memcpy(buf, JOURNAL_SIGNATURE, JOURNAL_SIGNATURE_LEN);
+	put_uint16(buf + JOURNAL_SIGNATURE_LEN, header->db_id);
+	put_uint16(buf + JOURNAL_SIGNATURE_LEN + 2, header->file_no);
+	buf[JOURNAL_SIGNATURE_LEN + 4] = (unsigned char) header->kind;
+	put_uint32(buf + JOURNAL_SIGNATURE_LEN + 5, header->format_buf_len);
+
+	if (fwrite(buf, JOURNAL_HEADER_LEN, 1, journal_file) != 1
+		|| fwrite(header->format_buf, header->format_buf_len, 1,
+			journal_file) != 1
+		|| fflush(journal_file) != 0)
+	{
+		return ADAMOD_E_JOURNAL_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Append before-image of record to journal.
+ */
+int journal_write(AdamodIsn isn, const char *image, uint32_t image_len)
+{
+	unsigned char buf[JOURNAL_ENTRY_LEN];
+
+	put_uint64(buf, isn);
+	put_uint32(buf + 8, image_len);
+
+	if (fwrite(buf, JOURNAL_ENTRY_LEN, 1, journal_file) != 1
+		|| fwrite(image, image_len, 1, journal_file) != 1)
+	{
+		return ADAMOD_E_JOURNAL_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Write buffered journal entries to journal file and force them
+ * to disk, so they survive crash of system after commit.
+ */
+int journal_flush(void)
+{
+	if (journal_file == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+	if (fflush(journal_file) != 0) {
+		return ADAMOD_E_JOURNAL_IO;
+	}
+#if defined(_WIN32)
+	if (_commit(_fileno(journal_file)) != 0) {
+#else
+	if (fsync(fileno(journal_file)) != 0) {
+#endif
+		return ADAMOD_E_JOURNAL_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Append marker of transaction end to journal and force it to disk,
+ * because transaction is already ended in database.
+ */
+int journal_mark(char mark)
+{
+	unsigned char buf[JOURNAL_ENTRY_LEN];
+
+	if (journal_file == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	put_uint64(buf, (uint64_t) mark);
+	put_uint32(buf + 8, 0);
+	if (fwrite(buf, JOURNAL_ENTRY_LEN, 1, journal_file) != 1) {
+		return ADAMOD_E_JOURNAL_IO;
+	}
+
+	return journal_flush();
+}
+
+/*
+ * Mark before-images written since previous marker as committed.
+ */
+int journal_commit(void)
+{
+	return journal_mark(JOURNAL_COMMIT);
+}
+
+/*
+ * Mark before-images written since previous marker as backed out,
+ * so they are not replayed.
+ */
+int journal_rollback(void)
+{
+	return journal_mark(JOURNAL_ROLLBACK);
+}
+
+/*
+ * Set position in journal file by 64-bit offset.
+ */
+int journal_seek(uint64_t offset)
+{
+#if defined(_WIN32)
+	return _fseeki64(journal_file, (__int64) offset, SEEK_SET);
+#else
+	return fseeko(journal_file, (off_t) offset, SEEK_SET);
+#endif
+}
+
+/*
+ * Open journal file for replay and read its header.
+ * Offsets of entries of committed transactions are collected, so
+ * entries can be replayed in reverse order. Entries of backed out
+ * transactions are ignored. Entries after last marker (left by
+ * interrupted run, whose transaction may have been committed before
+ * its marker was written) are counted separately and follow committed
+ * ones, so they are replayed when added to number of entries.
+ */
+int journal_open(const char *file_name, struct JournalHeader *header)
+{
+	unsigned char buf[JOURNAL_HEADER_LEN];
+	size_t offsets_size = 0;
+	uint64_t offset;
+	AdamodIsn entry_count = 0;
+
+	/*
+	 * Default buffering is used for replay, because entries are
+	 * read in reverse order with seek before every entry.
+	 */
+	journal_file = fopen(file_name, "rb");
+	if (journal_file == NULL) {
+		return ADAMOD_E_JOURNAL_IO;
+	}
+
+	/* Read and check journal header. */
+	if (fread(buf, JOURNAL_HEADER_LEN, 1, journal_file) != 1) {
+		return ADAMOD_E_INVJOURNAL;
+	}
+	if (memcmp(buf, JOURNAL_SIGNATURE, JOURNAL_SIGNATURE_LEN) != 0) {
+		return ADAMOD_E_INVJOURNAL;
+	}
+	header->db_id = get_uint16(buf + JOURNAL_SIGNATURE_LEN);
+	header->file_no = get_uint16(buf + JOURNAL_SIGNATURE_LEN + 2);
+	header->kind = (char) buf[JOURNAL_SIGNATURE_LEN + 4];
+	header->format_buf_len = get_uint32(buf + JOURNAL_SIGNATURE_LEN + 5);
+	if (header->kind != JOURNAL_MODIFY && header->kind != JOURNAL_DELETE) {
+		return ADAMOD_E_INVJOURNAL;
+	}
+
+	header->format_buf = malloc(header->format_buf_len + 1);
+	if (header->format_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	if (fread(header->format_buf, header->format_buf_len, 1,
+		journal_file) != 1)
+	{
+		return ADAMOD_E_INVJOURNAL;
+	}
+	header->format_buf[header->format_buf_len] = '\0';
+
+	/* Collect offsets of journal entries. */
+	header->entry_count = 0;
+	header->max_image_len = 0;
+	header->unmarked_count = 0;
+	offset = JOURNAL_HEADER_LEN + (uint64_t) header->format_buf_len;
+	while (fread(buf, JOURNAL_ENTRY_LEN, 1, journal_file) == 1) {
+		uint32_t image_len = get_uint32(buf + 8);
+
+		if (image_len == 0) {
+			if (get_uint64(buf) == JOURNAL_COMMIT) {
+				header->entry_count = entry_count;
+			} else if (get_uint64(buf) == JOURNAL_ROLLBACK) {
+				entry_count = header->entry_count;
+			} else {
+				break;
+			}
+			offset += JOURNAL_ENTRY_LEN;
+			continue;
+		}
+
+		/* Skip image and make sure it is complete. */
+		if (journal_seek(offset + JOURNAL_ENTRY_LEN + image_len - 1) != 0
+			|| fgetc(journal_file) == EOF)
+		{
+			break;
+		}
+
+		if (entry_count == offsets_size) {
+			uint64_t *new_offsets;
+
+			offsets_size = offsets_size > 0 ? offsets_size * 2 : 1024;
+			new_offsets = realloc(entry_offsets,
+				offsets_size * sizeof(uint64_t));
+			if (new_offsets == NULL) {
+				return ADAMOD_E_NOMEMORY;
+			}
+			entry_offsets = new_offsets;
+		}
+		entry_offsets[entry_count++] = offset;
+		offset += JOURNAL_ENTRY_LEN + image_len;
+
+		if (image_len > header->max_image_len) {
+			header->max_image_len = image_len;
+		}
+	}
+	header->unmarked_count = entry_count - header->entry_count;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read journal entry by its number.
+ */
+int journal_read(AdamodIsn entry_no, AdamodIsn *isn, char *image,
+	uint32_t image_size, uint32_t *image_len)
+{
+	unsigned char buf[JOURNAL_ENTRY_LEN];
+
+	if (journal_seek(entry_offsets[entry_no]) != 0
+		|| fread(buf, JOURNAL_ENTRY_LEN, 1, journal_file) != 1)
+	{
+		return ADAMOD_E_JOURNAL_IO;
+	}
+
+	*isn = get_uint64(buf);
+	*image_len = get_uint32(buf + 8);
+	if (*image_len == 0 || *image_len > image_size
+		|| fread(image, *image_len, 1, journal_file) != 1)
+	{
+		return ADAMOD_E_INVJOURNAL;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Close journal file.
+ */
+int journal_close(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+
+	if (journal_file != NULL && fclose(journal_file) != 0) {
+		result_code = ADAMOD_E_JOURNAL_IO;
+	}
+	journal_file = NULL;
+
+	free(journal_buf);
+	journal_buf = NULL;
+	free(entry_offsets);
+	entry_offsets = NULL;
+
+	return result_code;
+}
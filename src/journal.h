@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(JOURNAL_H)
+#define JOURNAL_H
+
+#include <stdint.h>
+
+/* Kinds of journalled operations. */
+#define JOURNAL_MODIFY 'A'
+#define JOURNAL_DELETE 'E'
+
+/* Journal header. */
+struct JournalHeader {
+	uint16_t db_id;
+	uint16_t file_no;
+	char kind;
+	uint32_t format_buf_len;
+	char *format_buf;
+
+	/* Filled when journal is opened for replay. */
+	AdamodIsn entry_count;
+	uint32_t max_image_len;
+	/* Entries after last marker, following committed ones. */
+	AdamodIsn unmarked_count;
+};
+
+/* Create journal file and write its header. */
+int journal_create(const char *file_name, const struct JournalHeader *header);
+/* Append before-image of record to journal. */
+int journal_write(AdamodIsn isn, const char *image, uint32_t image_len);
+/* Write buffered journal entries to journal file and force them to disk. */
+int journal_flush(void);
+/* Mark before-images written since previous marker as committed. */
+int journal_commit(void);
+/* Mark before-images written since previous marker as backed out. */
+int journal_rollback(void);
+/* Open journal file for replay and read its header. */
+int journal_open(const char *file_name, struct JournalHeader *header);
+/* Read journal entry by its number. */
+int journal_read(AdamodIsn entry_no, AdamodIsn *isn, char *image,
+	uint32_t image_size, uint32_t *image_len);
+/* Close journal file. */
+int journal_close(void);
+
+/* Store and load numbers in little-endian byte order. */
+void put_uint16(unsigned char *buf, uint16_t value);
+void put_uint32(unsigned char *buf, uint32_t value);
+void put_uint64(unsigned char *buf, uint64_t value);
+uint16_t get_uint16(const unsigned char *buf);
+uint32_t get_uint32(const unsigned char *buf);
+uint64_t get_uint64(const unsigned char *buf);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adacall.h"
+#include "adamod.h"
+#include "codepage.h"
+#include "export.h"
+#include "fdt.h"
+#include "load.h"
+#include "messages.h"
+#include "modify.h"
+
+/* Size of input file buffer. */
+#define INPUT_BUF_SIZE (1024 * 1024)
+/* Maximal length of loaded record buffer. */
+#define RECORD_MAX_LEN 65535
+
+int load_open(void);
+int load_next(uint32_t *record_len);
+int read_line(uint32_t *record_len);
+int store_new_record(AdamodIsn *isn, uint32_t record_len);
+int flush_isns(void);
+int load_layout(void);
+
+/* Input file and its buffer. */
+static FILE *input_file = NULL;
+static char *input_buf = NULL;
+/* Input file is binary export file (otherwise record per line). */
+static int binary_input = 0;
+/* Bytes read from text input file while detecting its format. */
+static unsigned char pending_buf[EXPORT_SIGNATURE_LEN];
+static size_t pending_len = 0, pending_pos = 0;
+
+/* Format buffer of loaded records. */
+static char *format_buf = NULL;
+static uint32_t format_buf_len = 0;
+
+/* Buffer of loaded record. */
+static char *record_buf = NULL;
+/* Layout of text records for translation of alphanumeric values. */
+static struct RecordLayout layout;
+
+/* Writer of assigned ISNs. */
+static FILE *isn_file = NULL;
+static struct IsnWriter isn_writer;
+
+/*
+ * Open input file and detect its format. Binary export files (written
+ * by export mode) contain format buffer and length-prefixed records,
+ * other files contain one record buffer per line.
+ */
+int load_open(void)
+{
+	unsigned char buf[4];
+
+	if (strcmp(options.load_file_name, "-") == 0) {
+		input_file = stdin;
+	} else {
+		input_file = fopen(options.load_file_name, "rb");
+		if (input_file == NULL) {
+			return ADAMOD_E_INPUT_IO;
+		}
+	}
+
+	/* Input file is read with large sequential reads. */
+	if (input_file != stdin) {
+		input_buf = malloc(INPUT_BUF_SIZE);
+		if (input_buf != NULL) {
+			setvbuf(input_file, input_buf, _IOFBF, INPUT_BUF_SIZE);
+		}
+	}
+
+	/*
+	 * Detect format by signature. Standard input can't be rewound,
+	 * so bytes of text input are kept and returned by read_line().
+	 */
+	binary_input = 0;
+	pending_len = fread(pending_buf, 1, EXPORT_SIGNATURE_LEN, input_file);
+	pending_pos = 0;
+	if (pending_len == EXPORT_SIGNATURE_LEN
+		&& memcmp(pending_buf, EXPORT_SIGNATURE, EXPORT_SIGNATURE_LEN)
+			== 0)
+	{
+		pending_len = 0;
+		binary_input = 1;
+		if (fread(buf, 4, 1, input_file) != 1) {
+			return ADAMOD_E_INPUT_IO;
+		}
+		format_buf_len = buf[0] | (buf[1] << 8)
+			| ((uint32_t) buf[2] << 16) | ((uint32_t) buf[3] << 24);
+		if (format_buf_len == 0 || format_buf_len > RECORD_MAX_LEN) {
+			return ADAMOD_E_INVLOAD;
+		}
+
+		/* Format buffer from command line overrides stored one. */
+		format_buf = malloc(format_buf_len);
+		if (format_buf == NULL) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		if (fread(format_buf, format_buf_len, 1, input_file) != 1) {
+			return ADAMOD_E_INPUT_IO;
+		}
+	} else if (ferror(input_file)) {
+		return ADAMOD_E_INPUT_IO;
+	}
+
+	if (options.load_arg != NULL) {
+		free(format_buf);
+		format_buf = NULL;
+		format_buf_len = strlen(options.load_arg);
+	}
+	if (format_buf == NULL && options.load_arg == NULL) {
+		return ADAMOD_E_INVLOAD;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read next record buffer from input file (returns ADAMOD_M_DONE
+ * at the end of file).
+ */
+int load_next(uint32_t *record_len)
+{
+	if (binary_input) {
+		/* 8-byte ISN (ignored) and 4-byte record length. */
+		unsigned char buf[12];
+
+		if (fread(buf, sizeof(buf), 1, input_file) != 1) {
+			return feof(input_file) ? ADAMOD_M_DONE
+				: ADAMOD_E_INPUT_IO;
+		}
+		*record_len = buf[8] | (buf[9] << 8)
+			| ((uint32_t) buf[10] << 16) | ((uint32_t) buf[11] << 24);
+		if (*record_len == 0 || *record_len > RECORD_MAX_LEN
+			|| fread(record_buf, *record_len, 1, input_file) != 1)
+		{
+			return ADAMOD_E_INPUT_IO;
+		}
+	} else {
+		int return_code;
+
+		/* Empty lines are skipped. */
+		while ((return_code = read_line(record_len)) == ADAMOD_SUCCESS
+			&& *record_len == 0)
+		{
+		}
+		return return_code;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read record buffer from line of text input file (line terminator
+ * is not included in record buffer).
+ */
+int read_line(uint32_t *record_len)
+{
+	int c = EOF;
+	uint32_t len = 0;
+
+	for (;;) {
+		if (pending_pos < pending_len) {
+			c = pending_buf[pending_pos++];
+		} else if ((c = getc(input_file)) == EOF) {
+			break;
+		}
+		if (c == '\n') {
+			break;
+		}
+		if (len >= RECORD_MAX_LEN) {
+			/* Line does not fit in record buffer. */
+			return ADAMOD_E_INVLOAD;
+		}
+		record_buf[len++] = (char) c;
+	}
+
+	if (c == EOF) {
+		if (ferror(input_file)) {
+			return ADAMOD_E_INPUT_IO;
+		}
+		if (len == 0) {
+			return ADAMOD_M_DONE;
+		}
+	}
+	if (len > 0 && record_buf[len - 1] == '\r') {
+		len--;
+	}
+	*record_len = len;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Store new record in Adabas file and get its ISN.
+ */
+int store_new_record(AdamodIsn *isn, uint32_t record_len)
+{
+	ACBX acbx;
+	ABD fb_abd, rb_abd;
+	ABD *abds[2];
+	char *fb = options.load_arg != NULL
+		? (char *) options.load_arg : format_buf;
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command N1 (Add Record): add new record, ISN is assigned
+	 * by Adabas.
+	 */
+	acbx_init(&acbx, "N1", options.db_id, options.file_no);
+	abd_init(&fb_abd, ABD_FORMAT, fb, format_buf_len, format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, record_len, record_len);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+
+	/*
+	 * Execute Adabas direct call command N1. When hold queue is full
+	 * of added records, transaction is ended and command repeated.
+	 */
+	if (hold_call(&acbx, 2, abds) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_N1;
+	}
+
+	*isn = acbx.acbxisn;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Write assigned ISNs of stored records to ISN file, so they reach it
+ * before transaction is ended.
+ */
+int flush_isns(void)
+{
+	if (isn_file != NULL && isn_writer_flush(&isn_writer)
+		!= ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_OUTPUT_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Compile format buffer of text input with field definitions, so
+ * alphanumeric values are translated to codepage of database.
+ */
+int load_layout(void)
+{
+	struct FieldTable table;
+	int result_code;
+
+	result_code = fdt_load(&table);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+	result_code = layout_compile(&table, options.load_arg != NULL
+		? options.load_arg : format_buf, format_buf_len, &layout);
+	fdt_free(&table);
+
+	return result_code == ADAMOD_SUCCESS ? ADAMOD_SUCCESS : ADAMOD_E_INVLOAD;
+}
+
+/*
+ * Store records read from input file in specified Adabas file.
+ */
+int load_file_records(void)
+{
+	int return_code;
+	char db_options[30];
+	time_t start_time, prev_time;
+	AdamodIsn rec_no = 0;
+	AdamodIsn isn = 0;
+	uint32_t record_len;
+
+	record_buf = malloc(RECORD_MAX_LEN);
+	if (record_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	return_code = load_open();
+
+	/* Assigned ISNs are written to output file in order of records. */
+	if (return_code == ADAMOD_SUCCESS && options.output_file_name != NULL
+		&& !options.dry_mode)
+	{
+		isn_file = fopen(options.output_file_name, "wb");
+		if (isn_file == NULL) {
+			return_code = ADAMOD_E_OUTPUT_IO;
+		} else {
+			return_code = isn_writer_open(&isn_writer, isn_file,
+				options.log_format);
+		}
+	}
+
+	/* Open Adabas database. */
+	if (return_code == ADAMOD_SUCCESS) {
+		commit_hook(flush_isns);
+		sprintf(db_options, "UPD=%d.", options.file_no);
+		if (db_open(options.db_id, db_options) != ADA_NORMAL) {
+			return_code = ADAMOD_E_ADABAS_OP;
+		}
+	}
+
+	if (return_code == ADAMOD_SUCCESS) {
+		/* Get process start time. */
+		time(&start_time);
+		prev_time = start_time;
+
+		/* Text values are translated to codepage of database. */
+		if (codepage_enabled() && !binary_input) {
+			return_code = load_layout();
+		}
+
+		while (return_code == ADAMOD_SUCCESS
+			&& (return_code = load_next(&record_len)) == ADAMOD_SUCCESS)
+		{
+			/* Increase records counter. */
+			rec_no++;
+
+			/* Binary records are exported in codepage of database. */
+			if (codepage_enabled() && !binary_input
+				&& codepage_record(&layout, (unsigned char *) record_buf,
+					record_len, 1) != ADAMOD_SUCCESS)
+			{
+				return_code = ADAMOD_E_INVLOAD;
+				break;
+			}
+
+			/* In dry run mode skip real record storing. */
+			if (!options.dry_mode) {
+				return_code = store_new_record(&isn, record_len);
+				if (return_code == ADAMOD_SUCCESS
+					&& isn_file != NULL)
+				{
+					return_code = isn_writer_put(&isn_writer, isn);
+				}
+				if (return_code != ADAMOD_SUCCESS) {
+					break;
+				}
+
+				/* Log ISN of record for high verbose levels. */
+				if (options.verbose_level > 2
+					&& isn_writer_put(&isn_log, isn)
+						!= ADAMOD_SUCCESS)
+				{
+					return_code = ADAMOD_E_LOG_IO;
+					break;
+				}
+
+				/* Commit specified number of records. */
+				return_code = commit_record();
+				if (return_code != ADAMOD_SUCCESS) {
+					break;
+				}
+			}
+
+			/* Print process status. */
+			print_progress(rec_no, &prev_time);
+		}
+		if (return_code == ADAMOD_M_DONE) {
+			return_code = end_transaction();
+		}
+
+		/* Close Adabas database. */
+		if (db_close(options.db_id) != ADA_NORMAL) {
+			return_code = ADAMOD_E_ADABAS_CL;
+		}
+	}
+
+	/* Close files. */
+	commit_hook(NULL);
+	if (isn_file != NULL) {
+		if (isn_writer_close(&isn_writer) != ADAMOD_SUCCESS
+			|| fclose(isn_file) != 0)
+		{
+			if (return_code == ADAMOD_SUCCESS) {
+				return_code = ADAMOD_E_OUTPUT_IO;
+			}
+		}
+		isn_file = NULL;
+	}
+	if (input_file != NULL && input_file != stdin) {
+		fclose(input_file);
+	}
+	input_file = NULL;
+	free(input_buf);
+	free(format_buf);
+	free(record_buf);
+
+	/* Print used time. */
+	if (return_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
+	return return_code;
+}
@@ -26,7 +26,9 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <math.h>
 #include <stdio.h>
+#include <time.h>
 #include "adamod.h"
 #include "messages.h"
 
@@ -47,23 +49,107 @@ struct AdamodMessage messages[] = {
 	"Error: invalid format or record buffer specified" },
 	{ ADAMOD_E_NOMODIFY,
 	"Error: format and record buffers must be specified" },
+	{ ADAMOD_E_NOJOURNALFMT,
+	"Error: format buffer of journal must be specified" },
+	{ ADAMOD_E_INVFORMAT,
+	"Error: invalid format buffer of journal specified" },
+	{ ADAMOD_E_INVJOURNAL,
+	"Error: invalid journal file" },
+	{ ADAMOD_E_JOURNAL_IO,
+	"Error: journal file input/output failed" },
+	{ ADAMOD_E_NOMEMORY,
+	"Error: not enough memory" },
+	{ ADAMOD_E_LOG_IO,
+	"Error: log file writing failed" },
+	{ ADAMOD_E_INVISNLOG,
+	"Error: invalid ISN log file" },
+	{ ADAMOD_E_INVEXPORT,
+	"Error: format buffer with lengths of exported fields must be specified" },
+	{ ADAMOD_E_OUTPUT_IO,
+	"Error: output file writing failed" },
+	{ ADAMOD_E_INVRECORD,
+	"Error: invalid record buffer returned by Adabas" },
+	{ ADAMOD_E_INVLOAD,
+	"Error: invalid format or record buffer of loaded records" },
+	{ ADAMOD_E_INPUT_IO,
+	"Error: input file reading failed" },
+	{ ADAMOD_E_CACHE_IO,
+	"Error: search cache file writing failed" },
+	{ ADAMOD_E_INVRANGE,
+	"Error: invalid descriptor range specified" },
+	{ ADAMOD_E_INVUPDATE,
+	"Error: invalid modification in update file" },
+	{ ADAMOD_E_TRACE_IO,
+	"Error: trace file writing failed" },
+	{ ADAMOD_E_REPLAY_IO,
+	"Error: file of recorded calls input/output failed" },
+	{ ADAMOD_E_INVREPLAY,
+	"Error: invalid file of recorded calls" },
+	{ ADAMOD_E_REPLAY_MISMATCH,
+	"Error: Adabas calls differ from recorded calls" },
+	{ ADAMOD_E_EXCLUSIVE,
+	"Error: exclusive control of file can't be obtained (file is in use)" },
+	{ ADAMOD_E_SHARD_IO,
+	"Error: shard directory input/output failed" },
+	{ ADAMOD_E_SHARD_LOST,
+	"Error: lease of ISN range was taken over by other process" },
+	{ ADAMOD_E_INVCODEPAGE,
+	"Error: unknown codepage specified" },
+	{ ADAMOD_E_INVTRANSFORM,
+	"Error: invalid transformation" },
+	{ ADAMOD_E_TRANSFORM,
+	"Error: transformation of record failed" },
+	{ ADAMOD_E_INVRULES,
+	"Error: invalid rules file" },
+	{ ADAMOD_E_RULES_IO,
+	"Error: rules file reading failed" },
+	{ ADAMOD_E_VERIFY,
+	"Error: records mismatching modification or missing found" },
+	{ ADAMOD_E_INVHASH,
+	"Error: invalid hash file" },
+	{ ADAMOD_E_HASH_IO,
+	"Error: hash file reading or writing failed" },
+	{ ADAMOD_E_DIVERGENT,
+	"Error: divergent records found" },
 	{ ADAMOD_E_ADABAS_OP,
 	"Error: can't open Adabas database" },
 	{ ADAMOD_E_ADABAS_CL,
 	"Error: can't close Adabas database" },
 	{ ADAMOD_E_ADABAS_S1,
 	"Error: search failed" },
+	{ ADAMOD_E_ADABAS_L1,
+	"Error: record reading failed" },
 	{ ADAMOD_E_ADABAS_L2,
 	"Error: record reading failed" },
+	{ ADAMOD_E_ADABAS_L3,
+	"Error: record reading failed" },
 	{ ADAMOD_E_ADABAS_A1,
 	"Error: record modification failed" },
 	{ ADAMOD_E_ADABAS_ET,
 	"Error: commit transaction failed" },
 	{ ADAMOD_E_ADABAS_E1,
 	"Error: record deleting failed" },
+	{ ADAMOD_E_ADABAS_L4,
+	"Error: before-image reading failed" },
+	{ ADAMOD_E_ADABAS_N2,
+	"Error: record storing failed" },
+	{ ADAMOD_E_ADABAS_N1,
+	"Error: record adding failed" },
+	{ ADAMOD_E_ADABAS_C1,
+	"Error: checkpoint failed" },
+	{ ADAMOD_E_ADABAS_LF,
+	"Error: field definitions reading failed" },
+	{ ADAMOD_E_ADABAS_BT,
+	"Error: transaction backout failed" },
 
 	{ ADAMOD_M_DRYMODE,
 	"Running in dry mode" },
+	{ ADAMOD_M_STOPPED,
+	"Processing stopped on request" },
+	{ ADAMOD_M_HOLD_QUEUE,
+	"Hold queue is full" },
+	{ ADAMOD_M_NOT_FOUND,
+	"Record is not found" },
 	{ ADAMOD_M_DONE,
 	"Done" },
 
@@ -86,6 +172,55 @@ void print_message(AdamodStateCode code)
 	}
 }
 
+/*
+ * Print number of processed records once a second.
+ */
+void print_progress(AdamodIsn rec_no, time_t *prev_time)
+{
+	time_t cur_time;
+
+	time(&cur_time);
+	if (cur_time > *prev_time) {
+		if (options.verbose_level > 1) {
+			fprintf(stderr, "\rRecord: %llu",
+				(unsigned long long) rec_no);
+		}
+
+		*prev_time = cur_time;
+		fflush(stderr);
+	}
+}
+
+/*
+ * Print number of processed records and used time.
+ */
+void print_summary(AdamodIsn rec_no, time_t start_time)
+{
+	time_t cur_time;
+	double used_time;
+	int used_hours, used_minutes, used_seconds;
+
+	if (options.verbose_level < 1) {
+		return;
+	}
+
+	time(&cur_time);
+	used_time = (double) (cur_time - start_time);
+	used_hours = (int) floor(used_time / 3600);
+	used_minutes = (int) floor((used_time
+		- (used_hours * 3600)) / 60);
+	used_seconds = (int) (used_time - (used_hours * 3600)
+		- (used_minutes * 60));
+
+	if (options.verbose_level > 1) {
+		fputc('\r', stderr);
+	}
+	fprintf(stderr, "Processed records: %llu\n",
+		(unsigned long long) rec_no);
+	fprintf(stderr, "Done in %d:%02d:%02d.\n",
+		used_hours, used_minutes, used_seconds);
+}
+
 /*
  * Print Adabas buffer content.
  */
@@ -115,40 +250,43 @@ void dump_adabas_buf(unsigned char *buf, unsigned int buf_len)
 /*
  * Print Adabas control block content.
  */
-void dump_adabas_cb(CB_PAR *cb_)
+void dump_adabas_cb(ACBX *acbx)
 {
-	fprintf(stderr, "Call type:        %d\n", (int) cb_->cb_call_type);
+	fprintf(stderr, "Call type:        %d\n", (int) acbx->acbxtyp);
 	fprintf(stderr, "Command code:     ");
-	dump_adabas_buf(cb_->cb_cmd_code, 2);
+	dump_adabas_buf(acbx->acbxcmd, 2);
 	fprintf(stderr, "Command ID:       ");
-	dump_adabas_buf(cb_->cb_cmd_id, 4);
-	fprintf(stderr, "Database number:  %d\n", cb_->cb_un.x_un.x_cb_db_id);
-	fprintf(stderr, "File number:      %d\n", cb_->cb_un.x_un.x_cb_file_nr);
-	fprintf(stderr, "Return code:      %d\n", cb_->cb_return_code);
-	fprintf(stderr, "ISN:              %d\n", cb_->cb_isn);
-	fprintf(stderr, "ISN lower limit:  %d\n", cb_->cb_isn_ll);
-	fprintf(stderr, "ISN quantity:     %d\n", cb_->cb_isn_quantity);
-	fprintf(stderr, "Command option 1: %d\n", (int) cb_->cb_cop1);
-	fprintf(stderr, "Command option 2: %d\n", (int) cb_->cb_cop2);
-	fprintf(stderr, "Command time:     %d\n", cb_->cb_cmd_time);
+	dump_adabas_buf(acbx->acbxcid, 4);
+	fprintf(stderr, "Database number:  %lu\n",
+		(unsigned long) acbx->acbxdbid);
+	fprintf(stderr, "File number:      %lu\n",
+		(unsigned long) acbx->acbxfnr);
+	fprintf(stderr, "Return code:      %d\n", (int) acbx->acbxrsp);
+	fprintf(stderr, "Subcode:          %d\n", (int) acbx->acbxerrc);
+	fprintf(stderr, "ISN:              %llu\n",
+		(unsigned long long) acbx->acbxisn);
+	fprintf(stderr, "ISN lower limit:  %llu\n",
+		(unsigned long long) acbx->acbxisl);
+	fprintf(stderr, "ISN quantity:     %llu\n",
+		(unsigned long long) acbx->acbxisq);
+	fprintf(stderr, "Command options:  ");
+	dump_adabas_buf(acbx->acbxcop, 8);
+	fprintf(stderr, "Command time:     %llu\n",
+		(unsigned long long) acbx->acbxcmdt);
 	fprintf(stderr, "User area:        ");
-	dump_adabas_buf(cb_->cb_user_area, 4);
+	dump_adabas_buf(acbx->acbxusr, 16);
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Addition 1 field: ");
-	dump_adabas_buf(cb_->cb_add1, CB_L_AD1);
+	dump_adabas_buf(acbx->acbxadd1, 8);
 	fprintf(stderr, "Addition 2 field: ");
-	dump_adabas_buf(cb_->cb_add2, CB_L_AD2);
+	dump_adabas_buf(acbx->acbxadd2, 4);
 	fprintf(stderr, "Addition 3 field: ");
-	dump_adabas_buf(cb_->cb_add3, CB_L_AD3);
+	dump_adabas_buf(acbx->acbxadd3, 8);
 	fprintf(stderr, "Addition 4 field: ");
-	dump_adabas_buf(cb_->cb_add4, CB_L_AD4);
+	dump_adabas_buf(acbx->acbxadd4, 8);
 	fprintf(stderr, "Addition 5 field: ");
-	dump_adabas_buf(cb_->cb_add5, CB_L_AD5);
-	fprintf(stderr, "\n");
-	fprintf(stderr, "Format buffer length: %d\n", cb_->cb_fmt_buf_lng);
-	fprintf(stderr, "Record buffer length: %d\n", cb_->cb_rec_buf_lng);
-	fprintf(stderr, "Search buffer length: %d\n", cb_->cb_sea_buf_lng);
-	fprintf(stderr, "Value buffer length:  %d\n", cb_->cb_val_buf_lng);
-	fprintf(stderr, "ISN buffer length:    %d\n", cb_->cb_isn_buf_lng);
+	dump_adabas_buf(acbx->acbxadd5, 8);
+	fprintf(stderr, "Addition 6 field: ");
+	dump_adabas_buf(acbx->acbxadd6, 8);
 	fprintf(stderr, "\n");
 }
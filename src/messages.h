@@ -29,13 +29,18 @@
 #if !defined(MESSAGES_H)
 #define MESSAGES_H
 
-#include <adabas.h>
+#include <adabasx.h>
+#include <time.h>
 
 /* Print message for specified application state code. */
 void print_message(AdamodStateCode code);
+/* Print number of processed records once a second. */
+void print_progress(AdamodIsn rec_no, time_t *prev_time);
+/* Print number of processed records and used time. */
+void print_summary(AdamodIsn rec_no, time_t start_time);
 /* Print Adabas buffer content. */
 void dump_adabas_buf(unsigned char *buf, unsigned int buf_len);
 /* Print Adabas control block content. */
-void dump_adabas_cb(CB_PAR *cb_);
+void dump_adabas_cb(ACBX *acbx);
 
 #endif /* MESSAGES_H */
@@ -26,461 +26,2234 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <adabas.h>
-#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "adacall.h"
 #include "adamod.h"
+#include "codepage.h"
+#include "control.h"
+#include "fdt.h"
+#include "format.h"
+#include "journal.h"
 #include "messages.h"
 #include "modify.h"
+#include "search.h"
+#include "shard.h"
+#include "timer.h"
+#include "trace.h"
+#include "transform.h"
+#include "tune.h"
+#include "update.h"
 
+/* Default and maximal number of ISNs returned by command S1. */
 #define ISN_BUF_LEN 1000
+#define ISN_BUF_MAX 16384
 
-int db_open(int db_id, const char *db_options);
-int db_close(int db_id);
+/* Size of before-image buffer when record length is not known. */
+#define IMAGE_MAX_LEN 65535
+/* Maximal number of fields in format buffer of modified fields. */
+#define MODIFY_FIELDS_MAX 256
+/* Minimal number of records between checkpoints under exclusive control. */
+#define CHECKPOINT_RECORDS 100000
+/* Interval of claims while chunks are leased by other processes. */
+#define SHARD_POLL_USEC 5000000
+/* Maximal number of resumptions without newly committed records. */
+#define RESUME_MAX 3
 
-int modify_record(ISN isn);
-int delete_record(ISN isn);
+int prepare_modification(void);
+int prepare_transformation(void);
+int check_commit(void);
+
+int read_before_image(AdamodIsn isn, char *format_buf,
+	uint32_t format_buf_len);
+int update_record(AdamodIsn isn, char *format_buf, uint32_t format_buf_len,
+	char *record_buf, uint32_t record_buf_len);
+int store_record(AdamodIsn isn, char *format_buf, uint32_t format_buf_len,
+	char *record_buf, uint32_t record_buf_len);
+int modify_record(AdamodIsn isn);
+int transform_values(AdamodIsn isn, const unsigned char *record_buf,
+	uint32_t record_len);
+int transform_record(AdamodIsn isn);
+int reread_records(ACBX *acbx, AdamodIsn isn);
+int transform_file(void);
+int delete_record(AdamodIsn isn);
 int search_records(void);
-int scan_file(void);
+int select_records(void);
+int range_records(void);
+int scan_file(const struct IsnSet *selection);
+int purge_file(void);
+int chunk_record(struct ShardLease *lease, AdamodIsn isn, AdamodIsn *rec_no,
+	time_t *prev_time);
+int read_chunk(struct ShardLease *lease, AdamodIsn *rec_no,
+	time_t *prev_time, int *last);
+int select_chunk(struct ShardLease *lease, const struct IsnSet *selection,
+	AdamodIsn *rec_no, time_t *prev_time, int *last);
+int shard_records(void);
+int create_journal(void);
+int track_record(AdamodIsn isn);
+int record_committed(AdamodIsn isn);
+int process_records(void);
 
+/* Number of records modified in current transaction. */
+static unsigned int transaction_records = 0;
 /*
- * Open Adabas database.
+ * Records of batch read by transform_file() are held, so transaction
+ * isn't ended by full hold queue until batch is discarded.
  */
-int db_open(int db_id, const char *db_options)
-{
-	CB_PAR cb;
+static int batch_held = 0;
+
+/* Function saving output of records before commit (if any). */
+static int (*commit_output)(void) = NULL;
+
+/* Number and ISN of last processed record (reported on stop). */
+static AdamodIsn processed_records = 0;
+static AdamodIsn last_isn = 0;
+/* Number and ISN of last processed record at last commit. */
+static AdamodIsn committed_records = 0;
+static AdamodIsn committed_isn = 0;
 
-	/* Prepare Adabas direct call control block. */
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'O';
-	cb.cb_cmd_code[1] = 'P';
-	CB_SET_FD(&cb, db_id, 0);
-	cb.cb_rec_buf_lng = strlen(db_options);
+/*
+ * ISNs of records modified in current transaction and in committed
+ * ones, kept while lost session may be resumed.
+ */
+static int resume_mode = 0;
+static AdamodIsn *transaction_isns = NULL;
+static size_t transaction_isns_size = 0;
+static size_t transaction_isn_count = 0;
+static struct IsnSet committed_set;
 
-	/* Execute Adabas direct call command OP. */
-	do {
-		adabas(&cb, NULL, (char *) db_options, NULL, NULL, NULL);
-	} while (cb.cb_return_code == ADA_TABT);
+/* ISN buffer of command S1 (ISNs are returned as 4-byte values). */
+static uint32_t isn_buf[ISN_BUF_MAX];
 
-	cb.cb_isn_quantity = 0;
-	cb.cb_isn_ll = 0;
+/* Buffer for before-images of records written to journal. */
+static char *image_buf = NULL;
+static uint32_t image_buf_len = 0;
 
-	return cb.cb_return_code;
-}
+/* Format and record buffers of modification from command line. */
+static char *modify_format_buf = NULL;
+static uint32_t modify_format_len = 0;
+static char *modify_record_buf = NULL;
+static uint32_t modify_record_len = 0;
+
+/* Buffers of records read and written by transformation. */
+static unsigned char *transform_buf = NULL;
+static unsigned char *transform_result_buf = NULL;
+static uint32_t transform_buf_len = 0;
 
 /*
- * Close Adabas database.
+ * Prepare format and record buffers of modification from command line
+ * argument (split argument by delimiter '.') and check them against
+ * field definitions of file, before any record is modified.
  */
-int db_close(int db_id)
+int prepare_modification(void)
 {
-	/* Prepare Adabas direct call control block. */
-	CB_PAR cb;
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'C';
-	cb.cb_cmd_code[1] = 'L';
-	CB_SET_FD(&cb, db_id, 0);
+	struct FieldTable table;
+	struct RecordLayout layout;
+	int result_code;
+
+	modify_format_buf = (char *) options.modify_arg;
+	modify_record_buf = strchr(options.modify_arg, '.') + 1;
+	modify_format_len = modify_record_buf - modify_format_buf;
+	modify_record_len = strlen(modify_record_buf);
+
+	result_code = fdt_load(&table);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+	result_code = layout_compile(&table, modify_format_buf,
+		modify_format_len, &layout);
+	fdt_free(&table);
 
-	/* Execute Adabas direct call command CL. */
-	adabas(&cb, NULL, NULL, NULL, NULL, NULL);
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = layout_check(&layout,
+			(const unsigned char *) modify_record_buf, modify_record_len);
+	}
+	if (result_code == ADAMOD_SUCCESS) {
+		/* Alphanumeric values are translated to codepage of database. */
+		codepage_record(&layout, (unsigned char *) modify_record_buf,
+			modify_record_len, 1);
+	} else if (result_code == ADAMOD_E_INVFORMAT && codepage_enabled()) {
+		/* Values can't be translated without formats of fields. */
+		result_code = ADAMOD_E_INVMODIFY;
+	} else if (result_code == ADAMOD_E_INVFORMAT) {
+		/* Format buffer not compiled is checked by Adabas only. */
+		if (options.verbose_level > 1) {
+			fputs("Format buffer not checked with field definitions\n",
+				stderr);
+		}
+		result_code = ADAMOD_SUCCESS;
+	}
 
-	return cb.cb_return_code;
+	return result_code;
 }
 
 /*
- * Modify record in Adabas file (specified by ISN).
+ * Bind transformation to field definitions of file, before any record
+ * is modified. Modified fields are specified by format buffer of
+ * assigned fields.
  */
-int modify_record(ISN isn)
+int prepare_transformation(void)
 {
-	CB_PAR cb;
+	struct FieldTable table;
+	int result_code;
 
-	/*
-	 * Get format and record buffers from command line argument
-	 * (split argument by delimiter '.').
-	 */
-	char *format_buf = (char *) options.modify_arg;
-	char *record_buf = strchr(options.modify_arg, '.') + 1;
-	int format_buf_len = record_buf - format_buf;
-	int record_buf_len = strlen(record_buf);
+	modify_format_buf = (char *) transform_write_format();
+	modify_format_len = strlen(modify_format_buf);
 
-	/* Print ISN of record for high verbose levels. */
-	if (options.verbose_level > 2) {
-		fprintf(log_file, "%d\n", isn);
+	result_code = fdt_load(&table);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
 	}
-
-	/* In dry run mode skip real record modification. */
-	if (options.dry_mode) {
-		return ADAMOD_SUCCESS;
+	result_code = transform_bind(&table);
+	fdt_free(&table);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
 	}
 
-	/*
-	 * Prepare Adabas direct call control block.
-	 * Command A1 (Record Update): modify the value of one or more fields
-	 * within a record.
-	 */
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'A';
-	cb.cb_cmd_code[1] = '1';
-	CB_SET_FD(&cb, options.db_id, options.file_no);
-	cb.cb_cop1 = 'H';
-	cb.cb_isn = isn;
-	cb.cb_fmt_buf_lng = format_buf_len;
-	cb.cb_rec_buf_lng = record_buf_len;
-
-	/* Execute Adabas direct call command A1. */
-	adabas(&cb, format_buf, record_buf, NULL, NULL, NULL);
-	if (cb.cb_return_code != ADA_NORMAL) {
-		if (options.verbose_level > 0) {
-			dump_adabas_cb(&cb);
-		}
-		return ADAMOD_E_ADABAS_A1;
+	if (options.verbose_level > 1) {
+		fprintf(stderr, "Transformation reads fields %s\n",
+			transform_read_format());
 	}
 
-	/*
-	 * Prepare Adabas direct call control block.
-	 * Command ET (End Transaction): end of a logical transaction.
-	 */
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'E';
-	cb.cb_cmd_code[1] = 'T';
-	CB_SET_FD(&cb, options.db_id, options.file_no);
-
-	/* Execute Adabas direct call command ET. */
-	adabas(&cb, NULL, NULL, NULL, NULL, NULL);
-	if (cb.cb_return_code != ADA_NORMAL) {
-		if (options.verbose_level > 0) {
-			dump_adabas_cb(&cb);
-		}
-		return ADAMOD_E_ADABAS_ET;
+	/* Read and computed record buffers are kept in one allocation. */
+	transform_buf_len = transform_record_max();
+	transform_buf = malloc(transform_buf_len * 2);
+	if (transform_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
 	}
+	transform_result_buf = transform_buf + transform_buf_len;
 
 	return ADAMOD_SUCCESS;
 }
 
 /*
- * Delete record from the Adabas file (specified by ISN).
+ * End current transaction, if any records were modified in it. Under
+ * exclusive control records are modified without transactions, so
+ * checkpoint is written instead.
  */
-int delete_record(ISN isn)
+int end_transaction(void)
 {
-	CB_PAR cb;
-
-	/* Print ISN of record for high verbose levels. */
-	if (options.verbose_level > 2) {
-		fprintf(log_file, "%d\n", isn);
-	}
+	ACBX acbx;
+	uint64_t start_usec;
+	int result_code;
 
-	/* In dry run mode skip real record modification. */
-	if (options.dry_mode) {
+	if (transaction_records == 0) {
 		return ADAMOD_SUCCESS;
 	}
+	start_usec = timer_usec();
 
 	/*
-	 * Prepare Adabas direct call control block.
-	 * Command E1 (Delete Record): delete a record.
+	 * Before-images must reach journal file before modifications
+	 * are committed.
 	 */
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'E';
-	cb.cb_cmd_code[1] = '1';
-	CB_SET_FD(&cb, options.db_id, options.file_no);
-	cb.cb_isn = isn;
-
-	/* Execute Adabas direct call command E1. */
-	adabas(&cb, NULL, NULL, NULL, NULL, NULL);
-	if (cb.cb_return_code != ADA_NORMAL) {
-		if (options.verbose_level > 0) {
-			dump_adabas_cb(&cb);
+	if (options.journal_file_name != NULL
+		&& journal_flush() != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_JOURNAL_IO;
+	}
+	if (commit_output != NULL) {
+		result_code = commit_output();
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
 		}
-		return ADAMOD_E_ADABAS_E1;
 	}
 
-	/*
-	 * Prepare Adabas direct call control block.
-	 * Command ET (End Transaction): end of a logical transaction.
-	 */
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'E';
-	cb.cb_cmd_code[1] = 'T';
-	CB_SET_FD(&cb, options.db_id, options.file_no);
-
-	/* Execute Adabas direct call command ET. */
-	adabas(&cb, NULL, NULL, NULL, NULL, NULL);
-	if (cb.cb_return_code != ADA_NORMAL) {
-		if (options.verbose_level > 0) {
-			dump_adabas_cb(&cb);
+	if (options.exclusive_mode) {
+		/*
+		 * Prepare Adabas direct call control block.
+		 * Command C1 (Checkpoint): write checkpoint of
+		 * modifications.
+		 */
+		acbx_init(&acbx, "C1", options.db_id, options.file_no);
+
+		/* Execute Adabas direct call command C1. */
+		if (adabas_call(&acbx, 0, NULL) != ADA_NORMAL) {
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_C1;
+		}
+	} else {
+		/*
+		 * Prepare Adabas direct call control block.
+		 * Command ET (End Transaction): end of a logical
+		 * transaction.
+		 */
+		acbx_init(&acbx, "ET", options.db_id, options.file_no);
+
+		/* Execute Adabas direct call command ET. */
+		if (adabas_call(&acbx, 0, NULL) != ADA_NORMAL) {
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_ET;
+		}
+		tune_commit(transaction_records, adabas_call_usec());
+
+		/* Records of committed transaction are not modified again. */
+		if (resume_mode) {
+			size_t isn_no;
+
+			for (isn_no = 0; isn_no < transaction_isn_count; isn_no++) {
+				if (isn_set_add(&committed_set, transaction_isns[isn_no])
+					!= ADAMOD_SUCCESS)
+				{
+					return ADAMOD_E_NOMEMORY;
+				}
+			}
+			transaction_isn_count = 0;
 		}
-		return ADAMOD_E_ADABAS_ET;
+	}
+
+	transaction_records = 0;
+	committed_records = processed_records;
+	committed_isn = last_isn;
+	trace_span("commit", "commit", start_usec, timer_usec());
+
+	/* Before-images of committed records are replayed by undo. */
+	if (options.journal_file_name != NULL
+		&& journal_commit() != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_JOURNAL_IO;
 	}
 
 	return ADAMOD_SUCCESS;
 }
 
 /*
- * Search records according to specified search argument
- * (combination of search and value buffers) and modify
- * found records.
+ * Back out current transaction, so its before-images are not replayed
+ * by undo. Transaction of lost session is already backed out by
+ * Adabas. Under exclusive control modifications can't be backed out,
+ * so their before-images are kept.
  */
-int search_records(void)
+int backout_transaction(void)
 {
-	int result_code;
-	time_t start_time, cur_time, prev_time;
-	int rec_no;
-	unsigned int isn_no;
-	CB_PAR cb;
-
-	/*
-	 * Get search and value buffers from command line argument
-	 * (split argument by delimiter '.').
-	 */
-	char *search_buf = (char *) options.search_arg;
-	char *value_buf = strchr(options.search_arg, '.') + 1;
-	int search_buf_len = value_buf - search_buf;
-	int value_buf_len = strlen(value_buf);
-	
-	/* This ISN buffer will be used in command S1. */
-	ISN isn_buf[ISN_BUF_LEN];
+	ACBX acbx;
 
-	/* Prepare Adabas direct call control block.
-	 * Command S1 (Find Records): select a set of records which
-	 * satisfy given search criteria.
-	 */
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'S';
-	cb.cb_cmd_code[1] = '1';
-	/* Specify database identifier and file number. */
-	CB_SET_FD(&cb, options.db_id, options.file_no);
-	/* Same command identifier will be used for all subsequent commands. */
-	cb.cb_cmd_id[0] = 'A';
-	cb.cb_cmd_id[1] = 'M';
-	cb.cb_cmd_id[2] = 'O';
-	cb.cb_cmd_id[3] = 'D';
-	/* We don't need to read record fields, so use "." as format buffer. */
-	cb.cb_fmt_buf_lng = 1;
-	/* Search criteria specified in search and value buffers. */
-	cb.cb_sea_buf_lng = search_buf_len;
-	cb.cb_val_buf_lng = value_buf_len;
-	/* Use small ISN buffer to get next portion of ISNs. */
-	cb.cb_isn_buf_lng = sizeof(isn_buf);
+	if (options.exclusive_mode) {
+		transaction_records = 0;
+		return options.journal_file_name != NULL
+			? journal_commit() : ADAMOD_SUCCESS;
+	}
 
-	/* Get process start time. */
-	time(&start_time);
-	prev_time = start_time;
+	if (!options.dry_mode && !session_lost()) {
+		/*
+		 * Prepare Adabas direct call control block.
+		 * Command BT (Backout Transaction): remove all modifications
+		 * of current transaction.
+		 */
+		acbx_init(&acbx, "BT", options.db_id, options.file_no);
 
-	/*
-	 * Search records multiple times (don't want to slow down Adabas by
-	 * using 'SAVE LIST' option) and modify every portion of found records.
-	 */
-	rec_no = 0;
-	while (1) {
-		/* Execute Adabas direct call command S1. */
-		adabas(&cb, (char *) ".", NULL, search_buf, value_buf,
-			(char *) isn_buf);
-		if (cb.cb_return_code != ADA_NORMAL) {
+		/* Execute Adabas direct call command BT. */
+		if (adabas_call(&acbx, 0, NULL) != ADA_NORMAL) {
 			if (options.verbose_level > 0) {
-				dump_adabas_cb(&cb);
+				dump_adabas_cb(&acbx);
 			}
-			return ADAMOD_E_ADABAS_S1;
+			return ADAMOD_E_ADABAS_BT;
 		}
+	}
+	transaction_records = 0;
 
-		/* Print number of found records. */
-		if (rec_no == 0 && options.verbose_level > 0) {
-			fprintf(stderr, "Found records: %d\n",
-				cb.cb_isn_quantity);
-		}
+	if (options.journal_file_name != NULL
+		&& journal_rollback() != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_JOURNAL_IO;
+	}
 
-		/* Get ISN of records from ISN buffer and modify each record. */
-		for (isn_no = 0; isn_no < cb.cb_isn_quantity
-			&& isn_no < ISN_BUF_LEN; isn_no++)
-		{
-			/* Increase records counter. */
-			rec_no++;
+	return ADAMOD_SUCCESS;
+}
 
-			/* Modify record by ISN. */
-			if (options.delete_mode) {
-				result_code = delete_record(isn_buf[isn_no]);
-			} else {
-				result_code = modify_record(isn_buf[isn_no]);
-			}
-			if (result_code != ADAMOD_SUCCESS) {
-				return result_code;
-			}
+/*
+ * Set function called before commit to save output of records
+ * (like their assigned ISNs), so output of committed records isn't
+ * lost.
+ */
+void commit_hook(int (*hook)(void))
+{
+	commit_output = hook;
+}
 
-			/* Print process status. */
-			time(&cur_time);
-			if (cur_time > prev_time) {
-				if (options.verbose_level > 1) {
-					fprintf(stderr, "\rRecord: %d", rec_no);
-				}
-	
-				prev_time = cur_time;
-				fflush(stderr);
-			}
-		}
+/*
+ * Count modified record in current transaction and end transaction
+ * when it contains specified number of records.
+ */
+int commit_record(void)
+{
+	transaction_records++;
 
-		/*
-		 * Exit loop if last command S1 returned less ISNs than
-		 * fit in ISN buffer.
-		 */
-		if (cb.cb_isn_quantity < ISN_BUF_LEN) {
-			break;
+	return check_commit();
+}
+
+/*
+ * End transaction when it contains specified number of records.
+ */
+int check_commit(void)
+{
+	/* Under exclusive control only rare checkpoints are written. */
+	if (options.exclusive_mode) {
+		if (transaction_records < CHECKPOINT_RECORDS
+			|| transaction_records < options.commit_count)
+		{
+			return ADAMOD_SUCCESS;
 		}
+		return end_transaction();
 	}
 
-	/* Print used time. */
-	if (options.verbose_level > 0) {
-		double used_time;
-		int used_hours, used_minutes, used_seconds;
+	if (transaction_records < tune_commit_count()) {
+		return ADAMOD_SUCCESS;
+	}
 
-		time(&cur_time);
-		used_time = (double) (cur_time - start_time);
-		used_hours = (int) floor(used_time / 3600);
-		used_minutes = (int) floor((used_time
-			- (used_hours * 3600)) / 60);
-		used_seconds = (int) (used_time - (used_hours * 3600)
-			- (used_minutes * 60));
+	return end_transaction();
+}
 
-		if (options.verbose_level > 1) {
-			fputc('\r', stderr);
+/*
+ * Execute Adabas command which puts record in hold status. When hold
+ * queue is full, records of current transaction are committed and
+ * command is repeated.
+ */
+int hold_call(ACBX *acbx, int abd_count, ABD **abds)
+{
+	uint64_t start_usec;
+
+	if (adabas_call(acbx, abd_count, abds) == ADA_HOLD_QUEUE
+		&& transaction_records > 0 && !batch_held)
+	{
+		start_usec = timer_usec();
+		tune_overload();
+		if (end_transaction() == ADAMOD_SUCCESS) {
+			adabas_call(acbx, abd_count, abds);
 		}
-		fprintf(stderr, "Processed records: %d\n", rec_no);
-		fprintf(stderr, "Done in %d:%02d:%02d.\n",
-			used_hours, used_minutes, used_seconds);
+		trace_span("hold queue retry", "retry", start_usec,
+			timer_usec());
 	}
 
-	return ADAMOD_SUCCESS;
+	return acbx->acbxrsp;
 }
 
 /*
- * Scan and modify all records in specified Adabas file.
+ * Pause processing on request or outside of allowed time window.
+ * Records modified before pause are committed, so they are not held
+ * while session is idle, and lease of shared chunk is renewed.
+ * Returns ADAMOD_M_STOPPED when processing should be stopped.
  */
-int scan_file(void)
+int check_control(void)
 {
 	int result_code;
-	time_t start_time, cur_time, prev_time;
-	int rec_no;
-	CB_PAR cb;
+	ControlState state = control_state();
 
-	/* Prepare Adabas direct call control block.
-	 * Command L2 (Read Physical Sequence): read a record from a set of
-	 * records which are stored in physical sequence in Data Storage.
-	 */
-	memset(&cb, 0, sizeof(CB_PAR));
-	cb.cb_cmd_code[0] = 'L';
-	cb.cb_cmd_code[1] = '2';
-	/* Specify database identifier and file number. */
-	CB_SET_FD(&cb, options.db_id, options.file_no);
-	/* Same command identifier will be used for all subsequent commands. */
-	cb.cb_cmd_id[0] = 'A';
-	cb.cb_cmd_id[1] = 'M';
-	cb.cb_cmd_id[2] = 'O';
-	cb.cb_cmd_id[3] = 'D';
-	/* We don't need to read record fields, so use "." as format buffer. */
-	cb.cb_fmt_buf_lng = 1;
+	if (state == CONTROL_PAUSE) {
+		result_code = end_transaction();
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+		state = control_wait(shard_keep);
+	}
 
-	/* Get process start time. */
-	time(&start_time);
-	prev_time = start_time;
+	return state == CONTROL_STOP ? ADAMOD_M_STOPPED : ADAMOD_SUCCESS;
+}
 
-	/*
-	 * Fetch all records from file in physical sequence and
-	 * modify every record.
-	 */
-	for (rec_no = 1;; rec_no++) {
-		/* Execute Adabas direct call command L2. */
-		adabas(&cb, (char *) ".", NULL, NULL, NULL, NULL);
-		if (cb.cb_return_code != ADA_NORMAL) {
-			/* Exit loop when all records readed. */
-			if (cb.cb_return_code == ADA_EOF) {
-				break;
-			}
+/*
+ * Remember ISN of record modified in current transaction, so it is
+ * skipped after resumption of lost session once transaction is
+ * committed.
+ */
+int track_record(AdamodIsn isn)
+{
+	if (!resume_mode) {
+		return ADAMOD_SUCCESS;
+	}
 
-			/* Print error message when command failed. */
-			if (options.verbose_level > 0) {
-				dump_adabas_cb(&cb);
-			}
+	if (transaction_isn_count == transaction_isns_size) {
+		AdamodIsn *new_isns;
+		size_t new_size = transaction_isns_size > 0
+			? transaction_isns_size * 2 : 1024;
 
-			return ADAMOD_E_ADABAS_L2;
+		new_isns = realloc(transaction_isns,
+			new_size * sizeof(AdamodIsn));
+		if (new_isns == NULL) {
+			return ADAMOD_E_NOMEMORY;
 		}
+		transaction_isns = new_isns;
+		transaction_isns_size = new_size;
+	}
+	transaction_isns[transaction_isn_count++] = isn;
 
-		/* Modify record by ISN. */
-		if (options.delete_mode) {
-			result_code = delete_record(cb.cb_isn);
-		} else {
-			result_code = modify_record(cb.cb_isn);
-		}
-		if (result_code != ADAMOD_SUCCESS) {
-			return result_code;
-		}
+	return ADAMOD_SUCCESS;
+}
 
-		/* Print process status. */
-		time(&cur_time);
-		if (cur_time > prev_time) {
-			if (options.verbose_level > 1) {
-				fprintf(stderr, "\rRecord: %d", rec_no);
-			}
-	
-			prev_time = cur_time;
-			fflush(stderr);
+/*
+ * Check whether record was modified in committed transaction before
+ * session was lost.
+ */
+int record_committed(AdamodIsn isn)
+{
+	return resume_mode && committed_set.count > 0
+		&& isn_set_contains(&committed_set, isn);
+}
+
+/*
+ * Read fields of record (specified by format buffer) with hold and
+ * write them to journal as before-image of record (records are not
+ * held under exclusive control). Returns ADAMOD_M_NOT_FOUND in shard
+ * mode when record is already deleted.
+ */
+int read_before_image(AdamodIsn isn, char *format_buf,
+	uint32_t format_buf_len)
+{
+	ACBX acbx;
+	ABD fb_abd, rb_abd;
+	ABD *abds[2];
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L4 (Read ISN with hold): read record and put it
+	 * in hold status.
+	 * Command L1 (Read ISN): read record without hold.
+	 */
+	acbx_init(&acbx, options.exclusive_mode ? "L1" : "L4", options.db_id,
+		options.file_no);
+	acbx.acbxisn = isn;
+	abd_init(&fb_abd, ABD_FORMAT, format_buf, format_buf_len,
+		format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, image_buf, image_buf_len, 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+
+	/* Execute Adabas direct call command L4. */
+	if (hold_call(&acbx, 2, abds) != ADA_NORMAL) {
+		if (acbx.acbxrsp == ADA_ISN_NOT_FOUND
+			&& options.shard_dir_name != NULL)
+		{
+			return ADAMOD_M_NOT_FOUND;
 		}
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_L4;
 	}
 
-	/* Print used time. */
-	if (options.verbose_level > 0) {
-		double used_time;
-		int used_hours, used_minutes, used_seconds;
+	/* Length of received record buffer is returned in its ABD. */
+	return journal_write(isn, image_buf, (uint32_t) rb_abd.abdrecv);
+}
 
-		time(&cur_time);
-		used_time = (double) (cur_time - start_time);
-		used_hours = (int) floor(used_time / 3600);
-		used_minutes = (int) floor((used_time
-			- (used_hours * 3600)) / 60);
-		used_seconds = (int) (used_time - (used_hours * 3600)
-			- (used_minutes * 60));
+/*
+ * Update fields of record in Adabas file (specified by ISN).
+ */
+int update_record(AdamodIsn isn, char *format_buf, uint32_t format_buf_len,
+	char *record_buf, uint32_t record_buf_len)
+{
+	ACBX acbx;
+	ABD fb_abd, rb_abd;
+	ABD *abds[2];
 
-		if (options.verbose_level > 1) {
-			fputc('\r', stderr);
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command A1 (Record Update): modify the value of one or more fields
+	 * within a record.
+	 */
+	acbx_init(&acbx, "A1", options.db_id, options.file_no);
+	if (!options.exclusive_mode) {
+		acbx.acbxcop[0] = 'H';
+	}
+	acbx.acbxisn = isn;
+	abd_init(&fb_abd, ABD_FORMAT, format_buf, format_buf_len,
+		format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, record_buf_len,
+		record_buf_len);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+
+	/* Execute Adabas direct call command A1. */
+	if (hold_call(&acbx, 2, abds) != ADA_NORMAL) {
+		/* Batch of held records is discarded and read again. */
+		if (batch_held && acbx.acbxrsp == ADA_HOLD_QUEUE) {
+			return ADAMOD_M_HOLD_QUEUE;
+		}
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
 		}
-		fprintf(stderr, "Processed records: %d\n", rec_no);
-		fprintf(stderr, "Done in %d:%02d:%02d.\n",
-			used_hours, used_minutes, used_seconds);
+		return ADAMOD_E_ADABAS_A1;
 	}
 
 	return ADAMOD_SUCCESS;
 }
 
 /*
- * Search records in specified Adabas file and modify found records.
+ * Store record in Adabas file with specified ISN.
  */
-int modify_file_records(void)
+int store_record(AdamodIsn isn, char *format_buf, uint32_t format_buf_len,
+	char *record_buf, uint32_t record_buf_len)
 {
-	int return_code;
-	char db_options[30];
+	ACBX acbx;
+	ABD fb_abd, rb_abd;
+	ABD *abds[2];
 
-	/* Open Adabas database. */
-	sprintf(db_options, "UPD=%d.", options.file_no);
-	if (db_open(options.db_id, db_options) != ADA_NORMAL) {
-		return ADAMOD_E_ADABAS_OP;
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command N2 (Add Record with user ISN): add new record
+	 * with ISN assigned by user.
+	 */
+	acbx_init(&acbx, "N2", options.db_id, options.file_no);
+	acbx.acbxisn = isn;
+	abd_init(&fb_abd, ABD_FORMAT, format_buf, format_buf_len,
+		format_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, record_buf_len,
+		record_buf_len);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+
+	/* Execute Adabas direct call command N2. */
+	if (hold_call(&acbx, 2, abds) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_N2;
 	}
 
-	if (options.isn > 0) {
-		/* When ISN specified, modify/delete just one record by ISN. */
-		if (options.delete_mode) {
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Modify record in Adabas file (specified by ISN).
+ */
+int modify_record(AdamodIsn isn)
+{
+	if (transform_enabled()) {
+		return transform_record(isn);
+	}
+
+	return modify_fields(isn, modify_format_buf, modify_format_len,
+		modify_record_buf, modify_record_len);
+}
+
+/*
+ * Modify record (specified by ISN) with values computed by
+ * transformation from record buffer read with hold. Record isn't
+ * updated when values are not changed, but it's counted in current
+ * transaction which releases its hold.
+ */
+int transform_values(AdamodIsn isn, const unsigned char *record_buf,
+	uint32_t record_len)
+{
+	int result_code;
+	uint32_t result_len, image_len;
+
+	/* Hold of record committed before resumption is only released. */
+	if (record_committed(isn)) {
+		transaction_records++;
+		return ADAMOD_SUCCESS;
+	}
+	processed_records++;
+	last_isn = isn;
+
+	/* Log ISN of record for high verbose levels. */
+	if (options.verbose_level > 2
+		&& isn_writer_put(&isn_log, isn) != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_LOG_IO;
+	}
+
+	/* In dry run mode values are computed without modification. */
+	result_code = transform_apply(record_buf, record_len,
+		transform_result_buf, &result_len, &image_len);
+	if (result_code != ADAMOD_SUCCESS) {
+		if (options.verbose_level > 0) {
+			fprintf(stderr, "Transformation of record with ISN %llu "
+				"failed\n", (unsigned long long) isn);
+		}
+		return result_code;
+	}
+	if (options.dry_mode) {
+		return ADAMOD_SUCCESS;
+	}
+	result_code = track_record(isn);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+	transaction_records++;
+
+	if (result_len == image_len
+		&& memcmp(transform_result_buf, record_buf, image_len) == 0)
+	{
+		return ADAMOD_SUCCESS;
+	}
+
+	/* Values of assigned fields are read first, they are before-image. */
+	if (options.journal_file_name != NULL) {
+		result_code = journal_write(isn, (const char *) record_buf,
+			image_len);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+
+	result_code = update_record(isn, modify_format_buf, modify_format_len,
+		(char *) transform_result_buf, result_len);
+
+	/* Record not modified is processed again after it's read again. */
+	if (result_code == ADAMOD_M_HOLD_QUEUE) {
+		transaction_records--;
+		processed_records--;
+		if (resume_mode) {
+			transaction_isn_count--;
+		}
+	}
+
+	return result_code;
+}
+
+/*
+ * Read fields of record (specified by ISN) used by transformation with
+ * hold and modify record with values computed from them. Records are
+ * not held under exclusive control and in dry run mode.
+ */
+int transform_record(AdamodIsn isn)
+{
+	int result_code;
+	ACBX acbx;
+	ABD fb_abd, rb_abd;
+	ABD *abds[2];
+	const char *format_buf = transform_read_format();
+
+	/* Skip records listed in exclusion files or already committed. */
+	if (isn_excluded(isn) || record_committed(isn)) {
+		return ADAMOD_SUCCESS;
+	}
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L4 (Read ISN with hold): read record and put it
+	 * in hold status.
+	 * Command L1 (Read ISN): read record without hold.
+	 */
+	acbx_init(&acbx, options.exclusive_mode || options.dry_mode
+		? "L1" : "L4", options.db_id, options.file_no);
+	acbx.acbxisn = isn;
+	abd_init(&fb_abd, ABD_FORMAT, (char *) format_buf,
+		strlen(format_buf), strlen(format_buf));
+	abd_init(&rb_abd, ABD_RECORD, transform_buf, transform_buf_len, 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+
+	/* Execute Adabas direct call command L4. */
+	if (hold_call(&acbx, 2, abds) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_L4;
+	}
+
+	/* Length of received record buffer is returned in its ABD. */
+	result_code = transform_values(isn, transform_buf,
+		(uint32_t) rb_abd.abdrecv);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return check_commit();
+}
+
+/*
+ * Modify fields of record in Adabas file (specified by ISN) with values
+ * of record buffer.
+ */
+int modify_fields(AdamodIsn isn, char *format_buf, uint32_t format_buf_len,
+	char *record_buf, uint32_t record_buf_len)
+{
+	int result_code;
+
+	/* Skip records listed in exclusion files or already committed. */
+	if (isn_excluded(isn) || record_committed(isn)) {
+		return ADAMOD_SUCCESS;
+	}
+	processed_records++;
+	last_isn = isn;
+
+	/* Log ISN of record for high verbose levels. */
+	if (options.verbose_level > 2
+		&& isn_writer_put(&isn_log, isn) != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_LOG_IO;
+	}
+
+	/* In dry run mode skip real record modification. */
+	if (options.dry_mode) {
+		return ADAMOD_SUCCESS;
+	}
+	result_code = track_record(isn);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/* Save values of modified fields to journal. */
+	if (options.journal_file_name != NULL) {
+		result_code = read_before_image(isn, format_buf,
+			format_buf_len);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+
+	result_code = update_record(isn, format_buf, format_buf_len,
+		record_buf, record_buf_len);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return commit_record();
+}
+
+/*
+ * Delete record from the Adabas file (specified by ISN). In shard mode
+ * record which is not found was deleted by previous owner of chunk
+ * after its last commit, so it is skipped.
+ */
+int delete_record(AdamodIsn isn)
+{
+	int result_code;
+	ACBX acbx;
+
+	/* Skip records listed in exclusion files or already committed. */
+	if (isn_excluded(isn) || record_committed(isn)) {
+		return ADAMOD_SUCCESS;
+	}
+	processed_records++;
+	last_isn = isn;
+
+	/* Log ISN of record for high verbose levels. */
+	if (options.verbose_level > 2
+		&& isn_writer_put(&isn_log, isn) != ADAMOD_SUCCESS)
+	{
+		return ADAMOD_E_LOG_IO;
+	}
+
+	/* In dry run mode skip real record modification. */
+	if (options.dry_mode) {
+		return ADAMOD_SUCCESS;
+	}
+	result_code = track_record(isn);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/* Save record fields specified for journal. */
+	if (options.journal_file_name != NULL) {
+		result_code = read_before_image(isn,
+			(char *) options.journal_format_arg,
+			strlen(options.journal_format_arg));
+		if (result_code == ADAMOD_M_NOT_FOUND) {
+			processed_records--;
+			return ADAMOD_SUCCESS;
+		}
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command E1 (Delete Record): delete a record.
+	 */
+	acbx_init(&acbx, "E1", options.db_id, options.file_no);
+	acbx.acbxisn = isn;
+
+	/* Execute Adabas direct call command E1. */
+	if (hold_call(&acbx, 0, NULL) != ADA_NORMAL) {
+		if (acbx.acbxrsp == ADA_ISN_NOT_FOUND
+			&& options.shard_dir_name != NULL)
+		{
+			processed_records--;
+			return ADAMOD_SUCCESS;
+		}
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_E1;
+	}
+
+	return commit_record();
+}
+
+/*
+ * Search records according to specified search argument
+ * (combination of search and value buffers) and modify
+ * found records.
+ */
+int search_records(void)
+{
+	int result_code;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no;
+	AdamodIsn isn_no;
+	uint32_t isn_count;
+	ACBX acbx;
+	ABD fb_abd, sb_abd, vb_abd, ib_abd;
+	ABD *abds[4];
+
+	/*
+	 * Get search and value buffers from command line argument
+	 * (split argument by delimiter '.').
+	 */
+	char *search_buf = (char *) options.search_args[0].arg;
+	char *value_buf = strchr(search_buf, '.') + 1;
+	uint32_t search_buf_len = value_buf - search_buf;
+	uint32_t value_buf_len = strlen(value_buf);
+
+	/* Prepare Adabas direct call control block.
+	 * Command S1 (Find Records): select a set of records which
+	 * satisfy given search criteria.
+	 */
+	/* Specify database identifier and file number. */
+	acbx_init(&acbx, "S1", options.db_id, options.file_no);
+	/* Same command identifier will be used for all subsequent commands. */
+	memcpy(acbx.acbxcid, "AMOD", 4);
+	/* We don't need to read record fields, so use "." as format buffer. */
+	abd_init(&fb_abd, ABD_FORMAT, (char *) ".", 1, 1);
+	/* Search criteria specified in search and value buffers. */
+	abd_init(&sb_abd, ABD_SEARCH, search_buf, search_buf_len,
+		search_buf_len);
+	abd_init(&vb_abd, ABD_VALUE, value_buf, value_buf_len, value_buf_len);
+	/* Use small ISN buffer to get next portion of ISNs. */
+	abd_init(&ib_abd, ABD_ISN, isn_buf, sizeof(isn_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &sb_abd;
+	abds[2] = &vb_abd;
+	abds[3] = &ib_abd;
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	/*
+	 * Search records multiple times (don't want to slow down Adabas by
+	 * using 'SAVE LIST' option) and modify every portion of found records.
+	 */
+	rec_no = 0;
+	while (1) {
+		/* Size of ISN buffer defines number of returned ISNs. */
+		isn_count = tune_fetch_size(ISN_BUF_LEN, ISN_BUF_MAX);
+		ib_abd.abdsize = isn_count * ISN_LEN;
+
+		/* Execute Adabas direct call command S1. */
+		if (adabas_call(&acbx, 4, abds) != ADA_NORMAL) {
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_S1;
+		}
+		tune_fetch(adabas_call_usec());
+
+		/* Print number of found records. */
+		if (rec_no == 0 && options.verbose_level > 0) {
+			fprintf(stderr, "Found records: %llu\n",
+				(unsigned long long) acbx.acbxisq);
+		}
+
+		/* Get ISN of records from ISN buffer and modify each record. */
+		for (isn_no = 0; isn_no < acbx.acbxisq
+			&& isn_no < isn_count; isn_no++)
+		{
+			/* Pause or stop processing on request. */
+			result_code = check_control();
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+
+			/* Increase records counter. */
+			rec_no++;
+
+			/* Modify record by ISN. */
+			if (options.delete_mode) {
+				result_code = delete_record(isn_buf[isn_no]);
+			} else {
+				result_code = modify_record(isn_buf[isn_no]);
+			}
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+
+			/* Print process status. */
+			print_progress(rec_no, &prev_time);
+		}
+
+		/*
+		 * Exit loop if last command S1 returned less ISNs than
+		 * fit in ISN buffer.
+		 */
+		if (acbx.acbxisq < isn_count) {
+			break;
+		}
+	}
+
+	/* Print used time. */
+	print_summary(rec_no, start_time);
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Combine results of multiple search arguments in memory
+ * and modify selected records.
+ */
+int select_records(void)
+{
+	int result_code;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no = 0;
+	AdamodIsn isn;
+	struct IsnSet set;
+	struct IsnSetIterator iterator;
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	result_code = select_isn_set(&set);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/*
+	 * In physical order selected records are picked from scan
+	 * of Data Storage, so consecutive updates hit the same blocks.
+	 */
+	if (options.physical_order) {
+		result_code = scan_file(&set);
+		isn_set_free(&set);
+		return result_code;
+	}
+
+	/* Modify selected records in ascending order of ISNs. */
+	isn_set_iterate(&iterator);
+	while (isn_set_next(&set, &iterator, &isn)) {
+		/* Pause or stop processing on request. */
+		result_code = check_control();
+		if (result_code != ADAMOD_SUCCESS) {
+			break;
+		}
+
+		/* Increase records counter. */
+		rec_no++;
+
+		/* Modify record by ISN. */
+		if (options.delete_mode) {
+			result_code = delete_record(isn);
+		} else {
+			result_code = modify_record(isn);
+		}
+		if (result_code != ADAMOD_SUCCESS) {
+			break;
+		}
+
+		/* Print process status. */
+		print_progress(rec_no, &prev_time);
+	}
+	isn_set_free(&set);
+
+	/* Print used time. */
+	if (result_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
+	return result_code;
+}
+
+/*
+ * Read records in logical sequence of descriptor from start value
+ * to end value and modify every record as it arrives.
+ */
+int range_records(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no = 0;
+	ACBX acbx;
+	ABD fb_abd, rb_abd, sb_abd, vb_abd, mb_abd;
+	ABD *abds[5];
+	struct FormatField fields[MODIFY_FIELDS_MAX];
+	int field_count, field_no;
+	unsigned char *record_buf;
+	unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+	uint32_t entry_count, entry_no, record_pos = 0;
+	uint32_t value_len, end_len;
+	int done = 0;
+	struct FieldTable table;
+	const struct FieldDef *descriptor;
+
+	/*
+	 * Get descriptor and start value from command line argument
+	 * (split argument by delimiter '.'). Descriptor specification
+	 * is used both as search and format buffer, so every record
+	 * is returned with its descriptor value.
+	 */
+	char *search_buf = (char *) options.range_arg;
+	char *value_buf = strchr(options.range_arg, '.') + 1;
+	uint32_t search_buf_len = value_buf - search_buf;
+	const char *end_value = options.range_end_arg;
+
+	value_len = strlen(value_buf);
+	if (format_record_length(search_buf, search_buf_len)
+		!= (int) value_len || value_len == 0)
+	{
+		return ADAMOD_E_INVRANGE;
+	}
+	end_len = end_value != NULL ? strlen(end_value) : 0;
+	if (end_len > value_len) {
+		return ADAMOD_E_INVRANGE;
+	}
+
+	/*
+	 * Only elementary fields are read by value range. Super-, sub-
+	 * and phonetic descriptors are not defined as fields, and values
+	 * of their ranges are not compared with values of fields.
+	 */
+	result_code = fdt_load(&table);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+	descriptor = fdt_find(&table, search_buf);
+	result_code = descriptor != NULL && descriptor->format != ' '
+		? ADAMOD_SUCCESS : ADAMOD_E_INVRANGE;
+	fdt_free(&table);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/*
+	 * Records whose descriptor is modified would move within
+	 * descriptor sequence and could be read again.
+	 */
+	if (!options.delete_mode) {
+		field_count = format_parse(modify_format_buf,
+			(int) modify_format_len, fields, MODIFY_FIELDS_MAX);
+		for (field_no = 0; field_no < field_count; field_no++) {
+			if (strncmp(fields[field_no].name, search_buf, 2) == 0) {
+				return ADAMOD_E_INVRANGE;
+			}
+		}
+	}
+
+	record_buf = malloc(MULTIFETCH_MAX * value_len);
+	if (record_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L3 (Read Logical Sequence): read records in sequence
+	 * of descriptor values starting with value in value buffer.
+	 */
+	acbx_init(&acbx, "L3", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOD", 4);
+	/* Command option 2 'V': start with specified value. */
+	acbx.acbxcop[1] = 'V';
+	abd_init(&fb_abd, ABD_FORMAT, search_buf, search_buf_len,
+		search_buf_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, MULTIFETCH_MAX * value_len, 0);
+	abd_init(&sb_abd, ABD_SEARCH, search_buf, search_buf_len,
+		search_buf_len);
+	abd_init(&vb_abd, ABD_VALUE, value_buf, value_len, value_len);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &sb_abd;
+	abds[3] = &vb_abd;
+	abds[4] = &mb_abd;
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	while (!done && result_code == ADAMOD_SUCCESS) {
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxisl = tune_fetch_size(MULTIFETCH_MAX, MULTIFETCH_MAX);
+
+		/* Execute Adabas direct call command L3. */
+		if (adabas_call(&acbx, 5, abds) != ADA_NORMAL) {
+			/* Exit loop when all records readed. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				break;
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			result_code = ADAMOD_E_ADABAS_L3;
+			break;
+		}
+
+		tune_fetch(adabas_call_usec());
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count > MULTIFETCH_MAX) {
+			result_code = ADAMOD_E_INVRECORD;
+			break;
+		}
+
+		record_pos = 0;
+		for (entry_no = 0; entry_no < entry_count && !done
+			&& result_code == ADAMOD_SUCCESS; entry_no++)
+		{
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response == ADA_EOF) {
+				done = 1;
+				break;
+			}
+			if (entry.response != ADA_NORMAL) {
+				continue;
+			}
+			if (entry.record_len != value_len
+				|| record_pos + value_len > MULTIFETCH_MAX * value_len)
+			{
+				result_code = ADAMOD_E_INVRECORD;
+				break;
+			}
+
+			/* Stop after last record with value up to end value. */
+			if (end_len > 0 && memcmp(record_buf + record_pos,
+				end_value, end_len) > 0)
+			{
+				done = 1;
+				break;
+			}
+
+			/* Pause or stop processing on request. */
+			result_code = check_control();
+			if (result_code != ADAMOD_SUCCESS) {
+				break;
+			}
+			record_pos += value_len;
+
+			/* Increase records counter. */
+			rec_no++;
+
+			/* Modify record by ISN. */
+			if (options.delete_mode) {
+				result_code = delete_record(entry.isn);
+			} else {
+				result_code = modify_record(entry.isn);
+			}
+
+			/* Print process status. */
+			print_progress(rec_no, &prev_time);
+		}
+	}
+
+	/* Value of failed record may be used to resume processing. */
+	if (result_code != ADAMOD_SUCCESS && record_pos >= value_len
+		&& options.verbose_level > 0)
+	{
+		fputs("\rProcessing stopped at value: ", stderr);
+		fwrite(record_buf + record_pos - value_len, value_len, 1, stderr);
+		fputc('\n', stderr);
+	}
+	free(record_buf);
+
+	/* Print used time. */
+	if (result_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
+	return result_code;
+}
+
+/*
+ * Scan and modify all records in specified Adabas file. When selection
+ * is specified, only records with ISNs in selection are modified, so
+ * they are processed in sequence they are stored in Data Storage.
+ */
+int scan_file(const struct IsnSet *selection)
+{
+	int result_code = ADAMOD_SUCCESS;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no;
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+	char record_buf[1];
+	unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+	uint32_t entry_count, entry_no;
+
+	/* Prepare Adabas direct call control block.
+	 * Command L2 (Read Physical Sequence): read a record from a set of
+	 * records which are stored in physical sequence in Data Storage.
+	 */
+	/* Specify database identifier and file number. */
+	acbx_init(&acbx, "L2", options.db_id, options.file_no);
+	/* Same command identifier will be used for all subsequent commands. */
+	memcpy(acbx.acbxcid, "AMOD", 4);
+	/* We don't need to read record fields, so use "." as format buffer. */
+	abd_init(&fb_abd, ABD_FORMAT, (char *) ".", 1, 1);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, sizeof(record_buf), 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	/*
+	 * Fetch ISNs of all records from file in physical sequence
+	 * (with multi-fetch) and modify every record.
+	 */
+	for (rec_no = 0; result_code == ADAMOD_SUCCESS;) {
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxisl = tune_fetch_size(MULTIFETCH_MAX, MULTIFETCH_MAX);
+
+		/* Execute Adabas direct call command L2. */
+		if (adabas_call(&acbx, 3, abds) != ADA_NORMAL) {
+			/* Exit loop when all records readed. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				break;
+			}
+
+			/* Print error message when command failed. */
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+
+			return ADAMOD_E_ADABAS_L2;
+		}
+
+		tune_fetch(adabas_call_usec());
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count > MULTIFETCH_MAX) {
+			return ADAMOD_E_INVRECORD;
+		}
+
+		for (entry_no = 0; entry_no < entry_count; entry_no++) {
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response != ADA_NORMAL || (selection != NULL
+				&& !isn_set_contains(selection, entry.isn)))
+			{
+				continue;
+			}
+
+			/* Pause or stop processing on request. */
+			result_code = check_control();
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+
+			/* Increase records counter. */
+			rec_no++;
+
+			/* Modify record by ISN. */
+			if (options.delete_mode) {
+				result_code = delete_record(entry.isn);
+			} else {
+				result_code = modify_record(entry.isn);
+			}
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+
+			/* Print process status. */
+			print_progress(rec_no, &prev_time);
+		}
+	}
+
+	/* Print used time. */
+	print_summary(rec_no, start_time);
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Commit records modified so far and continue reading of records
+ * in physical sequence after record with specified ISN: sequence
+ * of command ID is released, so next command starts new one.
+ */
+int reread_records(ACBX *acbx, AdamodIsn isn)
+{
+	int result_code;
+	ACBX rc_acbx;
+	uint64_t start_usec = timer_usec();
+
+	tune_overload();
+	result_code = end_transaction();
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command RC (Release Command ID): release sequence of
+	 * command ID.
+	 */
+	acbx_init(&rc_acbx, "RC", options.db_id, options.file_no);
+	memcpy(rc_acbx.acbxcid, acbx->acbxcid, 4);
+
+	/* Execute Adabas direct call command RC. */
+	if (adabas_call(&rc_acbx, 0, NULL) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&rc_acbx);
+		}
+		return ADAMOD_E_ADABAS_L2;
+	}
+	trace_span("hold queue retry", "retry", start_usec, timer_usec());
+
+	/* New sequence begins with record following specified ISN. */
+	acbx->acbxisn = isn;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Read all records of file in physical sequence with hold (with
+ * multi-fetch) and modify them with transformation. Prefetched records
+ * are held until end of transaction, so transaction is ended only
+ * after all records of multi-fetch buffer are processed. When hold
+ * queue is full, the rest of batch is read again in smaller batches.
+ */
+int transform_file(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no;
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+	unsigned char *record_buf;
+	unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+	uint32_t entry_count, entry_no, record_pos;
+	uint32_t fetch_max = MULTIFETCH_MAX;
+	AdamodIsn prev_isn = 0;
+	const char *format_buf = transform_read_format();
+
+	record_buf = malloc(MULTIFETCH_MAX * transform_buf_len);
+	if (record_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L5 (Read Physical Sequence with hold): read records
+	 * in physical sequence and put them in hold status.
+	 * Command L2 (Read Physical Sequence): read records without hold.
+	 */
+	acbx_init(&acbx, options.exclusive_mode || options.dry_mode
+		? "L2" : "L5", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOD", 4);
+	abd_init(&fb_abd, ABD_FORMAT, (char *) format_buf,
+		strlen(format_buf), strlen(format_buf));
+	abd_init(&rb_abd, ABD_RECORD, record_buf,
+		MULTIFETCH_MAX * transform_buf_len, 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+	batch_held = !options.exclusive_mode && !options.dry_mode;
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	for (rec_no = 0; result_code == ADAMOD_SUCCESS;) {
+		/*
+		 * Pause or stop processing on request (pause ends
+		 * transaction, so it's checked between multi-fetches).
+		 */
+		result_code = check_control();
+		if (result_code != ADAMOD_SUCCESS) {
+			break;
+		}
+
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxisl = tune_fetch_size(fetch_max, fetch_max);
+
+		/* Execute Adabas direct call command L5. */
+		if (hold_call(&acbx, 3, abds) != ADA_NORMAL) {
+			/* Exit loop when all records readed. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				break;
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			result_code = ADAMOD_E_ADABAS_L2;
+			break;
+		}
+
+		tune_fetch(adabas_call_usec());
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count > MULTIFETCH_MAX) {
+			result_code = ADAMOD_E_INVRECORD;
+			break;
+		}
+
+		record_pos = 0;
+		for (entry_no = 0; entry_no < entry_count
+			&& result_code == ADAMOD_SUCCESS; entry_no++)
+		{
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response != ADA_NORMAL) {
+				continue;
+			}
+			if (record_pos + entry.record_len
+				> MULTIFETCH_MAX * transform_buf_len)
+			{
+				result_code = ADAMOD_E_INVRECORD;
+				break;
+			}
+			record_pos += entry.record_len;
+
+			/* Skip records listed in exclusion files. */
+			if (isn_excluded(entry.isn)) {
+				continue;
+			}
+
+			/* Increase records counter. */
+			rec_no++;
+
+			/* Modify record with values read by multi-fetch. */
+			result_code = transform_values(entry.isn,
+				record_buf + record_pos - entry.record_len,
+				entry.record_len);
+			if (result_code == ADAMOD_M_HOLD_QUEUE) {
+				rec_no--;
+				break;
+			}
+			prev_isn = entry.isn;
+
+			/* Print process status. */
+			print_progress(rec_no, &prev_time);
+		}
+
+		/*
+		 * Hold queue is full: records modified so far are committed,
+		 * which releases holds of the rest of batch, so they are read
+		 * again in smaller batches.
+		 */
+		if (result_code == ADAMOD_M_HOLD_QUEUE) {
+			result_code = transaction_records > 0
+				? reread_records(&acbx, prev_isn) : ADAMOD_E_ADABAS_A1;
+			fetch_max = entry_no > 1 ? entry_no : 1;
+			continue;
+		}
+
+		/* Holds of prefetched records are released together. */
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = check_commit();
+		}
+
+		/* Batches grow back after commit. */
+		if (transaction_records == 0 && fetch_max < MULTIFETCH_MAX) {
+			fetch_max = fetch_max * 2 < MULTIFETCH_MAX
+				? fetch_max * 2 : MULTIFETCH_MAX;
+		}
+	}
+	batch_held = 0;
+	free(record_buf);
+
+	/* Print used time. */
+	if (result_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
+	return result_code;
+}
+
+/*
+ * Delete all records from Adabas file at once by refresh of file
+ * (requires exclusive control of file).
+ */
+int purge_file(void)
+{
+	ACBX acbx;
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command E1 (Delete Record) with ISN 0: refresh file.
+	 */
+	acbx_init(&acbx, "E1", options.db_id, options.file_no);
+	acbx.acbxisn = 0;
+
+	/* Execute Adabas direct call command E1. */
+	if (adabas_call(&acbx, 0, NULL) != ADA_NORMAL) {
+		if (options.verbose_level > 0) {
+			dump_adabas_cb(&acbx);
+		}
+		return ADAMOD_E_ADABAS_E1;
+	}
+
+	if (options.verbose_level > 0) {
+		fprintf(stderr, "File %d refreshed\n", options.file_no);
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Modify or delete record of leased ISN range.
+ */
+int chunk_record(struct ShardLease *lease, AdamodIsn isn, AdamodIsn *rec_no,
+	time_t *prev_time)
+{
+	int result_code;
+
+	/* Pause or stop processing on request. */
+	result_code = check_control();
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/* Lease is renewed, so other processes don't take chunk over. */
+	result_code = shard_renew(lease);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/* Increase records counter. */
+	(*rec_no)++;
+
+	/* Modify record by ISN. */
+	if (options.delete_mode) {
+		result_code = delete_record(isn);
+	} else {
+		result_code = modify_record(isn);
+	}
+
+	/* Print process status. */
+	print_progress(*rec_no, prev_time);
+
+	return result_code;
+}
+
+/*
+ * Read records of leased ISN range in sequence of ISNs and modify
+ * them. Flag last is set when no records follow the range.
+ */
+int read_chunk(struct ShardLease *lease, AdamodIsn *rec_no,
+	time_t *prev_time, int *last)
+{
+	int result_code;
+	AdamodIsn isn = lease->first_isn;
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+	char record_buf[1];
+	unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+	uint32_t entry_count, entry_no, fetch_size;
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L1 (Read Record) with option 'I': read record with
+	 * specified ISN or with the next higher one.
+	 */
+	acbx_init(&acbx, "L1", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOD", 4);
+	/* We don't need to read record fields, so use "." as format buffer. */
+	abd_init(&fb_abd, ABD_FORMAT, (char *) ".", 1, 1);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, sizeof(record_buf), 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	*last = 0;
+	while (isn <= lease->last_isn) {
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxcop[1] = 'I';
+		acbx.acbxisn = isn;
+		/* Range can't contain more records than ISNs left in it. */
+		fetch_size = tune_fetch_size(MULTIFETCH_MAX, MULTIFETCH_MAX);
+		if (fetch_size > lease->last_isn - isn + 1) {
+			fetch_size = (uint32_t) (lease->last_isn - isn + 1);
+		}
+		acbx.acbxisl = fetch_size;
+
+		/* Execute Adabas direct call command L1. */
+		if (adabas_call(&acbx, 3, abds) != ADA_NORMAL) {
+			/* There are no records after read ones. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				*last = 1;
+				break;
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_L1;
+		}
+
+		tune_fetch(adabas_call_usec());
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count == 0 || entry_count > MULTIFETCH_MAX) {
+			return ADAMOD_E_INVRECORD;
+		}
+
+		for (entry_no = 0; entry_no < entry_count; entry_no++) {
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response == ADA_EOF) {
+				*last = 1;
+				return ADAMOD_SUCCESS;
+			}
+			if (entry.response != ADA_NORMAL) {
+				continue;
+			}
+			if (entry.isn > lease->last_isn) {
+				return ADAMOD_SUCCESS;
+			}
+			isn = entry.isn + 1;
+
+			result_code = chunk_record(lease, entry.isn, rec_no,
+				prev_time);
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Modify selected records of leased ISN range. Flag last is set
+ * when no selected records follow the range.
+ */
+int select_chunk(struct ShardLease *lease, const struct IsnSet *selection,
+	AdamodIsn *rec_no, time_t *prev_time, int *last)
+{
+	int result_code;
+	AdamodIsn isn;
+	struct IsnSetIterator iterator;
+
+	*last = 1;
+	isn_set_seek(selection, &iterator, lease->first_isn);
+	while (isn_set_next(selection, &iterator, &isn)) {
+		if (isn > lease->last_isn) {
+			*last = 0;
+			break;
+		}
+
+		result_code = chunk_record(lease, isn, rec_no, prev_time);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Process records of job shared with other processes by leases of
+ * ISN ranges in shard directory. Chunk is marked done only after
+ * its modifications are committed.
+ */
+int shard_records(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no = 0;
+	struct IsnSet set;
+	struct ShardLease lease;
+	ShardClaim claim;
+	int owner_flag, last, waiting = 0;
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	/* Processes work on snapshot of selection made by one of them. */
+	shard_open();
+	isn_set_init(&set);
+	if (options.search_count > 0) {
+		result_code = shard_selection(&set, &owner_flag);
+		if (result_code == ADAMOD_SUCCESS && owner_flag) {
+			result_code = select_isn_set(&set);
+			if (result_code == ADAMOD_SUCCESS) {
+				result_code = shard_save_selection(&set);
+			}
+		}
+	}
+
+	while (result_code == ADAMOD_SUCCESS) {
+		result_code = shard_claim(&lease, &claim);
+		if (result_code != ADAMOD_SUCCESS || claim == SHARD_DONE) {
+			break;
+		}
+
+		/*
+		 * Remaining chunks are leased by other processes - wait
+		 * until they are done or their leases expire.
+		 */
+		if (claim == SHARD_BUSY) {
+			if (!waiting && options.verbose_level > 0) {
+				fputs("\rWaiting for chunks leased by other processes\n",
+					stderr);
+			}
+			waiting = 1;
+			result_code = check_control();
+			if (result_code == ADAMOD_SUCCESS) {
+				timer_sleep(SHARD_POLL_USEC);
+			}
+			continue;
+		}
+		waiting = 0;
+
+		if (options.search_count > 0) {
+			result_code = select_chunk(&lease, &set, &rec_no,
+				&prev_time, &last);
+		} else {
+			result_code = read_chunk(&lease, &rec_no, &prev_time,
+				&last);
+		}
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = end_transaction();
+		}
+
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = shard_complete(&lease, last);
+		} else if (result_code == ADAMOD_E_SHARD_LOST) {
+			/*
+			 * Chunk is finished by process which took it over, so
+			 * its records modified in current transaction are left
+			 * to that process.
+			 */
+			if (options.verbose_level > 0) {
+				fprintf(stderr, "\rLease of chunk %lu lost\n",
+					(unsigned long) lease.chunk_no);
+			}
+			result_code = backout_transaction();
+		} else {
+			/* Unfinished chunk may be taken by others at once. */
+			shard_release(&lease);
+		}
+	}
+	isn_set_free(&set);
+
+	/* Print used time. */
+	if (result_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
+	return result_code;
+}
+
+/*
+ * Create journal for before-images of modified or deleted records.
+ */
+int create_journal(void)
+{
+	struct JournalHeader header;
+	int record_len;
+
+	header.db_id = options.db_id;
+	header.file_no = options.file_no;
+	if (options.delete_mode) {
+		/* Deleted records are saved with fields of journal format. */
+		header.kind = JOURNAL_DELETE;
+		header.format_buf = (char *) options.journal_format_arg;
+		header.format_buf_len = strlen(options.journal_format_arg);
+
+		/*
+		 * Received length of every image is returned by Adabas,
+		 * so fields of unknown length are read into large buffer.
+		 */
+		record_len = format_record_length(header.format_buf,
+			header.format_buf_len);
+		image_buf_len = record_len > 0 ? record_len : IMAGE_MAX_LEN;
+	} else if (transform_enabled()) {
+		/*
+		 * Before-images of transformed records are taken from
+		 * records read by transformation.
+		 */
+		header.kind = JOURNAL_MODIFY;
+		header.format_buf = (char *) transform_write_format();
+		header.format_buf_len = strlen(header.format_buf);
+		return journal_create(options.journal_file_name, &header);
+	} else {
+		/* Modified records are saved with fields being modified. */
+		header.kind = JOURNAL_MODIFY;
+		header.format_buf = (char *) options.modify_arg;
+		header.format_buf_len = strchr(options.modify_arg, '.') + 1
+			- options.modify_arg;
+		image_buf_len = strlen(options.modify_arg)
+			- header.format_buf_len;
+	}
+
+	image_buf = malloc(image_buf_len);
+	if (image_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	return journal_create(options.journal_file_name, &header);
+}
+
+/*
+ * Process records selected by command line arguments.
+ */
+int process_records(void)
+{
+	int return_code;
+
+	if (options.update_file_name != NULL) {
+		/*
+		 * When update file specified - modify records with values
+		 * read from this file.
+		 */
+		return_code = update_file_records();
+	} else if (options.shard_dir_name != NULL) {
+		/*
+		 * When shard directory specified - process ranges of ISNs
+		 * leased from job shared with other processes.
+		 */
+		return_code = shard_records();
+	} else if (options.isn > 0) {
+		/* When ISN specified, modify/delete just one record by ISN. */
+		if (options.delete_mode) {
 			return_code = delete_record(options.isn);
 		} else {
 			return_code = modify_record(options.isn);
 		}
-	} else if (options.search_arg != NULL) {
+	} else if (options.range_arg != NULL) {
+		/*
+		 * When descriptor range specified - read and modify records
+		 * in sequence of descriptor values.
+		 */
+		return_code = range_records();
+	} else if (options.search_count == 1
+		&& options.cache_dir_name == NULL && !options.physical_order
+		&& !options.search_args[0].isn_log)
+	{
 		/*
 		 * When search argument specified -
 		 * search and modify records according to this argument.
 		 */
 		return_code = search_records();
+	} else if (options.search_count > 0) {
+		/*
+		 * When multiple, cached or physically ordered searches
+		 * specified -
+		 * combine found ISNs and modify selected records.
+		 */
+		return_code = select_records();
+	} else if (options.purge_mode && !options.dry_mode) {
+		/* When purge requested - delete all records by refresh. */
+		return_code = purge_file();
 	} else {
+		/*
+		 * When deletion of all records not journalled - point out
+		 * that refresh of file deletes them much faster.
+		 */
+		if (options.delete_mode && !options.purge_mode
+			&& options.exclude_count == 0
+			&& options.journal_file_name == NULL
+			&& options.verbose_level > 0)
+		{
+			fprintf(stderr, "All records of file will be deleted, "
+				"option --purge deletes them at once\n");
+		}
+
 		/*
 		 * When neither ISN nor search argument specified -
 		 * scan and modify all records in file.
 		 */
-		return_code = scan_file();
+		if (transform_enabled()) {
+			return_code = transform_file();
+		} else {
+			return_code = scan_file(NULL);
+		}
+
+		/* In dry run of purge report number of deleted records. */
+		if (return_code == ADAMOD_SUCCESS && options.purge_mode) {
+			fprintf(stderr, "Records to be deleted by refresh "
+				"of file: %llu\n",
+				(unsigned long long) processed_records);
+		}
+	}
+
+	return return_code;
+}
+
+/*
+ * Search records in specified Adabas file and modify found records.
+ */
+int modify_file_records(void)
+{
+	int return_code;
+	char db_options[30];
+	time_t start_time;
+	int resume_count;
+	AdamodIsn committed_count;
+
+	/* Get process start time. */
+	time(&start_time);
+
+	/* Create journal of before-images (not needed in dry run mode). */
+	if (options.journal_file_name != NULL && !options.dry_mode) {
+		return_code = create_journal();
+		if (return_code != ADAMOD_SUCCESS) {
+			journal_close();
+			free(image_buf);
+			return return_code;
+		}
+	} else {
+		options.journal_file_name = NULL;
+	}
+
+	/*
+	 * Open Adabas database. Under exclusive control file can't be
+	 * used by other users, so records are modified without holds.
+	 */
+	sprintf(db_options, "%s=%d.", options.exclusive_mode ? "EXU" : "UPD",
+		options.file_no);
+	return_code = db_open(options.db_id, db_options);
+	if (return_code != ADA_NORMAL) {
+		journal_close();
+		free(image_buf);
+		return return_code == ADA_FILE_LOCKED && options.exclusive_mode
+			? ADAMOD_E_EXCLUSIVE : ADAMOD_E_ADABAS_OP;
+	}
+
+	/* Modification is checked before any record is touched. */
+	if (options.modify_arg != NULL || transform_enabled()) {
+		return_code = transform_enabled()
+			? prepare_transformation() : prepare_modification();
+		if (return_code != ADAMOD_SUCCESS) {
+			free(transform_buf);
+			db_close(options.db_id);
+			journal_close();
+			free(image_buf);
+			return return_code;
+		}
+	}
+
+	/* Processing may be paused and stopped by signals. */
+	control_init();
+
+	/*
+	 * Lost session is reopened and records are processed again,
+	 * skipping records of committed transactions. Records of update
+	 * file are read only once, so update mode is not resumed.
+	 */
+	resume_mode = options.reconnect_time > 0 && !options.dry_mode
+		&& !options.exclusive_mode && options.update_file_name == NULL;
+	isn_set_init(&committed_set);
+	for (resume_count = 0; ; resume_count++) {
+		committed_count = isn_set_count(&committed_set);
+		return_code = process_records();
+		if (return_code == ADAMOD_SUCCESS) {
+			return_code = end_transaction();
+		}
+		if (return_code == ADAMOD_SUCCESS
+			|| return_code == ADAMOD_M_STOPPED || !resume_mode
+			|| !session_lost())
+		{
+			break;
+		}
+
+		/* Session which doesn't let records be committed is given up. */
+		if (isn_set_count(&committed_set) > committed_count) {
+			resume_count = 0;
+		}
+		if (resume_count >= RESUME_MAX) {
+			break;
+		}
+
+		/*
+		 * Adabas has backed out transaction of lost session, so its
+		 * modifications are repeated.
+		 */
+		if (backout_transaction() != ADAMOD_SUCCESS
+			|| session_reopen(options.db_id) != ADA_NORMAL)
+		{
+			break;
+		}
+		fprintf(stderr, "\rAdabas session lost, processing resumed "
+			"after %llu committed records\n",
+			(unsigned long long) isn_set_count(&committed_set));
+		transaction_isn_count = 0;
+		processed_records = committed_records;
+		last_isn = committed_isn;
+	}
+	resume_mode = 0;
+	free(transaction_isns);
+	transaction_isns = NULL;
+	transaction_isns_size = 0;
+	transaction_isn_count = 0;
+	isn_set_free(&committed_set);
+
+	/* Commit records modified in last transaction. */
+	if (return_code == ADAMOD_SUCCESS) {
+		return_code = end_transaction();
+	} else if (return_code == ADAMOD_M_STOPPED) {
+		/*
+		 * On stop request records processed so far are committed
+		 * and last of them is reported to resume processing.
+		 */
+		if (end_transaction() != ADAMOD_SUCCESS) {
+			return_code = ADAMOD_E_ADABAS_ET;
+		} else {
+			fprintf(stderr, "\rProcessing stopped after ISN: %llu\n",
+				(unsigned long long) last_isn);
+			print_summary(processed_records, start_time);
+		}
+	} else {
+		/*
+		 * Closing of session would commit records modified in last
+		 * transaction, so it is backed out.
+		 */
+		backout_transaction();
+	}
+
+	/* Close Adabas database. */
+	if (db_close(options.db_id) != ADA_NORMAL) {
+		return_code = ADAMOD_E_ADABAS_CL;
+	}
+
+	/* Close journal. */
+	if (journal_close() != ADAMOD_SUCCESS
+		&& return_code == ADAMOD_SUCCESS)
+	{
+		return_code = ADAMOD_E_JOURNAL_IO;
+	}
+	free(image_buf);
+	free(transform_buf);
+
+	return return_code;
+}
+
+/*
+ * Undo modifications of records saved in journal: restore
+ * before-images of modified records and store deleted records
+ * with their original ISNs. Entries are replayed in reverse order.
+ */
+int undo_file_records(void)
+{
+	int return_code;
+	char db_options[30];
+	struct JournalHeader header;
+	AdamodIsn entry_no;
+	AdamodIsn isn;
+	uint32_t record_buf_len;
+	char *record_buf;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no = 0;
+
+	/* Open journal and read its header. */
+	header.format_buf = NULL;
+	return_code = journal_open(options.undo_file_name, &header);
+	if (return_code != ADAMOD_SUCCESS) {
+		journal_close();
+		free(header.format_buf);
+		return return_code;
+	}
+
+	/* Target of journal replay is database and file of journal. */
+	options.db_id = header.db_id;
+	options.file_no = header.file_no;
+
+	record_buf = malloc(header.max_image_len + 1);
+	if (record_buf == NULL) {
+		journal_close();
+		free(header.format_buf);
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	/*
+	 * Records after last commit marker may belong to transaction
+	 * committed before marker was written, so they are reported and
+	 * replayed only on request.
+	 */
+	if (header.unmarked_count > 0) {
+		fprintf(stderr, "Unmarked journal records: %llu%s\n",
+			(unsigned long long) header.unmarked_count,
+			options.undo_unmarked ? "" : " (skipped, see option -J)");
+		if (options.undo_unmarked) {
+			header.entry_count += header.unmarked_count;
+		}
+	}
+
+	if (options.verbose_level > 0) {
+		fprintf(stderr, "Journal records: %llu\n",
+			(unsigned long long) header.entry_count);
+	}
+
+	/* Open Adabas database. */
+	sprintf(db_options, "UPD=%d.", options.file_no);
+	if (db_open(options.db_id, db_options) != ADA_NORMAL) {
+		journal_close();
+		free(header.format_buf);
+		free(record_buf);
+		return ADAMOD_E_ADABAS_OP;
+	}
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	for (entry_no = header.entry_count; entry_no > 0; entry_no--) {
+		return_code = journal_read(entry_no - 1, &isn, record_buf,
+			header.max_image_len, &record_buf_len);
+		if (return_code != ADAMOD_SUCCESS) {
+			break;
+		}
+
+		/* Increase records counter. */
+		rec_no++;
+
+		/* Log ISN of record for high verbose levels. */
+		if (options.verbose_level > 2
+			&& isn_writer_put(&isn_log, isn) != ADAMOD_SUCCESS)
+		{
+			return_code = ADAMOD_E_LOG_IO;
+			break;
+		}
+
+		/* Restore record by ISN. */
+		if (!options.dry_mode) {
+			if (header.kind == JOURNAL_MODIFY) {
+				return_code = update_record(isn,
+					header.format_buf, header.format_buf_len,
+					record_buf, record_buf_len);
+			} else {
+				return_code = store_record(isn,
+					header.format_buf, header.format_buf_len,
+					record_buf, record_buf_len);
+			}
+			if (return_code == ADAMOD_SUCCESS) {
+				return_code = commit_record();
+			}
+			if (return_code != ADAMOD_SUCCESS) {
+				break;
+			}
+		}
+
+		/* Print process status. */
+		print_progress(rec_no, &prev_time);
+	}
+
+	/* Commit records restored in last transaction. */
+	if (return_code == ADAMOD_SUCCESS) {
+		return_code = end_transaction();
+	} else {
+		/*
+		 * Closing of session would commit records restored in last
+		 * transaction, so it is backed out.
+		 */
+		backout_transaction();
 	}
 
 	/* Close Adabas database. */
@@ -488,5 +2261,14 @@ int modify_file_records(void)
 		return_code = ADAMOD_E_ADABAS_CL;
 	}
 
+	journal_close();
+	free(header.format_buf);
+	free(record_buf);
+
+	/* Print used time. */
+	if (return_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
 	return return_code;
 }
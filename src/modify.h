@@ -29,7 +29,26 @@
 #if !defined(MODIFY_H)
 #define MODIFY_H
 
+#include "adacall.h"
+
 /* Search records in specified Adabas file and modify found records. */
 int modify_file_records(void);
+/* Modify fields of record with values of record buffer. */
+int modify_fields(AdamodIsn isn, char *format_buf, uint32_t format_buf_len,
+	char *record_buf, uint32_t record_buf_len);
+/* End current transaction, if any records were modified in it. */
+int end_transaction(void);
+/* Back out current transaction and drop its before-images from journal. */
+int backout_transaction(void);
+/* Set function called before commit to save output of records. */
+void commit_hook(int (*hook)(void));
+/* Count modified record and end transaction when it's complete. */
+int commit_record(void);
+/* Execute command with hold, ending transaction on full hold queue. */
+int hold_call(ACBX *acbx, int abd_count, ABD **abds);
+/* Pause or stop processing on request. */
+int check_control(void);
+/* Undo modifications of records saved in journal. */
+int undo_file_records(void);
 
 #endif /* MODIFY_H */
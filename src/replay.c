@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adamod.h"
+#include "journal.h"
+#include "replay.h"
+#include "timer.h"
+
+/* Signature at the beginning of file of recorded calls. */
+#define RECORD_SIGNATURE "ADAMODR1"
+#define RECORD_SIGNATURE_LEN 8
+/* Size of buffer of file of recorded calls. */
+#define RECORD_FILE_BUF_SIZE (1024 * 1024)
+/* Maximal length of encoded call entry. */
+#define ENTRY_MAX_LEN (16 * 1024 * 1024)
+
+int put_varint(unsigned char *buf, uint64_t value);
+int get_varint(const unsigned char *buf, uint32_t len, uint32_t *pos,
+	uint64_t *value);
+uint32_t encode_delta(unsigned char *buf, const unsigned char *data,
+	const unsigned char *prev, uint32_t len);
+int decode_delta(const unsigned char *buf, uint32_t len, uint32_t *pos,
+	unsigned char *data, uint32_t data_len);
+int ensure_entry(uint64_t len);
+int open_calls_file(const char *file_name, const char *mode);
+uint32_t hash_bytes(uint32_t hash, const void *data, uint32_t len);
+int read_entry(uint32_t *entry_len);
+
+/* File of recorded calls, its buffer and mode. */
+static FILE *calls_file = NULL;
+static char *calls_file_buf = NULL;
+static int replay_mode = 0;
+static double replay_scale = 1.0;
+/* Replayed calls did not match recorded ones. */
+static int replay_failed = 0;
+static AdamodIsn call_count = 0;
+
+/* Control block of previous call (calls are stored as its delta). */
+static ACBX prev_acbx;
+
+/* Buffer of encoded call entry. */
+static unsigned char *entry_buf = NULL;
+static uint32_t entry_size = 0;
+
+/*
+ * Store number as variable-length sequence of 7-bit groups. Returns
+ * number of stored bytes (at most 10).
+ */
+int put_varint(unsigned char *buf, uint64_t value)
+{
+	int len = 0;
+
+	while (value >= 0x80) {
+		buf[len++] = (unsigned char) (value | 0x80);
+		value >>= 7;
+	}
+	buf[len++] = (unsigned char) value;
+
+	return len;
+}
+
+/*
+ * Load number stored by put_varint().
+ */
+int get_varint(const unsigned char *buf, uint32_t len, uint32_t *pos,
+	uint64_t *value)
+{
+	int shift = 0;
+
+	*value = 0;
+	while (*pos < len && shift < 64) {
+		*value |= (uint64_t) (buf[*pos] & 0x7F) << shift;
+		if ((buf[(*pos)++] & 0x80) == 0) {
+			return ADAMOD_SUCCESS;
+		}
+		shift += 7;
+	}
+
+	return ADAMOD_E_INVREPLAY;
+}
+
+/*
+ * Encode data as difference with previous data: bytes are xor-ed with
+ * previous ones and runs of zero bytes (unchanged bytes) are stored
+ * as zero byte followed by length of run. Returns length of encoding.
+ */
+uint32_t encode_delta(unsigned char *buf, const unsigned char *data,
+	const unsigned char *prev, uint32_t len)
+{
+	uint32_t pos = 0, out = 0, run;
+
+	while (pos < len) {
+		if ((data[pos] ^ prev[pos]) != 0) {
+			buf[out++] = data[pos] ^ prev[pos];
+			pos++;
+			continue;
+		}
+		for (run = 0; pos < len && data[pos] == prev[pos]; run++) {
+			pos++;
+		}
+		buf[out++] = 0;
+		out += put_varint(buf + out, run);
+	}
+
+	return out;
+}
+
+/*
+ * Decode data encoded by encode_delta() (data contains previous data
+ * on input).
+ */
+int decode_delta(const unsigned char *buf, uint32_t len, uint32_t *pos,
+	unsigned char *data, uint32_t data_len)
+{
+	uint32_t data_pos = 0;
+	uint64_t run;
+
+	while (data_pos < data_len) {
+		if (*pos >= len) {
+			return ADAMOD_E_INVREPLAY;
+		}
+		if (buf[*pos] != 0) {
+			data[data_pos++] ^= buf[(*pos)++];
+			continue;
+		}
+		(*pos)++;
+		if (get_varint(buf, len, pos, &run) != ADAMOD_SUCCESS
+			|| run > data_len - data_pos)
+		{
+			return ADAMOD_E_INVREPLAY;
+		}
+		data_pos += (uint32_t) run;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Make entry buffer large enough for entry of specified length.
+ */
+int ensure_entry(uint64_t len)
+{
+	unsigned char *buf;
+
+	if (len <= entry_size) {
+		return ADAMOD_SUCCESS;
+	}
+	if (len > ENTRY_MAX_LEN) {
+		return ADAMOD_E_INVREPLAY;
+	}
+
+	buf = realloc(entry_buf, (size_t) len);
+	if (buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	entry_buf = buf;
+	entry_size = (uint32_t) len;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Open file of recorded calls and check its header.
+ */
+int open_calls_file(const char *file_name, const char *mode)
+{
+	unsigned char header[RECORD_SIGNATURE_LEN + 4];
+
+	calls_file = fopen(file_name, mode);
+	if (calls_file == NULL) {
+		return ADAMOD_E_REPLAY_IO;
+	}
+	calls_file_buf = malloc(RECORD_FILE_BUF_SIZE);
+	if (calls_file_buf != NULL) {
+		setvbuf(calls_file, calls_file_buf, _IOFBF,
+			RECORD_FILE_BUF_SIZE);
+	}
+	memset(&prev_acbx, 0, sizeof(ACBX));
+
+	/* Control block is stored as is, so its size must match. */
+	if (mode[0] == 'w') {
+		memcpy(header, RECORD_SIGNATURE, RECORD_SIGNATURE_LEN);
+		put_uint32(header + RECORD_SIGNATURE_LEN, sizeof(ACBX));
+		if (fwrite(header, sizeof(header), 1, calls_file) != 1) {
+			return ADAMOD_E_REPLAY_IO;
+		}
+	} else if (fread(header, sizeof(header), 1, calls_file) != 1
+		|| memcmp(header, RECORD_SIGNATURE, RECORD_SIGNATURE_LEN) != 0
+		|| get_uint32(header + RECORD_SIGNATURE_LEN) != sizeof(ACBX))
+	{
+		return ADAMOD_E_INVREPLAY;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Create file of recorded Adabas calls. Every call is stored with
+ * its duration, changes of control block and received data, so
+ * the run can be replayed without database.
+ */
+int record_open(const char *file_name)
+{
+	return open_calls_file(file_name, "wb");
+}
+
+/*
+ * Open file of recorded Adabas calls for replay. Durations of calls
+ * are reproduced multiplied by specified scale (0 - without delays).
+ */
+int replay_open(const char *file_name, double latency_scale)
+{
+	replay_mode = 1;
+	replay_scale = latency_scale;
+
+	return open_calls_file(file_name, "rb");
+}
+
+/*
+ * Check whether Adabas calls are replayed.
+ */
+int replay_enabled(void)
+{
+	return replay_mode;
+}
+
+/*
+ * Add bytes to 32-bit FNV-1a hash.
+ */
+uint32_t hash_bytes(uint32_t hash, const void *data, uint32_t len)
+{
+	const unsigned char *p = data;
+
+	while (len-- > 0) {
+		hash = ((hash ^ *p++) * 0x01000193UL) & 0xFFFFFFFFUL;
+	}
+
+	return hash;
+}
+
+/*
+ * Get hash of command and data sent to Adabas, used to check that
+ * replayed call is the same as recorded one.
+ */
+uint32_t call_hash(const ACBX *acbx, int abd_count, ABD **abds)
+{
+	unsigned char fields[34];
+	uint32_t hash = 0x811C9DC5UL;
+	int abd_no;
+
+	if (calls_file == NULL) {
+		return 0;
+	}
+
+	/* Command, its options and target. */
+	memcpy(fields, acbx->acbxcmd, 2);
+	memcpy(fields + 2, acbx->acbxcop, 8);
+	memcpy(fields + 10, acbx->acbxcid, 4);
+	put_uint32(fields + 14, acbx->acbxfnr);
+	put_uint64(fields + 18, acbx->acbxisn);
+	put_uint64(fields + 26, acbx->acbxisl);
+	hash = hash_bytes(hash, fields, sizeof(fields));
+
+	/* Buffers with their sizes and sent data. */
+	for (abd_no = 0; abd_no < abd_count; abd_no++) {
+		fields[0] = abds[abd_no]->abdid;
+		put_uint32(fields + 1, (uint32_t) abds[abd_no]->abdsize);
+		hash = hash_bytes(hash, fields, 5);
+		hash = hash_bytes(hash, abds[abd_no]->abdaddr,
+			(uint32_t) abds[abd_no]->abdsend);
+	}
+
+	return hash;
+}
+
+/*
+ * Write completed Adabas call to file of recorded calls: command code,
+ * hash of sent data, duration, changes of control block and data
+ * received in buffers.
+ */
+void record_call(const ACBX *acbx, int abd_count, ABD **abds,
+	uint32_t hash, uint64_t call_usec)
+{
+	uint64_t len = 2 + 4 + 10 + 2 * sizeof(ACBX) + 10;
+	uint32_t pos = 0;
+	uint32_t recv_len;
+	unsigned char prefix[10];
+	int abd_no;
+
+	if (calls_file == NULL || replay_mode || replay_failed) {
+		return;
+	}
+
+	for (abd_no = 0; abd_no < abd_count; abd_no++) {
+		len += 1 + 10 + abds[abd_no]->abdrecv;
+	}
+	if (ensure_entry(len) != ADAMOD_SUCCESS) {
+		replay_failed = 1;
+		return;
+	}
+
+	memcpy(entry_buf, acbx->acbxcmd, 2);
+	put_uint32(entry_buf + 2, hash);
+	pos = 6;
+	pos += put_varint(entry_buf + pos, call_usec);
+	pos += encode_delta(entry_buf + pos, (const unsigned char *) acbx,
+		(const unsigned char *) &prev_acbx, sizeof(ACBX));
+	memcpy(&prev_acbx, acbx, sizeof(ACBX));
+
+	pos += put_varint(entry_buf + pos, abd_count);
+	for (abd_no = 0; abd_no < abd_count; abd_no++) {
+		recv_len = (uint32_t) (abds[abd_no]->abdrecv
+			< abds[abd_no]->abdsize ? abds[abd_no]->abdrecv
+			: abds[abd_no]->abdsize);
+		entry_buf[pos++] = abds[abd_no]->abdid;
+		pos += put_varint(entry_buf + pos, recv_len);
+		memcpy(entry_buf + pos, abds[abd_no]->abdaddr, recv_len);
+		pos += recv_len;
+	}
+
+	/* Entry is prefixed with its length. */
+	if (fwrite(prefix, put_varint(prefix, pos), 1, calls_file) != 1
+		|| fwrite(entry_buf, pos, 1, calls_file) != 1)
+	{
+		replay_failed = 1;
+	}
+	call_count++;
+}
+
+/*
+ * Read next call entry from file of recorded calls.
+ */
+int read_entry(uint32_t *entry_len)
+{
+	uint64_t len = 0;
+	int shift = 0;
+	int c;
+
+	do {
+		c = getc(calls_file);
+		if (c == EOF || shift >= 35) {
+			return ADAMOD_E_INVREPLAY;
+		}
+		len |= (uint64_t) (c & 0x7F) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	if (ensure_entry(len) != ADAMOD_SUCCESS
+		|| fread(entry_buf, (size_t) len, 1, calls_file) != 1)
+	{
+		return ADAMOD_E_INVREPLAY;
+	}
+	*entry_len = (uint32_t) len;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Answer Adabas call with next recorded call. Control block and
+ * received buffers are restored and duration of call is reproduced.
+ * When call does not match recorded one, replay fails and call gets
+ * response code REPLAY_MISMATCH.
+ */
+void replay_call(ACBX *acbx, int abd_count, ABD **abds, uint32_t hash)
+{
+	uint32_t entry_len;
+	uint32_t pos = 6;
+	uint64_t call_usec, count, recv_len;
+	int abd_no;
+
+	if (replay_failed || read_entry(&entry_len) != ADAMOD_SUCCESS
+		|| entry_len < pos
+		|| memcmp(entry_buf, acbx->acbxcmd, 2) != 0
+		|| get_uint32(entry_buf + 2) != hash
+		|| get_varint(entry_buf, entry_len, &pos, &call_usec)
+			!= ADAMOD_SUCCESS
+		|| decode_delta(entry_buf, entry_len, &pos,
+			(unsigned char *) &prev_acbx, sizeof(ACBX))
+			!= ADAMOD_SUCCESS
+		|| get_varint(entry_buf, entry_len, &pos, &count)
+			!= ADAMOD_SUCCESS
+		|| count != (uint64_t) abd_count)
+	{
+		replay_failed = 1;
+		acbx->acbxrsp = REPLAY_MISMATCH;
+		return;
+	}
+
+	for (abd_no = 0; abd_no < abd_count; abd_no++) {
+		if (pos >= entry_len
+			|| entry_buf[pos++] != abds[abd_no]->abdid
+			|| get_varint(entry_buf, entry_len, &pos, &recv_len)
+				!= ADAMOD_SUCCESS
+			|| recv_len > abds[abd_no]->abdsize
+			|| recv_len > entry_len - pos)
+		{
+			replay_failed = 1;
+			acbx->acbxrsp = REPLAY_MISMATCH;
+			return;
+		}
+		memcpy(abds[abd_no]->abdaddr, entry_buf + pos,
+			(size_t) recv_len);
+		abds[abd_no]->abdrecv = recv_len;
+		pos += (uint32_t) recv_len;
+	}
+	memcpy(acbx, &prev_acbx, sizeof(ACBX));
+	call_count++;
+
+	if (replay_scale > 0) {
+		timer_sleep((uint64_t) (call_usec * replay_scale));
+	}
+}
+
+/*
+ * Close file of recorded calls. Replay fails when calls did not
+ * match recorded ones or not all recorded calls were replayed.
+ */
+int replay_close(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+
+	if (calls_file == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	if (replay_mode) {
+		if (replay_failed || getc(calls_file) != EOF) {
+			result_code = ADAMOD_E_REPLAY_MISMATCH;
+		}
+		fclose(calls_file);
+	} else if (fclose(calls_file) != 0 || replay_failed) {
+		result_code = ADAMOD_E_REPLAY_IO;
+	}
+	if (options.verbose_level > 0) {
+		fprintf(stderr, "%s calls: %llu\n",
+			replay_mode ? "Replayed" : "Recorded",
+			(unsigned long long) call_count);
+	}
+
+	calls_file = NULL;
+	free(calls_file_buf);
+	calls_file_buf = NULL;
+	free(entry_buf);
+	entry_buf = NULL;
+	entry_size = 0;
+
+	return result_code;
+}
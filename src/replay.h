@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(REPLAY_H)
+#define REPLAY_H
+
+#include <adabasx.h>
+#include <stdint.h>
+
+/* Response code of replayed call which does not match recorded call. */
+#define REPLAY_MISMATCH 9999
+
+/* Create file of recorded Adabas calls. */
+int record_open(const char *file_name);
+/* Open file of recorded Adabas calls for replay. */
+int replay_open(const char *file_name, double latency_scale);
+/* Check whether Adabas calls are replayed. */
+int replay_enabled(void);
+/* Get hash of command and data sent to Adabas. */
+uint32_t call_hash(const ACBX *acbx, int abd_count, ABD **abds);
+/* Write completed Adabas call to file of recorded calls. */
+void record_call(const ACBX *acbx, int abd_count, ABD **abds,
+	uint32_t hash, uint64_t call_usec);
+/* Answer Adabas call with next recorded call. */
+void replay_call(ACBX *acbx, int abd_count, ABD **abds, uint32_t hash);
+/* Close file of recorded calls. */
+int replay_close(void);
+
+#endif /* REPLAY_H */
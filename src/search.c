@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adacall.h"
+#include "adamod.h"
+#include "cache.h"
+#include "messages.h"
+#include "search.h"
+#include "tune.h"
+
+/* Default and maximal number of ISNs returned by one command S1. */
+#define SEARCH_ISN_BUF_LEN 16384
+#define SEARCH_ISN_BUF_MAX 65536
+
+/* ISNs of records excluded from processing. */
+static struct IsnSet excluded;
+
+/*
+ * Read all ISNs of records found by search argument into ISN set.
+ */
+int search_isn_set(const char *search_arg, const char *cid,
+	struct IsnSet *set)
+{
+	int result_code = ADAMOD_SUCCESS;
+	AdamodIsn isn_no;
+	uint32_t isn_count;
+	ACBX acbx;
+	ABD fb_abd, sb_abd, vb_abd, ib_abd;
+	ABD *abds[4];
+	uint32_t *isn_buf;
+
+	/*
+	 * Get search and value buffers from search argument
+	 * (split argument by delimiter '.').
+	 */
+	char *search_buf = (char *) search_arg;
+	char *value_buf = strchr(search_arg, '.') + 1;
+	uint32_t search_buf_len = value_buf - search_buf;
+	uint32_t value_buf_len = strlen(value_buf);
+
+	/* ISNs are returned by nucleus as 4-byte values. */
+	isn_buf = malloc(SEARCH_ISN_BUF_MAX * sizeof(uint32_t));
+	if (isn_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command S1 (Find Records): select a set of records which
+	 * satisfy given search criteria.
+	 */
+	acbx_init(&acbx, "S1", options.db_id, options.file_no);
+	/* Every search uses its own command identifier. */
+	memcpy(acbx.acbxcid, cid, 4);
+	abd_init(&fb_abd, ABD_FORMAT, (char *) ".", 1, 1);
+	abd_init(&sb_abd, ABD_SEARCH, search_buf, search_buf_len,
+		search_buf_len);
+	abd_init(&vb_abd, ABD_VALUE, value_buf, value_buf_len, value_buf_len);
+	abd_init(&ib_abd, ABD_ISN, isn_buf,
+		SEARCH_ISN_BUF_MAX * sizeof(uint32_t), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &sb_abd;
+	abds[2] = &vb_abd;
+	abds[3] = &ib_abd;
+
+	/* Get all portions of ISNs found by search. */
+	while (result_code == ADAMOD_SUCCESS) {
+		/* Size of ISN buffer defines number of returned ISNs. */
+		isn_count = tune_fetch_size(SEARCH_ISN_BUF_LEN, SEARCH_ISN_BUF_MAX);
+		ib_abd.abdsize = isn_count * ISN_LEN;
+
+		/* Execute Adabas direct call command S1. */
+		if (adabas_call(&acbx, 4, abds) != ADA_NORMAL) {
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			result_code = ADAMOD_E_ADABAS_S1;
+			break;
+		}
+		tune_fetch(adabas_call_usec());
+
+		for (isn_no = 0; isn_no < acbx.acbxisq
+			&& isn_no < isn_count
+			&& result_code == ADAMOD_SUCCESS; isn_no++)
+		{
+			result_code = isn_set_add(set, isn_buf[isn_no]);
+		}
+
+		/* Last portion doesn't fill whole ISN buffer. */
+		if (acbx.acbxisq < isn_count) {
+			break;
+		}
+	}
+	free(isn_buf);
+
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return isn_set_optimize(set);
+}
+
+/*
+ * Combine results of all search arguments into ISN set. Searches are
+ * evaluated in order of command line, each result is combined with
+ * result of previous searches.
+ */
+int select_isn_set(struct IsnSet *set)
+{
+	int result_code = ADAMOD_SUCCESS;
+	int search_no;
+	char cid[16];
+	int cached;
+	struct IsnSet found;
+
+	isn_set_init(set);
+	for (search_no = 0; search_no < options.search_count
+		&& result_code == ADAMOD_SUCCESS; search_no++)
+	{
+		const struct SearchArg *search = options.search_args + search_no;
+
+		/* Intersection with or difference from empty set is empty. */
+		if (search_no > 0 && set->count == 0
+			&& search->operation != ISN_SET_UNION)
+		{
+			continue;
+		}
+
+		/*
+		 * ISNs may be taken from ISN log of previous run, search
+		 * result may be taken from cache of previous runs.
+		 */
+		isn_set_init(&found);
+		cached = search->isn_log;
+		result_code = search->isn_log
+			? isn_set_load(&found, search->arg)
+			: cache_load(search->arg, &found, &cached);
+		if (result_code == ADAMOD_SUCCESS && !cached) {
+			sprintf(cid, "AS%02d", search_no);
+			result_code = search_isn_set(search->arg, cid, &found);
+			if (result_code == ADAMOD_SUCCESS) {
+				result_code = cache_save(search->arg, &found);
+			}
+		}
+		if (result_code == ADAMOD_SUCCESS) {
+			if (options.verbose_level > 1) {
+				fprintf(stderr, "Search %d found records: %llu\n",
+					search_no + 1,
+					(unsigned long long) isn_set_count(&found));
+			}
+			result_code = isn_set_combine(set, &found,
+				search_no > 0 ? search->operation : ISN_SET_UNION);
+		}
+		isn_set_free(&found);
+	}
+
+	if (result_code != ADAMOD_SUCCESS) {
+		isn_set_free(set);
+		return result_code;
+	}
+
+	result_code = isn_set_optimize(set);
+	if (result_code == ADAMOD_SUCCESS && options.verbose_level > 0) {
+		fprintf(stderr, "Found records: %llu (%lu bytes of ISN set)\n",
+			(unsigned long long) isn_set_count(set),
+			(unsigned long) isn_set_memory(set));
+	}
+
+	return result_code;
+}
+
+/*
+ * Load ISNs of exclusion files.
+ */
+int exclude_open(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+	int file_no;
+
+	isn_set_init(&excluded);
+	for (file_no = 0; file_no < options.exclude_count
+		&& result_code == ADAMOD_SUCCESS; file_no++)
+	{
+		result_code = isn_set_load(&excluded,
+			options.exclude_file_names[file_no]);
+	}
+
+	if (result_code == ADAMOD_SUCCESS && options.exclude_count > 0
+		&& options.verbose_level > 1)
+	{
+		fprintf(stderr, "Excluded records: %llu\n",
+			(unsigned long long) isn_set_count(&excluded));
+	}
+
+	return result_code;
+}
+
+/*
+ * Check whether record is excluded from processing.
+ */
+int isn_excluded(AdamodIsn isn)
+{
+	return excluded.count > 0 && isn_set_contains(&excluded, isn);
+}
+
+/*
+ * Free ISNs of exclusion files.
+ */
+void exclude_close(void)
+{
+	isn_set_free(&excluded);
+}
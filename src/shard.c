@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+/* Functions open() and getpid() are declared only for POSIX sources. */
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adamod.h"
+#include "isnset.h"
+#include "shard.h"
+#include "timer.h"
+
+/* Signature at the beginning of selection snapshot file. */
+#define SELECTION_SIGNATURE "ADAMODS1"
+#define SELECTION_SIGNATURE_LEN 8
+/* Interval of checks for selection made by other process. */
+#define SELECTION_POLL_USEC 1000000
+
+/* States of chunks. */
+#define CHUNK_OPEN 0
+#define CHUNK_DONE 1
+#define CHUNK_LAST 2
+
+char *shard_file_name(long chunk_no, const char *suffix);
+int file_age(const char *file_name, time_t *age);
+int lease_create(const char *file_name);
+int lease_owned(const char *file_name);
+int lease_acquire(const char *file_name, ShardClaim *claim);
+int chunk_state(uint32_t chunk_no);
+
+/* Owner identification written to lease files of this process. */
+static char owner[128];
+static unsigned long owner_pid = 0;
+/* Chunks before this one are known to be done. */
+static uint32_t first_open_chunk = 0;
+/* Lease of chunk being processed by this process. */
+static struct ShardLease *held_lease = NULL;
+
+/*
+ * Make name of file in shard directory (chunk number is negative
+ * for files of the whole job).
+ */
+char *shard_file_name(long chunk_no, const char *suffix)
+{
+	char *file_name;
+
+	file_name = malloc(strlen(options.shard_dir_name) + strlen(suffix) + 48);
+	if (file_name == NULL) {
+		return NULL;
+	}
+
+	if (chunk_no < 0) {
+		sprintf(file_name, "%s/adamod-%u-%u.%s", options.shard_dir_name,
+			(unsigned int) options.db_id,
+			(unsigned int) options.file_no, suffix);
+	} else {
+		sprintf(file_name, "%s/adamod-%u-%u-%06lu.%s",
+			options.shard_dir_name, (unsigned int) options.db_id,
+			(unsigned int) options.file_no, (unsigned long) chunk_no,
+			suffix);
+	}
+
+	return file_name;
+}
+
+/*
+ * Get time passed since last modification of file (returns 0 when
+ * file doesn't exist).
+ */
+int file_age(const char *file_name, time_t *age)
+{
+#if defined(_WIN32)
+	struct _stat file_stat;
+
+	if (_stat(file_name, &file_stat) != 0) {
+		return 0;
+	}
+#else
+	struct stat file_stat;
+
+	if (stat(file_name, &file_stat) != 0) {
+		return 0;
+	}
+#endif
+	*age = time(NULL) - file_stat.st_mtime;
+
+	return 1;
+}
+
+/*
+ * Create lease file with owner identification, unless it already
+ * exists (returns 1 - created, 0 - exists, -1 - error).
+ */
+int lease_create(const char *file_name)
+{
+	int fd;
+	int written;
+
+#if defined(_WIN32)
+	fd = _open(file_name, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,
+		_S_IREAD | _S_IWRITE);
+#else
+	fd = open(file_name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+#endif
+	if (fd < 0) {
+		return errno == EEXIST ? 0 : -1;
+	}
+
+#if defined(_WIN32)
+	written = _write(fd, owner, strlen(owner));
+	_close(fd);
+#else
+	written = (int) write(fd, owner, strlen(owner));
+	close(fd);
+#endif
+	if (written != (int) strlen(owner)) {
+		remove(file_name);
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * Check whether lease file is owned by this process.
+ */
+int lease_owned(const char *file_name)
+{
+	FILE *file;
+	char buf[sizeof(owner)];
+	size_t len;
+
+	file = fopen(file_name, "rb");
+	if (file == NULL) {
+		return 0;
+	}
+	len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = '\0';
+
+	return strcmp(buf, owner) == 0;
+}
+
+/*
+ * Acquire lease file. Expired lease is renamed before it is taken
+ * over, so only one of processes noticing expiration takes it.
+ */
+int lease_acquire(const char *file_name, ShardClaim *claim)
+{
+	char *stale_name;
+	time_t age;
+	int attempt, created, expired = 0;
+
+	*claim = SHARD_BUSY;
+	for (attempt = 0; attempt < 3; attempt++) {
+		created = lease_create(file_name);
+		if (created < 0) {
+			return ADAMOD_E_SHARD_IO;
+		}
+		if (created) {
+			if (expired && options.verbose_level > 0) {
+				fprintf(stderr, "\rExpired lease taken over: %s\n",
+					file_name);
+			}
+			*claim = SHARD_CLAIMED;
+			return ADAMOD_SUCCESS;
+		}
+
+		/* Lease released meanwhile is created again. */
+		if (!file_age(file_name, &age)) {
+			continue;
+		}
+		if (age < options.lease_time) {
+			return ADAMOD_SUCCESS;
+		}
+
+		stale_name = malloc(strlen(file_name) + 16);
+		if (stale_name == NULL) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		sprintf(stale_name, "%s.%lu", file_name, owner_pid);
+		if (rename(file_name, stale_name) == 0) {
+			/* Lease renewed just before renaming is put back. */
+			if (file_age(stale_name, &age) && age < options.lease_time) {
+				rename(stale_name, file_name);
+				free(stale_name);
+				return ADAMOD_SUCCESS;
+			}
+			remove(stale_name);
+			expired = 1;
+		}
+		free(stale_name);
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Get state of chunk from its completion file (returns -1 when
+ * memory can't be allocated).
+ */
+int chunk_state(uint32_t chunk_no)
+{
+	FILE *file;
+	char *file_name;
+	int c;
+
+	file_name = shard_file_name((long) chunk_no, "done");
+	if (file_name == NULL) {
+		return -1;
+	}
+	file = fopen(file_name, "rb");
+	free(file_name);
+	if (file == NULL) {
+		return CHUNK_OPEN;
+	}
+	c = fgetc(file);
+	fclose(file);
+
+	return c == 'l' ? CHUNK_LAST : CHUNK_DONE;
+}
+
+/*
+ * Prepare owner identification of leases of this process (host,
+ * process identifier and start time).
+ */
+void shard_open(void)
+{
+	const char *host_name = getenv("HOSTNAME");
+
+	if (host_name == NULL) {
+		host_name = getenv("COMPUTERNAME");
+	}
+	if (host_name == NULL) {
+		host_name = "localhost";
+	}
+
+#if defined(_WIN32)
+	owner_pid = (unsigned long) _getpid();
+#else
+	owner_pid = (unsigned long) getpid();
+#endif
+	sprintf(owner, "%.64s %lu %lu\n", host_name, owner_pid,
+		(unsigned long) time(NULL));
+	first_open_chunk = 0;
+}
+
+/*
+ * Claim next unprocessed chunk. Chunks are checked from the first
+ * one, so chunks of dead processes are taken over when their leases
+ * expire. When remaining chunks are leased by other processes,
+ * claim is busy; when all chunks are done, claim is done.
+ */
+int shard_claim(struct ShardLease *lease, ShardClaim *claim)
+{
+	uint32_t chunk_no;
+	char *file_name;
+	int state, result_code, busy = 0;
+
+	held_lease = NULL;
+	for (chunk_no = first_open_chunk;; chunk_no++) {
+		state = chunk_state(chunk_no);
+		if (state < 0) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		if (state == CHUNK_LAST) {
+			break;
+		}
+		if (state == CHUNK_DONE) {
+			if (chunk_no == first_open_chunk) {
+				first_open_chunk++;
+			}
+			continue;
+		}
+
+		file_name = shard_file_name((long) chunk_no, "lease");
+		if (file_name == NULL) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		result_code = lease_acquire(file_name, claim);
+		if (result_code != ADAMOD_SUCCESS) {
+			free(file_name);
+			return result_code;
+		}
+		if (*claim == SHARD_BUSY) {
+			free(file_name);
+			busy = 1;
+			continue;
+		}
+
+		/* Chunk may be completed just before its lease was created. */
+		state = chunk_state(chunk_no);
+		if (state != CHUNK_OPEN) {
+			remove(file_name);
+			free(file_name);
+			if (state == CHUNK_LAST) {
+				break;
+			}
+			continue;
+		}
+		free(file_name);
+
+		lease->chunk_no = chunk_no;
+		lease->first_isn = (AdamodIsn) chunk_no * options.shard_size + 1;
+		lease->last_isn = lease->first_isn + options.shard_size - 1;
+		lease->renewed = time(NULL);
+		held_lease = lease;
+		if (options.verbose_level > 1) {
+			fprintf(stderr, "\rChunk %lu claimed (ISN %llu-%llu)\n",
+				(unsigned long) chunk_no,
+				(unsigned long long) lease->first_isn,
+				(unsigned long long) lease->last_isn);
+		}
+
+		return ADAMOD_SUCCESS;
+	}
+
+	*claim = busy ? SHARD_BUSY : SHARD_DONE;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Renew lease of chunk, when third of lease time passed since last
+ * renewal. Lease taken over by other process is lost.
+ */
+int shard_renew(struct ShardLease *lease)
+{
+	FILE *file;
+	char *file_name;
+	time_t now;
+	int result_code = ADAMOD_SUCCESS;
+
+	time(&now);
+	if (now - lease->renewed < options.lease_time / 3) {
+		return ADAMOD_SUCCESS;
+	}
+
+	file_name = shard_file_name((long) lease->chunk_no, "lease");
+	if (file_name == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	if (!lease_owned(file_name)) {
+		result_code = ADAMOD_E_SHARD_LOST;
+	} else {
+		/* Rewriting of file updates its modification time. */
+		file = fopen(file_name, "wb");
+		if (file == NULL) {
+			result_code = ADAMOD_E_SHARD_IO;
+		} else {
+			fputs(owner, file);
+			if (fclose(file) != 0) {
+				result_code = ADAMOD_E_SHARD_IO;
+			}
+		}
+	}
+	free(file_name);
+
+	/* Lost lease is reported again by next renewal. */
+	if (result_code == ADAMOD_SUCCESS) {
+		lease->renewed = now;
+	} else {
+		held_lease = NULL;
+	}
+
+	return result_code;
+}
+
+/*
+ * Renew lease of chunk being processed, so it isn't taken over while
+ * processing is paused. Lost lease is reported by shard_renew() called
+ * for next record of chunk.
+ */
+void shard_keep(void)
+{
+	if (held_lease != NULL) {
+		shard_renew(held_lease);
+	}
+}
+
+/*
+ * Mark chunk done and drop its lease. Last chunk marks the end of
+ * records, so chunks after it are not claimed.
+ */
+int shard_complete(struct ShardLease *lease, int last)
+{
+	FILE *file;
+	char *file_name;
+	int result_code = ADAMOD_SUCCESS;
+
+	file_name = shard_file_name((long) lease->chunk_no, "done");
+	if (file_name == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+	file = fopen(file_name, "wb");
+	if (file == NULL) {
+		result_code = ADAMOD_E_SHARD_IO;
+	} else {
+		fputs(last ? "last\n" : "done\n", file);
+		if (fclose(file) != 0) {
+			result_code = ADAMOD_E_SHARD_IO;
+		}
+	}
+	free(file_name);
+
+	shard_release(lease);
+
+	return result_code;
+}
+
+/*
+ * Drop lease of chunk, if it's still owned by this process.
+ */
+void shard_release(struct ShardLease *lease)
+{
+	char *file_name;
+
+	file_name = shard_file_name((long) lease->chunk_no, "lease");
+	if (file_name != NULL && lease_owned(file_name)) {
+		remove(file_name);
+	}
+	free(file_name);
+	held_lease = NULL;
+}
+
+/*
+ * Load snapshot of selection, so all processes work on the same ISNs.
+ * When there is no snapshot yet, one process is elected by lease of
+ * selection to make it, others wait for it.
+ */
+int shard_selection(struct IsnSet *set, int *owner_flag)
+{
+	FILE *file;
+	char *file_name, *lock_name;
+	char buf[SELECTION_SIGNATURE_LEN];
+	ShardClaim claim;
+	int result_code = ADAMOD_SUCCESS;
+	int waiting = 0;
+
+	*owner_flag = 0;
+	file_name = shard_file_name(-1, "sel");
+	lock_name = shard_file_name(-1, "lock");
+	if (file_name == NULL || lock_name == NULL) {
+		free(file_name);
+		free(lock_name);
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	for (;;) {
+		file = fopen(file_name, "rb");
+		if (file != NULL) {
+			if (fread(buf, SELECTION_SIGNATURE_LEN, 1, file) != 1
+				|| memcmp(buf, SELECTION_SIGNATURE,
+				SELECTION_SIGNATURE_LEN) != 0
+				|| isn_set_read(set, file) != ADAMOD_SUCCESS)
+			{
+				result_code = ADAMOD_E_SHARD_IO;
+			}
+			fclose(file);
+			break;
+		}
+
+		result_code = lease_acquire(lock_name, &claim);
+		if (result_code != ADAMOD_SUCCESS) {
+			break;
+		}
+		if (claim == SHARD_CLAIMED) {
+			/* Snapshot may be saved just before lock was created. */
+			file = fopen(file_name, "rb");
+			if (file != NULL) {
+				fclose(file);
+				remove(lock_name);
+				continue;
+			}
+			*owner_flag = 1;
+			break;
+		}
+
+		if (!waiting && options.verbose_level > 0) {
+			fputs("Waiting for selection of other process\n", stderr);
+		}
+		waiting = 1;
+		timer_sleep(SELECTION_POLL_USEC);
+	}
+
+	free(file_name);
+	free(lock_name);
+
+	return result_code;
+}
+
+/*
+ * Save selection for other processes. File is written under temporary
+ * name and renamed, so readers never see partial file.
+ */
+int shard_save_selection(const struct IsnSet *set)
+{
+	FILE *file;
+	char *file_name, *temp_name, *lock_name;
+	int result_code;
+
+	file_name = shard_file_name(-1, "sel");
+	temp_name = shard_file_name(-1, "sel.tmp");
+	lock_name = shard_file_name(-1, "lock");
+	if (file_name == NULL || temp_name == NULL || lock_name == NULL) {
+		free(file_name);
+		free(temp_name);
+		free(lock_name);
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	result_code = ADAMOD_E_SHARD_IO;
+	file = fopen(temp_name, "wb");
+	if (file != NULL) {
+		fwrite(SELECTION_SIGNATURE, SELECTION_SIGNATURE_LEN, 1, file);
+		result_code = isn_set_write(set, file);
+		if (fclose(file) != 0) {
+			result_code = ADAMOD_E_SHARD_IO;
+		}
+		if (result_code == ADAMOD_SUCCESS
+			&& rename(temp_name, file_name) != 0)
+		{
+			result_code = ADAMOD_E_SHARD_IO;
+		}
+		if (result_code != ADAMOD_SUCCESS) {
+			remove(temp_name);
+			result_code = ADAMOD_E_SHARD_IO;
+		}
+	}
+	remove(lock_name);
+
+	free(file_name);
+	free(temp_name);
+	free(lock_name);
+
+	return result_code;
+}
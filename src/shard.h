@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(SHARD_H)
+#define SHARD_H
+
+#include <stdint.h>
+#include <time.h>
+#include "isnset.h"
+
+/*
+ * Processes working on the same job (possibly on different hosts)
+ * share shard directory. ISN space of file is divided into chunks of
+ * fixed size; process claims chunk by atomic creation of its lease
+ * file, renews lease while processing chunk and marks chunk done
+ * after commit. Lease not renewed in time (dead process) is taken
+ * over by other process.
+ */
+
+/* Results of chunk claim. */
+typedef enum {
+	SHARD_DONE = 0,
+	SHARD_CLAIMED,
+	SHARD_BUSY
+} ShardClaim;
+
+/* Lease of ISN range. */
+struct ShardLease {
+	uint32_t chunk_no;
+	AdamodIsn first_isn;
+	AdamodIsn last_isn;
+	time_t renewed;
+};
+
+/* Prepare owner identification of leases of this process. */
+void shard_open(void);
+/* Claim next unprocessed chunk (busy - chunks leased by others). */
+int shard_claim(struct ShardLease *lease, ShardClaim *claim);
+/* Renew lease when due (fails when lease was taken over). */
+int shard_renew(struct ShardLease *lease);
+/* Renew lease of chunk being processed, while processing is paused. */
+void shard_keep(void);
+/* Mark chunk done (last - no records follow chunk) and drop lease. */
+int shard_complete(struct ShardLease *lease, int last);
+/* Drop lease of unfinished chunk, so it can be claimed at once. */
+void shard_release(struct ShardLease *lease);
+/* Load snapshot of selection (owner flag - it must be made). */
+int shard_selection(struct IsnSet *set, int *owner_flag);
+/* Save selection made by owner for other processes. */
+int shard_save_selection(const struct IsnSet *set);
+
+#endif /* SHARD_H */
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adamod.h"
+#include "timer.h"
+#include "trace.h"
+
+/* Number of events kept in memory before they are written. */
+#define TRACE_BUF_EVENTS 4096
+/* Maximal length of event name. */
+#define TRACE_NAME_LEN 23
+
+/* Recorded event (complete event "X" of Chrome trace format). */
+struct TraceEvent {
+	char name[TRACE_NAME_LEN + 1];
+	const char *category;
+	uint64_t start_usec;
+	uint64_t duration_usec;
+	/* Response code and ISN of Adabas call (-1 - not a call). */
+	int response;
+	AdamodIsn isn;
+};
+
+void trace_event(const char *name, const char *category, int response,
+	AdamodIsn isn, uint64_t start_usec, uint64_t end_usec);
+int trace_flush(void);
+
+/* Trace file, its buffer of events and state. */
+static FILE *trace_file = NULL;
+static struct TraceEvent *events = NULL;
+static unsigned int event_count = 0;
+static AdamodIsn written_events = 0;
+static uint64_t trace_start_usec = 0;
+static int trace_failed = 0;
+
+/*
+ * Open trace file and start recording of events. Events are written
+ * as JSON array of Chrome trace event format (viewed with Perfetto or
+ * chrome://tracing).
+ */
+int trace_open(const char *file_name)
+{
+	events = malloc(TRACE_BUF_EVENTS * sizeof(struct TraceEvent));
+	if (events == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	trace_file = fopen(file_name, "wb");
+	if (trace_file == NULL) {
+		free(events);
+		events = NULL;
+		return ADAMOD_E_TRACE_IO;
+	}
+
+	fputs("{\"traceEvents\":[\n", trace_file);
+	trace_start_usec = timer_usec();
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Check whether events are recorded.
+ */
+int trace_enabled(void)
+{
+	return trace_file != NULL;
+}
+
+/*
+ * Record event in buffer (buffer is written to file when full).
+ */
+void trace_event(const char *name, const char *category, int response,
+	AdamodIsn isn, uint64_t start_usec, uint64_t end_usec)
+{
+	struct TraceEvent *event;
+
+	if (trace_file == NULL) {
+		return;
+	}
+	if (event_count == TRACE_BUF_EVENTS
+		&& trace_flush() != ADAMOD_SUCCESS)
+	{
+		trace_failed = 1;
+		event_count = 0;
+	}
+
+	event = &events[event_count++];
+	strncpy(event->name, name, TRACE_NAME_LEN);
+	event->name[TRACE_NAME_LEN] = '\0';
+	event->category = category;
+	event->start_usec = start_usec - trace_start_usec;
+	event->duration_usec = end_usec - start_usec;
+	event->response = response;
+	event->isn = isn;
+}
+
+/*
+ * Record span of operation.
+ */
+void trace_span(const char *name, const char *category,
+	uint64_t start_usec, uint64_t end_usec)
+{
+	trace_event(name, category, -1, 0, start_usec, end_usec);
+}
+
+/*
+ * Record span of Adabas call with its response code and ISN.
+ */
+void trace_call(const char *cmd_code, int response, AdamodIsn isn,
+	uint64_t start_usec, uint64_t end_usec)
+{
+	char name[3];
+
+	name[0] = cmd_code[0];
+	name[1] = cmd_code[1];
+	name[2] = '\0';
+	trace_event(name, "adabas", response, isn, start_usec, end_usec);
+}
+
+/*
+ * Write buffered events to trace file.
+ */
+int trace_flush(void)
+{
+	unsigned int event_no;
+	const struct TraceEvent *event;
+
+	for (event_no = 0; event_no < event_count; event_no++) {
+		event = &events[event_no];
+		fprintf(trace_file, "%s{\"name\":\"%s\",\"cat\":\"%s\","
+			"\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+			"\"pid\":1,\"tid\":1",
+			written_events > 0 ? ",\n" : "", event->name,
+			event->category,
+			(unsigned long long) event->start_usec,
+			(unsigned long long) event->duration_usec);
+		if (event->response >= 0) {
+			fprintf(trace_file, ",\"args\":{\"rsp\":%d,\"isn\":%llu}",
+				event->response, (unsigned long long) event->isn);
+		}
+		fputc('}', trace_file);
+		written_events++;
+	}
+	event_count = 0;
+
+	return ferror(trace_file) ? ADAMOD_E_TRACE_IO : ADAMOD_SUCCESS;
+}
+
+/*
+ * Write recorded events and close trace file.
+ */
+int trace_close(void)
+{
+	int result_code;
+
+	if (trace_file == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	result_code = trace_flush();
+	fputs("\n],\"displayTimeUnit\":\"ms\"}\n", trace_file);
+	if (fclose(trace_file) != 0 || trace_failed) {
+		result_code = ADAMOD_E_TRACE_IO;
+	}
+	trace_file = NULL;
+	free(events);
+	events = NULL;
+
+	return result_code;
+}
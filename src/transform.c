@@ -0,0 +1,1916 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "adamod.h"
+#include "codepage.h"
+#include "fdt.h"
+#include "format.h"
+#include "transform.h"
+
+/* Maximal numbers of fields, instructions, rules and constants. */
+#define TRANSFORM_FIELDS_MAX 64
+#define TRANSFORM_CODE_MAX 8192
+#define TRANSFORM_RULES_MAX 256
+#define TRANSFORM_NUMBERS_MAX 256
+#define TRANSFORM_TEXTS_MAX 256
+/* Size of pool of text constants. */
+#define TRANSFORM_POOL_SIZE 4096
+/* Maximal depth of stack of values. */
+#define TRANSFORM_STACK_MAX 32
+/* Size of buffer for text values computed for one record. */
+#define TRANSFORM_SCRATCH_SIZE 65536
+/* Maximal length of format buffers of transformation. */
+#define TRANSFORM_FORMAT_MAX 1024
+/* Maximal length of line of rules file. */
+#define RULE_LINE_MAX 4096
+
+/* Maximal length of value of variable length field. */
+#define VARIABLE_VALUE_MAX 253
+/* Maximal number of digits of numbers. */
+#define NUMBER_DIGITS 18
+/* Maximal number of decimal places of numbers. */
+#define NUMBER_SCALE 6
+
+/* Instructions of stack machine. */
+typedef enum {
+	OP_FIELD,
+	OP_NUMBER,
+	OP_TEXT,
+	OP_ADD,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_NEG,
+	OP_CONCAT,
+	OP_UPPER,
+	OP_LOWER,
+	OP_TRIM,
+	OP_REPLACE,
+	OP_PREFIX,
+	OP_STORE,
+	OP_EQ,
+	OP_NE,
+	OP_LT,
+	OP_LE,
+	OP_GT,
+	OP_GE,
+	OP_NOT,
+	OP_AND,
+	OP_OR,
+	OP_JUMP_FALSE,
+	OP_RULE,
+	OP_MATCH
+} TransformOp;
+
+struct Instruction {
+	TransformOp op;
+	/* Index of field, constant or rule, or target of jump. */
+	int arg;
+	/* Line of rules file and position in it (for error messages). */
+	int line;
+	int pos;
+};
+
+/* Decimal number (value is scaled by 10 to the power of scale). */
+struct Number {
+	int64_t value;
+	int scale;
+};
+
+/* Value on stack of machine (number or text in local codepage). */
+struct Value {
+	int text;
+	struct Number number;
+	const unsigned char *buf;
+	uint32_t len;
+};
+
+/* Field used by transformation. */
+struct TransformField {
+	char name[FIELD_NAME_LEN + 1];
+	int assigned;
+	/* Length (0 - variable length) and format bound from definitions. */
+	int length;
+	char format;
+};
+
+/* Rule of rules file. */
+struct Rule {
+	/* Fields assigned by rule (bit per assigned field). */
+	uint64_t mask;
+	/* First instruction after instructions of rule. */
+	int end;
+	int line;
+	unsigned long matches;
+};
+
+/* Function called in expression. */
+struct Function {
+	const char *name;
+	int arg_count;
+	TransformOp op;
+};
+
+/* Comparison operator. */
+struct Operator {
+	const char *token;
+	TransformOp op;
+};
+
+/* Parser state. */
+struct Parser {
+	const char *expr;
+	const char *pos;
+	int depth;
+	/* Line of rules file (0 - transformation from command line). */
+	int line;
+	/* Errors are not printed while alternative syntax is tried. */
+	int quiet;
+};
+
+int position_error(int line, int pos, const char *reason);
+int parse_error(struct Parser *parser, const char *reason);
+void parse_space(struct Parser *parser);
+int parse_keyword(struct Parser *parser, const char *keyword);
+TransformOp parse_operator(struct Parser *parser);
+int parse_emit(struct Parser *parser, TransformOp op, int arg, int effect);
+int parse_field(struct Parser *parser, int *field_no);
+int parse_number(struct Parser *parser);
+int parse_text(struct Parser *parser);
+int parse_call(struct Parser *parser);
+int parse_primary(struct Parser *parser);
+int parse_unary(struct Parser *parser);
+int parse_term(struct Parser *parser);
+int parse_expression(struct Parser *parser);
+int parse_assignment(struct Parser *parser);
+int parse_assignments(struct Parser *parser);
+int parse_comparison(struct Parser *parser);
+int parse_negation(struct Parser *parser);
+int parse_conjunction(struct Parser *parser);
+int parse_condition(struct Parser *parser);
+int parse_rule(struct Parser *parser);
+int transform_order(void);
+int transform_error(const char *name, const char *reason, int result_code);
+int64_t number_power(int exponent);
+int64_t number_magnitude(int64_t value);
+int number_round(struct Number *number, int scale);
+int number_add(struct Number *a, const struct Number *b, int subtract);
+int number_multiply(struct Number *a, const struct Number *b);
+int number_divide(struct Number *a, const struct Number *b);
+int number_compare(const struct Number *a, const struct Number *b);
+int number_decode(const struct TransformField *field,
+	const unsigned char *buf, uint32_t len, struct Number *number);
+int number_encode(const struct TransformField *field, struct Number number,
+	unsigned char *buf);
+unsigned char *scratch_alloc(uint32_t len);
+int text_replace(struct Value *value, const struct Value *from,
+	const struct Value *to, int prefix_only);
+int text_compare(const struct Value *a, const struct Value *b);
+int field_decode(const struct TransformField *field,
+	const unsigned char *buf, uint32_t len, struct Value *value);
+
+/* Functions of expressions (all arguments and results are texts). */
+static const struct Function functions[] = {
+	{ "upper", 1, OP_UPPER },
+	{ "lower", 1, OP_LOWER },
+	{ "trim", 1, OP_TRIM },
+	{ "replace", 3, OP_REPLACE },
+	{ "prefix", 3, OP_PREFIX },
+	{ NULL, 0, OP_FIELD }
+};
+
+/* Comparison operators (longer tokens are matched first). */
+static const struct Operator operators[] = {
+	{ "<>", OP_NE },
+	{ "<=", OP_LE },
+	{ ">=", OP_GE },
+	{ "=", OP_EQ },
+	{ "<", OP_LT },
+	{ ">", OP_GT },
+	{ NULL, OP_FIELD }
+};
+
+/* Compiled transformation. */
+static struct Instruction code[TRANSFORM_CODE_MAX];
+static int code_count = 0;
+static struct Number numbers[TRANSFORM_NUMBERS_MAX];
+static int number_count = 0;
+static uint32_t text_offsets[TRANSFORM_TEXTS_MAX];
+static uint32_t text_lengths[TRANSFORM_TEXTS_MAX];
+static int text_count = 0;
+static unsigned char text_pool[TRANSFORM_POOL_SIZE];
+static uint32_t text_pool_len = 0;
+
+/* Fields (assigned fields are first after compilation). */
+static struct TransformField fields[TRANSFORM_FIELDS_MAX];
+static int field_count = 0;
+static int assigned_count = 0;
+
+/*
+ * Rules of rules file. Rules are evaluated with values of fields as
+ * they are read and first matching rule assigning field wins.
+ */
+static struct Rule rules[TRANSFORM_RULES_MAX];
+static int rule_count = 0;
+static int rules_mode = 0;
+
+/* Format buffers of read and written fields. */
+static char read_format[TRANSFORM_FORMAT_MAX];
+static char write_format[TRANSFORM_FORMAT_MAX];
+
+/* Buffer for text values computed for current record. */
+static unsigned char scratch[TRANSFORM_SCRATCH_SIZE];
+static uint32_t scratch_len = 0;
+
+/*
+ * Print error of transformation at position of expression (in line
+ * of rules file).
+ */
+int position_error(int line, int pos, const char *reason)
+{
+	if (options.verbose_level > 0 && line > 0) {
+		fprintf(stderr, "Rules file line %d, position %d: %s\n",
+			line, pos + 1, reason);
+	} else if (options.verbose_level > 0) {
+		fprintf(stderr, "Transformation error at position %d: %s\n",
+			pos + 1, reason);
+	}
+
+	return rules_mode ? ADAMOD_E_INVRULES : ADAMOD_E_INVTRANSFORM;
+}
+
+/*
+ * Print error of transformation at current position of parser.
+ */
+int parse_error(struct Parser *parser, const char *reason)
+{
+	if (parser->quiet) {
+		return rules_mode ? ADAMOD_E_INVRULES : ADAMOD_E_INVTRANSFORM;
+	}
+
+	return position_error(parser->line, (int) (parser->pos - parser->expr),
+		reason);
+}
+
+/*
+ * Skip white space in expression.
+ */
+void parse_space(struct Parser *parser)
+{
+	while (*parser->pos == ' ' || *parser->pos == '\t') {
+		parser->pos++;
+	}
+}
+
+/*
+ * Append instruction to bytecode, tracking depth of stack.
+ */
+int parse_emit(struct Parser *parser, TransformOp op, int arg, int effect)
+{
+	if (code_count >= TRANSFORM_CODE_MAX) {
+		return parse_error(parser, "expression is too long");
+	}
+	parser->depth += effect;
+	if (parser->depth > TRANSFORM_STACK_MAX) {
+		return parse_error(parser, "expression is too complex");
+	}
+
+	code[code_count].op = op;
+	code[code_count].arg = arg;
+	code[code_count].line = parser->line;
+	code[code_count].pos = (int) (parser->pos - parser->expr);
+	code_count++;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Skip keyword at current position of parser. Returns 0 when there is
+ * no such keyword.
+ */
+int parse_keyword(struct Parser *parser, const char *keyword)
+{
+	size_t len = strlen(keyword);
+
+	if (strncmp(parser->pos, keyword, len) != 0
+		|| (parser->pos[len] >= 'a' && parser->pos[len] <= 'z'))
+	{
+		return 0;
+	}
+	parser->pos += len;
+	parse_space(parser);
+
+	return 1;
+}
+
+/*
+ * Skip comparison operator at current position of parser and get its
+ * instruction (OP_FIELD when there is no comparison operator).
+ */
+TransformOp parse_operator(struct Parser *parser)
+{
+	const struct Operator *operator;
+
+	for (operator = operators; operator->token != NULL; operator++) {
+		if (strncmp(parser->pos, operator->token, strlen(operator->token))
+			== 0)
+		{
+			parser->pos += strlen(operator->token);
+			break;
+		}
+	}
+
+	return operator->op;
+}
+
+/*
+ * Parse field name (two characters with optional occurrence number)
+ * and get its index in list of used fields.
+ */
+int parse_field(struct Parser *parser, int *field_no)
+{
+	char name[FIELD_NAME_LEN + 1];
+	int len = 2;
+
+	if (!(parser->pos[0] >= 'A' && parser->pos[0] <= 'Z')
+		|| !((parser->pos[1] >= 'A' && parser->pos[1] <= 'Z')
+		|| (parser->pos[1] >= '0' && parser->pos[1] <= '9')))
+	{
+		return parse_error(parser, "field name expected");
+	}
+	while (parser->pos[len] >= '0' && parser->pos[len] <= '9') {
+		len++;
+	}
+	if (len > FIELD_NAME_LEN) {
+		return parse_error(parser, "invalid field name");
+	}
+	memcpy(name, parser->pos, len);
+	name[len] = '\0';
+
+	for (*field_no = 0; *field_no < field_count; (*field_no)++) {
+		if (strcmp(fields[*field_no].name, name) == 0) {
+			break;
+		}
+	}
+	if (*field_no == field_count) {
+		if (field_count >= TRANSFORM_FIELDS_MAX) {
+			return parse_error(parser, "too many fields");
+		}
+		strcpy(fields[field_count].name, name);
+		fields[field_count].assigned = 0;
+		field_count++;
+	}
+	parser->pos += len;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Parse numeric constant (digits with optional decimal places).
+ */
+int parse_number(struct Parser *parser)
+{
+	struct Number *number;
+	int digits = 0;
+	/* Number of decimal places (-1 before decimal point). */
+	int decimals = -1;
+
+	if (number_count >= TRANSFORM_NUMBERS_MAX) {
+		return parse_error(parser, "too many constants");
+	}
+	number = numbers + number_count;
+	number->value = 0;
+
+	while ((*parser->pos >= '0' && *parser->pos <= '9')
+		|| (*parser->pos == '.' && decimals < 0
+		&& parser->pos[1] >= '0' && parser->pos[1] <= '9'))
+	{
+		if (*parser->pos == '.') {
+			decimals = 0;
+		} else {
+			number->value = number->value * 10 + (*parser->pos - '0');
+			if (number->value != 0) {
+				digits++;
+			}
+			if (decimals >= 0) {
+				decimals++;
+			}
+		}
+		parser->pos++;
+		if (digits > NUMBER_DIGITS || decimals > NUMBER_SCALE) {
+			return parse_error(parser, "too many digits in number");
+		}
+	}
+	number->scale = decimals > 0 ? decimals : 0;
+
+	return parse_emit(parser, OP_NUMBER, number_count++, 1);
+}
+
+/*
+ * Parse text constant in quotes (quote is doubled inside text).
+ */
+int parse_text(struct Parser *parser)
+{
+	if (text_count >= TRANSFORM_TEXTS_MAX) {
+		return parse_error(parser, "too many constants");
+	}
+	text_offsets[text_count] = text_pool_len;
+
+	for (parser->pos++;; parser->pos++) {
+		if (*parser->pos == '\0') {
+			return parse_error(parser, "unterminated text");
+		}
+		if (*parser->pos == '\'' && *++parser->pos != '\'') {
+			break;
+		}
+		if (text_pool_len >= TRANSFORM_POOL_SIZE) {
+			return parse_error(parser, "text is too long");
+		}
+		text_pool[text_pool_len++] = (unsigned char) *parser->pos;
+	}
+	text_lengths[text_count] = text_pool_len - text_offsets[text_count];
+
+	return parse_emit(parser, OP_TEXT, text_count++, 1);
+}
+
+/*
+ * Parse call of function with its arguments.
+ */
+int parse_call(struct Parser *parser)
+{
+	const struct Function *function;
+	int result_code;
+	int arg_no;
+	size_t len = 0;
+
+	while (parser->pos[len] >= 'a' && parser->pos[len] <= 'z') {
+		len++;
+	}
+	for (function = functions; function->name != NULL; function++) {
+		if (strlen(function->name) == len
+			&& strncmp(function->name, parser->pos, len) == 0)
+		{
+			break;
+		}
+	}
+	if (function->name == NULL) {
+		return parse_error(parser, "unknown function");
+	}
+	parser->pos += len;
+
+	parse_space(parser);
+	if (*parser->pos != '(') {
+		return parse_error(parser, "'(' expected");
+	}
+	parser->pos++;
+
+	for (arg_no = 0; arg_no < function->arg_count; arg_no++) {
+		if (arg_no > 0) {
+			if (*parser->pos != ',') {
+				return parse_error(parser, "',' expected");
+			}
+			parser->pos++;
+		}
+		result_code = parse_expression(parser);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+	if (*parser->pos != ')') {
+		return parse_error(parser, "')' expected");
+	}
+	parser->pos++;
+
+	return parse_emit(parser, function->op, 0, 1 - function->arg_count);
+}
+
+/*
+ * Parse constant, field, function call or expression in parentheses.
+ */
+int parse_primary(struct Parser *parser)
+{
+	int result_code;
+	int field_no;
+
+	parse_space(parser);
+	if (*parser->pos >= '0' && *parser->pos <= '9') {
+		result_code = parse_number(parser);
+	} else if (*parser->pos == '\'') {
+		result_code = parse_text(parser);
+	} else if (*parser->pos >= 'a' && *parser->pos <= 'z') {
+		result_code = parse_call(parser);
+	} else if (*parser->pos == '(') {
+		parser->pos++;
+		result_code = parse_expression(parser);
+		if (result_code == ADAMOD_SUCCESS && *parser->pos != ')') {
+			return parse_error(parser, "')' expected");
+		}
+		parser->pos++;
+	} else {
+		result_code = parse_field(parser, &field_no);
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = parse_emit(parser, OP_FIELD, field_no, 1);
+		}
+	}
+	parse_space(parser);
+
+	return result_code;
+}
+
+/*
+ * Parse operand with optional minus sign.
+ */
+int parse_unary(struct Parser *parser)
+{
+	int result_code;
+
+	parse_space(parser);
+	if (*parser->pos != '-') {
+		return parse_primary(parser);
+	}
+	parser->pos++;
+
+	result_code = parse_unary(parser);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return parse_emit(parser, OP_NEG, 0, 0);
+}
+
+/*
+ * Parse multiplication and division of operands.
+ */
+int parse_term(struct Parser *parser)
+{
+	int result_code;
+	char operation;
+
+	result_code = parse_unary(parser);
+	while (result_code == ADAMOD_SUCCESS
+		&& (*parser->pos == '*' || *parser->pos == '/'))
+	{
+		operation = *parser->pos++;
+		result_code = parse_unary(parser);
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = parse_emit(parser,
+				operation == '*' ? OP_MUL : OP_DIV, 0, -1);
+		}
+	}
+
+	return result_code;
+}
+
+/*
+ * Parse addition and subtraction of terms (addition of texts is
+ * their concatenation).
+ */
+int parse_expression(struct Parser *parser)
+{
+	int result_code;
+	char operation;
+
+	result_code = parse_term(parser);
+	while (result_code == ADAMOD_SUCCESS && (*parser->pos == '+'
+		|| (*parser->pos == '-' && parser->pos[1] != '>')))
+	{
+		operation = *parser->pos++;
+		result_code = parse_term(parser);
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = parse_emit(parser,
+				operation == '+' ? OP_ADD : OP_SUB, 0, -1);
+		}
+	}
+
+	return result_code;
+}
+
+/*
+ * Parse assignment of expression to field.
+ */
+int parse_assignment(struct Parser *parser)
+{
+	int result_code;
+	int field_no;
+
+	parse_space(parser);
+	result_code = parse_field(parser, &field_no);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+	fields[field_no].assigned = 1;
+
+	parse_space(parser);
+	if (*parser->pos != '=') {
+		return parse_error(parser, "'=' expected");
+	}
+	parser->pos++;
+
+	result_code = parse_expression(parser);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return parse_emit(parser, OP_STORE, field_no, -1);
+}
+
+/*
+ * Parse assignments "FIELD=expression[;FIELD=expression]..." up to
+ * end of expression. Last assignment may be followed by delimiter.
+ */
+int parse_assignments(struct Parser *parser)
+{
+	int result_code;
+
+	for (;;) {
+		result_code = parse_assignment(parser);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+
+		parse_space(parser);
+		if (*parser->pos != ';') {
+			break;
+		}
+		parser->pos++;
+		parse_space(parser);
+		if (*parser->pos == '\0') {
+			break;
+		}
+	}
+
+	if (*parser->pos != '\0') {
+		return parse_error(parser, "';' expected");
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Parse comparison of expressions or condition in parentheses.
+ */
+int parse_comparison(struct Parser *parser)
+{
+	struct Parser saved = *parser;
+	int saved_code = code_count;
+	int saved_numbers = number_count;
+	int saved_texts = text_count;
+	int saved_fields = field_count;
+	uint32_t saved_pool = text_pool_len;
+	int result_code;
+	TransformOp op;
+
+	parse_space(parser);
+	if (*parser->pos == '(') {
+		/*
+		 * Parentheses enclose condition or operand of comparison,
+		 * condition is tried first.
+		 */
+		parser->pos++;
+		parser->quiet++;
+		result_code = parse_condition(parser);
+		parser->quiet--;
+		if (result_code == ADAMOD_SUCCESS && *parser->pos == ')') {
+			parser->pos++;
+			parse_space(parser);
+			if (parse_operator(parser) == OP_FIELD) {
+				return ADAMOD_SUCCESS;
+			}
+		}
+
+		*parser = saved;
+		code_count = saved_code;
+		number_count = saved_numbers;
+		text_count = saved_texts;
+		field_count = saved_fields;
+		text_pool_len = saved_pool;
+	}
+
+	result_code = parse_expression(parser);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+	op = parse_operator(parser);
+	if (op == OP_FIELD) {
+		return parse_error(parser, "comparison operator expected");
+	}
+	result_code = parse_expression(parser);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return parse_emit(parser, op, 0, -1);
+}
+
+/*
+ * Parse comparison with optional negation.
+ */
+int parse_negation(struct Parser *parser)
+{
+	int result_code;
+
+	parse_space(parser);
+	if (!parse_keyword(parser, "not")) {
+		return parse_comparison(parser);
+	}
+
+	result_code = parse_negation(parser);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return parse_emit(parser, OP_NOT, 0, 0);
+}
+
+/*
+ * Parse conjunction of conditions. Next condition is not evaluated
+ * when previous one is false.
+ */
+int parse_conjunction(struct Parser *parser)
+{
+	int result_code;
+	int jump_no;
+
+	result_code = parse_negation(parser);
+	while (result_code == ADAMOD_SUCCESS && parse_keyword(parser, "and")) {
+		jump_no = code_count;
+		result_code = parse_emit(parser, OP_AND, 0, -1);
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = parse_negation(parser);
+			code[jump_no].arg = code_count;
+		}
+	}
+
+	return result_code;
+}
+
+/*
+ * Parse disjunction of conditions. Next condition is not evaluated
+ * when previous one is true.
+ */
+int parse_condition(struct Parser *parser)
+{
+	int result_code;
+	int jump_no;
+
+	result_code = parse_conjunction(parser);
+	while (result_code == ADAMOD_SUCCESS && parse_keyword(parser, "or")) {
+		jump_no = code_count;
+		result_code = parse_emit(parser, OP_OR, 0, -1);
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = parse_conjunction(parser);
+			code[jump_no].arg = code_count;
+		}
+	}
+
+	return result_code;
+}
+
+/*
+ * Parse rule "condition -> FIELD=expression[;FIELD=expression]..."
+ * (rule without condition is applied to every record).
+ */
+int parse_rule(struct Parser *parser)
+{
+	struct Rule *rule = rules + rule_count;
+	int result_code;
+	int jump_no = -1;
+
+	if (rule_count >= TRANSFORM_RULES_MAX) {
+		return parse_error(parser, "too many rules");
+	}
+	rule->line = parser->line;
+	rule->matches = 0;
+
+	result_code = parse_emit(parser, OP_RULE, rule_count, 0);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	if (strncmp(parser->pos, "->", 2) != 0) {
+		result_code = parse_condition(parser);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+		jump_no = code_count;
+		result_code = parse_emit(parser, OP_JUMP_FALSE, 0, -1);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+		if (strncmp(parser->pos, "->", 2) != 0) {
+			return parse_error(parser, "'->' expected");
+		}
+	}
+	parser->pos += 2;
+
+	result_code = parse_emit(parser, OP_MATCH, rule_count, 0);
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = parse_assignments(parser);
+	}
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	/* Instructions of rule are skipped when condition is false. */
+	rule->end = code_count;
+	if (jump_no >= 0) {
+		code[jump_no].arg = code_count;
+	}
+	rule_count++;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Put assigned fields before other fields, so values of assigned fields
+ * are at beginning of read record buffer, and build format buffers.
+ */
+int transform_order(void)
+{
+	struct TransformField ordered[TRANSFORM_FIELDS_MAX];
+	int new_no[TRANSFORM_FIELDS_MAX];
+	int field_no, other_no, code_no, rule_no;
+	size_t len = 0;
+
+	assigned_count = 0;
+	for (field_no = 0; field_no < field_count; field_no++) {
+		if (fields[field_no].assigned) {
+			new_no[field_no] = assigned_count++;
+		}
+	}
+	for (field_no = 0, other_no = assigned_count; field_no < field_count;
+		field_no++)
+	{
+		if (!fields[field_no].assigned) {
+			new_no[field_no] = other_no++;
+		}
+	}
+	for (field_no = 0; field_no < field_count; field_no++) {
+		ordered[new_no[field_no]] = fields[field_no];
+	}
+	memcpy(fields, ordered, field_count * sizeof(fields[0]));
+
+	for (code_no = 0; code_no < code_count; code_no++) {
+		if (code[code_no].op == OP_FIELD || code[code_no].op == OP_STORE) {
+			code[code_no].arg = new_no[code[code_no].arg];
+		}
+	}
+
+	/* Rule is skipped when all fields assigned by it are assigned. */
+	for (code_no = 0, rule_no = -1; code_no < code_count; code_no++) {
+		if (code[code_no].op == OP_RULE) {
+			rule_no = code[code_no].arg;
+			rules[rule_no].mask = 0;
+		} else if (code[code_no].op == OP_STORE && rule_no >= 0) {
+			rules[rule_no].mask |= (uint64_t) 1 << code[code_no].arg;
+		}
+	}
+
+	/* Every field is read and written with standard length. */
+	read_format[0] = '\0';
+	for (field_no = 0; field_no < field_count; field_no++) {
+		len += strlen(fields[field_no].name) + 1;
+		if (len >= TRANSFORM_FORMAT_MAX) {
+			return rules_mode ? ADAMOD_E_INVRULES : ADAMOD_E_INVTRANSFORM;
+		}
+		if (field_no > 0) {
+			strcat(read_format, ",");
+		}
+		strcat(read_format, fields[field_no].name);
+		if (field_no == assigned_count - 1) {
+			sprintf(write_format, "%s.", read_format);
+		}
+	}
+	strcat(read_format, ".");
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Compile transformation "FIELD=expression[;FIELD=expression]..."
+ * into bytecode. Expressions consist of numbers, texts in quotes,
+ * fields, operators + - * / and functions. Values assigned to fields
+ * are used by following expressions.
+ */
+int transform_parse(const char *expr)
+{
+	struct Parser parser;
+	int result_code;
+
+	parser.expr = expr;
+	parser.pos = expr;
+	parser.depth = 0;
+	parser.line = 0;
+	parser.quiet = 0;
+
+	result_code = parse_assignments(&parser);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return transform_order();
+}
+
+/*
+ * Compile rules file with rule "condition -> FIELD=expression[;...]"
+ * per line into bytecode. Conditions compare expressions with
+ * operators = <> < <= > >= and are combined with not, and, or. Rules
+ * are evaluated together against values of fields as they are read,
+ * first matching rule assigning field wins. Empty lines and lines
+ * starting with '#' are skipped.
+ */
+int transform_rules(const char *file_name)
+{
+	FILE *file;
+	char line[RULE_LINE_MAX];
+	struct Parser parser;
+	int line_no = 0;
+	int result_code = ADAMOD_SUCCESS;
+
+	file = fopen(file_name, "r");
+	if (file == NULL) {
+		return ADAMOD_E_RULES_IO;
+	}
+	rules_mode = 1;
+
+	while (result_code == ADAMOD_SUCCESS
+		&& fgets(line, sizeof(line), file) != NULL)
+	{
+		parser.expr = line;
+		parser.pos = line;
+		parser.depth = 0;
+		parser.line = ++line_no;
+		parser.quiet = 0;
+
+		if (strchr(line, '\n') == NULL && !feof(file)) {
+			result_code = parse_error(&parser, "line is too long");
+			break;
+		}
+		line[strcspn(line, "\r\n")] = '\0';
+
+		parse_space(&parser);
+		if (*parser.pos != '\0' && *parser.pos != '#') {
+			result_code = parse_rule(&parser);
+		}
+	}
+	if (result_code == ADAMOD_SUCCESS && ferror(file)) {
+		result_code = ADAMOD_E_RULES_IO;
+	}
+	fclose(file);
+
+	if (result_code == ADAMOD_SUCCESS && rule_count == 0) {
+		if (options.verbose_level > 0) {
+			fprintf(stderr, "Rules file contains no rules\n");
+		}
+		result_code = ADAMOD_E_INVRULES;
+	}
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	return transform_order();
+}
+
+/*
+ * Check whether transformation is specified.
+ */
+int transform_enabled(void)
+{
+	return assigned_count > 0;
+}
+
+/*
+ * Print numbers of records matched by rules.
+ */
+void transform_report(void)
+{
+	int rule_no;
+
+	if (options.verbose_level < 1) {
+		return;
+	}
+
+	for (rule_no = 0; rule_no < rule_count; rule_no++) {
+		fprintf(stderr, "Records matched by rule at line %d: %lu\n",
+			rules[rule_no].line, rules[rule_no].matches);
+	}
+}
+
+/*
+ * Get format buffer of fields used by transformation (assigned fields
+ * followed by other used fields).
+ */
+const char *transform_read_format(void)
+{
+	return read_format;
+}
+
+/*
+ * Get format buffer of fields assigned by transformation.
+ */
+const char *transform_write_format(void)
+{
+	return write_format;
+}
+
+/*
+ * Get maximal length of record buffers of transformation (read record
+ * buffer is the longest).
+ */
+uint32_t transform_record_max(void)
+{
+	uint32_t len = 0;
+	int field_no;
+
+	for (field_no = 0; field_no < field_count; field_no++) {
+		len += fields[field_no].length > 0
+			? (uint32_t) fields[field_no].length : VARIABLE_VALUE_MAX + 1;
+	}
+
+	return len;
+}
+
+/*
+ * Print error of transformation of field.
+ */
+int transform_error(const char *name, const char *reason, int result_code)
+{
+	if (options.verbose_level > 0) {
+		fprintf(stderr, "Field %s: %s\n", name, reason);
+	}
+
+	return result_code == ADAMOD_E_INVTRANSFORM && rules_mode
+		? ADAMOD_E_INVRULES : result_code;
+}
+
+/*
+ * Bind transformation to field definitions of file: get lengths and
+ * formats of fields and check types of operands of instructions.
+ */
+int transform_bind(const struct FieldTable *table)
+{
+	struct RecordLayout layout;
+	int types[TRANSFORM_STACK_MAX];
+	int depth = 0;
+	int field_no, code_no;
+	int result_code;
+
+	result_code = layout_compile(table, read_format, strlen(read_format),
+		&layout);
+	if (result_code != ADAMOD_SUCCESS) {
+		return rules_mode ? ADAMOD_E_INVRULES : ADAMOD_E_INVTRANSFORM;
+	}
+	if (layout.count != field_count) {
+		return transform_error(fields[0].name,
+			"groups are not transformed", ADAMOD_E_INVTRANSFORM);
+	}
+
+	for (field_no = 0; field_no < field_count; field_no++) {
+		struct TransformField *field = fields + field_no;
+		const struct LayoutField *layout_field = layout.fields + field_no;
+
+		if (strcmp(field->name, layout_field->name) != 0) {
+			return transform_error(field->name,
+				"groups are not transformed", ADAMOD_E_INVTRANSFORM);
+		}
+		field->length = layout_field->length;
+		field->format = layout_field->format;
+		if ((field->format == 'A' && field->length <= VARIABLE_VALUE_MAX)
+			|| (field->format == 'U' && field->length <= NUMBER_DIGITS)
+			|| (field->format == 'P'
+			&& field->length * 2 - 1 <= NUMBER_DIGITS)
+			|| field->format == 'F')
+		{
+			continue;
+		}
+		return transform_error(field->name,
+			"format or length is not supported by transformation",
+			ADAMOD_E_INVTRANSFORM);
+	}
+
+	/*
+	 * Type of every value on stack (0 - number, 1 - text, 2 - result
+	 * of condition) is known before execution.
+	 */
+	for (code_no = 0; code_no < code_count; code_no++) {
+		struct Instruction *instruction = code + code_no;
+		int text = 0;
+
+		switch (instruction->op) {
+		case OP_FIELD:
+			types[depth++] = fields[instruction->arg].format == 'A';
+			continue;
+		case OP_NUMBER:
+			types[depth++] = 0;
+			continue;
+		case OP_TEXT:
+			types[depth++] = 1;
+			continue;
+		case OP_ADD:
+			if (types[depth - 2] == 1 && types[depth - 1] == 1) {
+				instruction->op = OP_CONCAT;
+				text = 1;
+			}
+			/* Fall through. */
+		case OP_SUB:
+		case OP_MUL:
+		case OP_DIV:
+			if (types[depth - 2] != text || types[depth - 1] != text) {
+				return position_error(instruction->line, instruction->pos,
+					"invalid types of operands");
+			}
+			depth--;
+			continue;
+		case OP_NEG:
+			text = 0;
+			break;
+		case OP_UPPER:
+		case OP_LOWER:
+		case OP_TRIM:
+			text = 1;
+			break;
+		case OP_REPLACE:
+		case OP_PREFIX:
+			if (types[depth - 3] != 1 || types[depth - 2] != 1) {
+				return position_error(instruction->line, instruction->pos,
+					"text arguments expected");
+			}
+			depth -= 2;
+			text = 1;
+			break;
+		case OP_EQ:
+		case OP_NE:
+		case OP_LT:
+		case OP_LE:
+		case OP_GT:
+		case OP_GE:
+			if (types[depth - 2] == 2 || types[depth - 2] != types[depth - 1])
+			{
+				return position_error(instruction->line, instruction->pos,
+					"invalid types of operands");
+			}
+			types[--depth - 1] = 2;
+			continue;
+		case OP_NOT:
+			text = 2;
+			break;
+		case OP_AND:
+		case OP_OR:
+		case OP_JUMP_FALSE:
+			/* Operand remains on stack only when jump is made. */
+			if (types[--depth] != 2) {
+				return position_error(instruction->line, instruction->pos,
+					"condition expected");
+			}
+			continue;
+		case OP_RULE:
+		case OP_MATCH:
+			continue;
+		case OP_STORE:
+			if (types[--depth] != (fields[instruction->arg].format == 'A'))
+			{
+				return position_error(instruction->line, instruction->pos,
+					"type of value doesn't match field");
+			}
+			continue;
+		default:
+			break;
+		}
+		if (types[depth - 1] != text) {
+			return position_error(instruction->line, instruction->pos,
+				text == 2 ? "condition expected"
+				: text ? "text arguments expected"
+				: "numeric operand expected");
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Get 10 to the power of exponent (up to number of digits).
+ */
+int64_t number_power(int exponent)
+{
+	int64_t power = 1;
+
+	while (exponent-- > 0) {
+		power *= 10;
+	}
+
+	return power;
+}
+
+/*
+ * Get absolute value of number.
+ */
+int64_t number_magnitude(int64_t value)
+{
+	return value < 0 ? -value : value;
+}
+
+/*
+ * Change number of decimal places of number (value is rounded half
+ * away from zero). Returns 0 when number is too large.
+ */
+int number_round(struct Number *number, int scale)
+{
+	int64_t power, remainder;
+
+	if (scale > number->scale) {
+		power = number_power(scale - number->scale);
+		if (number_magnitude(number->value)
+			> (number_power(NUMBER_DIGITS) - 1) / power)
+		{
+			return 0;
+		}
+		number->value *= power;
+	} else if (scale < number->scale) {
+		power = number_power(number->scale - scale);
+		remainder = number->value % power;
+		number->value /= power;
+		if (number_magnitude(remainder) * 2 >= power) {
+			number->value += number->value < 0 || remainder < 0 ? -1 : 1;
+		}
+	}
+	number->scale = scale;
+
+	return 1;
+}
+
+/*
+ * Add or subtract numbers. Returns 0 on overflow.
+ */
+int number_add(struct Number *a, const struct Number *b, int subtract)
+{
+	struct Number c = *b;
+	int scale = a->scale > b->scale ? a->scale : b->scale;
+
+	if (!number_round(a, scale) || !number_round(&c, scale)) {
+		return 0;
+	}
+	a->value += subtract ? -c.value : c.value;
+
+	return number_magnitude(a->value) < number_power(NUMBER_DIGITS);
+}
+
+/*
+ * Multiply numbers. Returns 0 on overflow.
+ */
+int number_multiply(struct Number *a, const struct Number *b)
+{
+	if (a->value != 0 && number_magnitude(b->value)
+		> (number_power(NUMBER_DIGITS) - 1) / number_magnitude(a->value))
+	{
+		return 0;
+	}
+	a->value *= b->value;
+	a->scale += b->scale;
+
+	return a->scale <= NUMBER_SCALE || number_round(a, NUMBER_SCALE);
+}
+
+/*
+ * Divide numbers (quotient is rounded to maximal number of decimal
+ * places which doesn't overflow). Returns 0 on overflow or division
+ * by zero.
+ */
+int number_divide(struct Number *a, const struct Number *b)
+{
+	struct Number dividend, divisor;
+	int64_t remainder;
+	int scale;
+
+	if (b->value == 0) {
+		return 0;
+	}
+
+	/* Quotient has scale of dividend minus scale of divisor. */
+	divisor = *b;
+	for (scale = NUMBER_SCALE; scale >= 0; scale--) {
+		dividend = *a;
+		if (number_round(&dividend, scale + divisor.scale)) {
+			break;
+		}
+	}
+	if (scale < 0) {
+		return 0;
+	}
+
+	a->value = dividend.value / divisor.value;
+	a->scale = scale;
+	remainder = dividend.value % divisor.value;
+	if (number_magnitude(remainder) * 2 >= number_magnitude(divisor.value))
+	{
+		a->value += (dividend.value < 0) != (divisor.value < 0) ? -1 : 1;
+	}
+
+	return 1;
+}
+
+/*
+ * Compare numbers. Returns negative, zero or positive value when first
+ * number is less than, equal to or greater than second one.
+ */
+int number_compare(const struct Number *a, const struct Number *b)
+{
+	int a_sign = (a->value > 0) - (a->value < 0);
+	int b_sign = (b->value > 0) - (b->value < 0);
+	int64_t a_power = number_power(a->scale);
+	int64_t b_power = number_power(b->scale);
+	int64_t a_part, b_part;
+
+	if (a_sign != b_sign || a_sign == 0) {
+		return a_sign - b_sign;
+	}
+
+	/* Integer parts are compared first, then fractions. */
+	a_part = number_magnitude(a->value) / a_power;
+	b_part = number_magnitude(b->value) / b_power;
+	if (a_part == b_part) {
+		a_part = number_magnitude(a->value) % a_power
+			* number_power(NUMBER_SCALE - a->scale);
+		b_part = number_magnitude(b->value) % b_power
+			* number_power(NUMBER_SCALE - b->scale);
+	}
+
+	return a_part == b_part ? 0 : a_part < b_part ? -a_sign : a_sign;
+}
+
+/*
+ * Decode numeric value of field (unpacked, packed or fixed point).
+ * Returns 0 when value is invalid.
+ */
+int number_decode(const struct TransformField *field,
+	const unsigned char *buf, uint32_t len, struct Number *number)
+{
+	uint32_t i;
+	int negative = 0;
+
+	number->value = 0;
+	number->scale = 0;
+
+	if (field->format == 'F') {
+		/* Fixed point values are stored in native byte order. */
+		if (len == 1) {
+			number->value = (signed char) buf[0];
+		} else if (len == 2) {
+			int16_t n;
+			memcpy(&n, buf, 2);
+			number->value = n;
+		} else if (len == 4) {
+			int32_t n;
+			memcpy(&n, buf, 4);
+			number->value = n;
+		} else {
+			memcpy(&number->value, buf, 8);
+		}
+		return number_magnitude(number->value)
+			< number_power(NUMBER_DIGITS);
+	}
+
+	for (i = 0; i < len; i++) {
+		if (field->format == 'U') {
+			/* Sign of negative value is in zone of last digit. */
+			if ((buf[i] & 0x0F) > 9 || ((buf[i] & 0xF0) != 0x30
+				&& (i < len - 1 || (buf[i] & 0xF0) != 0x70)))
+			{
+				return 0;
+			}
+			number->value = number->value * 10 + (buf[i] & 0x0F);
+			negative = (buf[i] & 0xF0) == 0x70;
+			continue;
+		}
+
+		/* Packed decimal: two digits per byte, sign in last nibble. */
+		if ((buf[i] >> 4) > 9 || (i < len - 1 && (buf[i] & 0x0F) > 9)
+			|| (i == len - 1 && (buf[i] & 0x0F) < 0x0A))
+		{
+			return 0;
+		}
+		number->value = number->value * 10 + (buf[i] >> 4);
+		if (i < len - 1) {
+			number->value = number->value * 10 + (buf[i] & 0x0F);
+		} else {
+			negative = (buf[i] & 0x0F) == 0x0B || (buf[i] & 0x0F) == 0x0D;
+		}
+	}
+	if (negative) {
+		number->value = -number->value;
+	}
+
+	return 1;
+}
+
+/*
+ * Encode numeric value of field rounded to integer. Returns 0 when
+ * value doesn't fit field.
+ */
+int number_encode(const struct TransformField *field, struct Number number,
+	unsigned char *buf)
+{
+	int64_t value, digits_max;
+	int len = field->length;
+	int negative;
+
+	number_round(&number, 0);
+	value = number_magnitude(number.value);
+	negative = number.value < 0;
+
+	if (field->format == 'F') {
+		if (len < 8 && (number.value >= ((int64_t) 1 << (len * 8 - 1))
+			|| number.value < -((int64_t) 1 << (len * 8 - 1))))
+		{
+			return 0;
+		}
+		if (len == 1) {
+			buf[0] = (unsigned char) (number.value & 0xFF);
+		} else if (len == 2) {
+			int16_t n = (int16_t) number.value;
+			memcpy(buf, &n, 2);
+		} else if (len == 4) {
+			int32_t n = (int32_t) number.value;
+			memcpy(buf, &n, 4);
+		} else {
+			memcpy(buf, &number.value, 8);
+		}
+		return 1;
+	}
+
+	if (field->format == 'U') {
+		if (value >= number_power(len)) {
+			return 0;
+		}
+		while (len-- > 0) {
+			buf[len] = (unsigned char) (0x30 | (value % 10));
+			value /= 10;
+		}
+		if (negative) {
+			buf[field->length - 1] = (unsigned char) (0x70
+				| (buf[field->length - 1] & 0x0F));
+		}
+		return 1;
+	}
+
+	digits_max = number_power(len * 2 - 1);
+	if (value >= digits_max) {
+		return 0;
+	}
+	buf[--len] = (unsigned char) (((value % 10) << 4)
+		| (negative ? 0x0D : 0x0C));
+	value /= 10;
+	while (len-- > 0) {
+		buf[len] = (unsigned char) (value % 10);
+		value /= 10;
+		buf[len] |= (unsigned char) ((value % 10) << 4);
+		value /= 10;
+	}
+
+	return 1;
+}
+
+/*
+ * Allocate buffer for text value of current record.
+ */
+unsigned char *scratch_alloc(uint32_t len)
+{
+	unsigned char *buf = scratch + scratch_len;
+
+	if (len > TRANSFORM_SCRATCH_SIZE - scratch_len) {
+		return NULL;
+	}
+	scratch_len += len;
+
+	return buf;
+}
+
+/*
+ * Replace occurrences (or only prefix) of text in value. Returns 0 when
+ * buffer of texts is exhausted.
+ */
+int text_replace(struct Value *value, const struct Value *from,
+	const struct Value *to, int prefix_only)
+{
+	unsigned char *buf;
+	uint32_t pos = 0, len = 0;
+
+	if (from->len == 0 || from->len > value->len) {
+		return 1;
+	}
+	if (prefix_only && memcmp(value->buf, from->buf, from->len) != 0) {
+		return 1;
+	}
+
+	/* Result is built at end of buffer of texts. */
+	buf = scratch + scratch_len;
+	while (pos < value->len) {
+		if (pos + from->len <= value->len
+			&& memcmp(value->buf + pos, from->buf, from->len) == 0
+			&& (!prefix_only || pos == 0))
+		{
+			if (scratch_len + len + to->len > TRANSFORM_SCRATCH_SIZE) {
+				return 0;
+			}
+			memcpy(buf + len, to->buf, to->len);
+			len += to->len;
+			pos += from->len;
+			continue;
+		}
+		if (scratch_len + len >= TRANSFORM_SCRATCH_SIZE) {
+			return 0;
+		}
+		buf[len++] = value->buf[pos++];
+	}
+	scratch_len += len;
+	value->buf = buf;
+	value->len = len;
+
+	return 1;
+}
+
+/*
+ * Compare texts ignoring trailing blanks. Returns negative, zero or
+ * positive value when first text is less than, equal to or greater than
+ * second one.
+ */
+int text_compare(const struct Value *a, const struct Value *b)
+{
+	uint32_t a_len = a->len, b_len = b->len;
+	int result;
+
+	while (a_len > 0 && a->buf[a_len - 1] == ' ') {
+		a_len--;
+	}
+	while (b_len > 0 && b->buf[b_len - 1] == ' ') {
+		b_len--;
+	}
+
+	result = memcmp(a->buf, b->buf, a_len < b_len ? a_len : b_len);
+	if (result == 0) {
+		result = a_len == b_len ? 0 : a_len < b_len ? -1 : 1;
+	}
+
+	return result;
+}
+
+/*
+ * Decode value of field from read record buffer.
+ */
+int field_decode(const struct TransformField *field,
+	const unsigned char *buf, uint32_t len, struct Value *value)
+{
+	unsigned char *text_buf;
+
+	value->text = field->format == 'A';
+	value->buf = buf;
+	value->len = len;
+	if (value->text && codepage_enabled()) {
+		text_buf = scratch_alloc(len);
+		if (text_buf == NULL) {
+			return transform_error(field->name, "value is too long",
+				ADAMOD_E_TRANSFORM);
+		}
+		memcpy(text_buf, buf, len);
+		codepage_to_local(text_buf, len);
+		value->buf = text_buf;
+	} else if (!value->text
+		&& !number_decode(field, buf, len, &value->number))
+	{
+		return transform_error(field->name, "invalid value for format",
+			ADAMOD_E_TRANSFORM);
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Compute record buffer of assigned fields from record buffer read with
+ * format buffer of transformation. Length of before-image of assigned
+ * fields (beginning of read record buffer) is returned too. Values of
+ * fields are decoded when they are used first time, so fields used by
+ * several rules are decoded once and fields of rules which are not
+ * evaluated are not decoded at all.
+ */
+int transform_apply(const unsigned char *record_buf, uint32_t record_len,
+	unsigned char *result_buf, uint32_t *result_len, uint32_t *image_len)
+{
+	struct Value values[TRANSFORM_FIELDS_MAX];
+	struct Value results[TRANSFORM_FIELDS_MAX];
+	struct Value stack[TRANSFORM_STACK_MAX];
+	const unsigned char *originals[TRANSFORM_FIELDS_MAX];
+	uint32_t original_lens[TRANSFORM_FIELDS_MAX];
+	uint32_t starts[TRANSFORM_FIELDS_MAX];
+	uint32_t lens[TRANSFORM_FIELDS_MAX];
+	int decoded[TRANSFORM_FIELDS_MAX];
+	int modified[TRANSFORM_FIELDS_MAX];
+	uint64_t modified_mask = 0, assigned_mask;
+	struct Value *top = stack;
+	unsigned char *buf;
+	uint32_t pos = 0, len;
+	int field_no, code_no, comparison;
+	int result_code;
+
+	scratch_len = 0;
+	*image_len = 0;
+	assigned_mask = assigned_count < 64
+		? ((uint64_t) 1 << assigned_count) - 1 : ~(uint64_t) 0;
+
+	/* Locate values of fields in read record buffer. */
+	for (field_no = 0; field_no < field_count; field_no++) {
+		const struct TransformField *field = fields + field_no;
+
+		if (field_no == assigned_count) {
+			*image_len = pos;
+		}
+		originals[field_no] = record_buf + pos;
+		len = (uint32_t) field->length;
+		if (len == 0) {
+			if (pos >= record_len || record_buf[pos] < 1) {
+				return transform_error(field->name,
+					"missing length of value", ADAMOD_E_TRANSFORM);
+			}
+			len = record_buf[pos++] - 1;
+		}
+		if (pos + len > record_len) {
+			return transform_error(field->name,
+				"value is beyond end of record buffer",
+				ADAMOD_E_TRANSFORM);
+		}
+		original_lens[field_no] = (uint32_t) (record_buf + pos + len
+			- originals[field_no]);
+		starts[field_no] = pos;
+		lens[field_no] = len;
+		decoded[field_no] = 0;
+		modified[field_no] = 0;
+		pos += len;
+	}
+	if (field_count == assigned_count) {
+		*image_len = pos;
+	}
+	if (pos != record_len) {
+		return ADAMOD_E_INVRECORD;
+	}
+
+	/* Execute bytecode (types of operands are checked by binding). */
+	for (code_no = 0; code_no < code_count; code_no++) {
+		const struct Instruction *instruction = code + code_no;
+		const char *reason = NULL;
+
+		switch (instruction->op) {
+		case OP_FIELD:
+			field_no = instruction->arg;
+			if (!decoded[field_no]) {
+				result_code = field_decode(fields + field_no,
+					record_buf + starts[field_no], lens[field_no],
+					values + field_no);
+				if (result_code != ADAMOD_SUCCESS) {
+					return result_code;
+				}
+				decoded[field_no] = 1;
+			}
+			*top++ = values[field_no];
+			break;
+		case OP_NUMBER:
+			top->text = 0;
+			top->number = numbers[instruction->arg];
+			top++;
+			break;
+		case OP_TEXT:
+			top->text = 1;
+			top->buf = text_pool + text_offsets[instruction->arg];
+			top->len = text_lengths[instruction->arg];
+			top++;
+			break;
+		case OP_ADD:
+		case OP_SUB:
+			top--;
+			if (!number_add(&top[-1].number, &top->number,
+				instruction->op == OP_SUB))
+			{
+				reason = "numeric overflow";
+			}
+			break;
+		case OP_MUL:
+			top--;
+			if (!number_multiply(&top[-1].number, &top->number)) {
+				reason = "numeric overflow";
+			}
+			break;
+		case OP_DIV:
+			top--;
+			if (!number_divide(&top[-1].number, &top->number)) {
+				reason = "division by zero or numeric overflow";
+			}
+			break;
+		case OP_NEG:
+			top[-1].number.value = -top[-1].number.value;
+			break;
+		case OP_CONCAT:
+			top--;
+			buf = scratch_alloc(top[-1].len + top->len);
+			if (buf == NULL) {
+				reason = "text is too long";
+			} else {
+				memcpy(buf, top[-1].buf, top[-1].len);
+				memcpy(buf + top[-1].len, top->buf, top->len);
+				top[-1].buf = buf;
+				top[-1].len += top->len;
+			}
+			break;
+		case OP_UPPER:
+		case OP_LOWER:
+			buf = scratch_alloc(top[-1].len);
+			if (buf == NULL) {
+				reason = "text is too long";
+			} else {
+				memcpy(buf, top[-1].buf, top[-1].len);
+				codepage_case(buf, top[-1].len,
+					instruction->op == OP_UPPER);
+				top[-1].buf = buf;
+			}
+			break;
+		case OP_TRIM:
+			while (top[-1].len > 0 && top[-1].buf[0] == ' ') {
+				top[-1].buf++;
+				top[-1].len--;
+			}
+			while (top[-1].len > 0
+				&& top[-1].buf[top[-1].len - 1] == ' ')
+			{
+				top[-1].len--;
+			}
+			break;
+		case OP_REPLACE:
+		case OP_PREFIX:
+			top -= 2;
+			if (!text_replace(top - 1, top, top + 1,
+				instruction->op == OP_PREFIX))
+			{
+				reason = "text is too long";
+			}
+			break;
+		case OP_STORE:
+			field_no = instruction->arg;
+			top--;
+			if (rules_mode) {
+				/* First matching rule assigning field wins. */
+				if (!modified[field_no]) {
+					results[field_no] = *top;
+				}
+			} else {
+				/* Assigned value is used by following expressions. */
+				values[field_no] = *top;
+				decoded[field_no] = 1;
+				results[field_no] = *top;
+			}
+			modified[field_no] = 1;
+			modified_mask |= (uint64_t) 1 << field_no;
+			break;
+		case OP_EQ:
+		case OP_NE:
+		case OP_LT:
+		case OP_LE:
+		case OP_GT:
+		case OP_GE:
+			top--;
+			comparison = top->text ? text_compare(top - 1, top)
+				: number_compare(&top[-1].number, &top->number);
+			top[-1].text = 0;
+			top[-1].number.scale = 0;
+			top[-1].number.value = instruction->op == OP_EQ
+				? comparison == 0 : instruction->op == OP_NE
+				? comparison != 0 : instruction->op == OP_LT
+				? comparison < 0 : instruction->op == OP_LE
+				? comparison <= 0 : instruction->op == OP_GT
+				? comparison > 0 : comparison >= 0;
+			break;
+		case OP_NOT:
+			top[-1].number.value = !top[-1].number.value;
+			break;
+		case OP_AND:
+		case OP_OR:
+			/* Result of condition is known by first operand. */
+			if ((top[-1].number.value != 0) == (instruction->op == OP_OR))
+			{
+				code_no = instruction->arg - 1;
+			} else {
+				top--;
+			}
+			break;
+		case OP_JUMP_FALSE:
+			top--;
+			if (top->number.value == 0) {
+				code_no = instruction->arg - 1;
+			}
+			break;
+		case OP_RULE:
+			/*
+			 * Rule is skipped when fields assigned by it are assigned
+			 * by previous rules, evaluation stops when every field is.
+			 */
+			if (modified_mask == assigned_mask) {
+				code_no = code_count - 1;
+			} else if ((modified_mask & rules[instruction->arg].mask)
+				== rules[instruction->arg].mask)
+			{
+				code_no = rules[instruction->arg].end - 1;
+			}
+			break;
+		case OP_MATCH:
+			rules[instruction->arg].matches++;
+			break;
+		}
+		if (reason != NULL && rules_mode) {
+			if (options.verbose_level > 0) {
+				fprintf(stderr, "Rule at line %d: %s\n",
+					instruction->line, reason);
+			}
+			return ADAMOD_E_TRANSFORM;
+		}
+		if (reason != NULL) {
+			/* Error is reported for field assigned by expression. */
+			while (code[code_no].op != OP_STORE) {
+				code_no++;
+			}
+			return transform_error(fields[code[code_no].arg].name,
+				reason, ADAMOD_E_TRANSFORM);
+		}
+	}
+
+	/* Encode values of assigned fields. */
+	for (field_no = 0, pos = 0; field_no < assigned_count; field_no++) {
+		const struct TransformField *field = fields + field_no;
+		const struct Value *value = results + field_no;
+
+		/* Values not assigned for record are written as read. */
+		if (!modified[field_no]) {
+			memcpy(result_buf + pos, originals[field_no],
+				original_lens[field_no]);
+			pos += original_lens[field_no];
+			continue;
+		}
+
+		if (!value->text) {
+			if (!number_encode(field, value->number, result_buf + pos)) {
+				return transform_error(field->name,
+					"value doesn't fit field", ADAMOD_E_TRANSFORM);
+			}
+			pos += field->length;
+			continue;
+		}
+
+		/* Trailing blanks are dropped when text is too long. */
+		len = value->len;
+		while (field->length > 0 && len > (uint32_t) field->length
+			&& value->buf[len - 1] == ' ')
+		{
+			len--;
+		}
+		if (len > (field->length > 0 ? (uint32_t) field->length
+			: VARIABLE_VALUE_MAX))
+		{
+			return transform_error(field->name,
+				"value doesn't fit field", ADAMOD_E_TRANSFORM);
+		}
+		if (field->length == 0) {
+			result_buf[pos++] = (unsigned char) (len + 1);
+		}
+		memcpy(result_buf + pos, value->buf, len);
+		if (field->length > 0) {
+			memset(result_buf + pos + len, ' ', field->length - len);
+			len = field->length;
+		}
+		codepage_to_db(result_buf + pos, len);
+		pos += len;
+	}
+	*result_len = pos;
+
+	return ADAMOD_SUCCESS;
+}
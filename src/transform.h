@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if !defined(TRANSFORM_H)
+#define TRANSFORM_H
+
+#include <stdint.h>
+#include "fdt.h"
+
+/*
+ * Transformation computes new values of fields from their current
+ * values ("FIELD=expression[;FIELD=expression]..."). It is compiled
+ * once into bytecode of small stack machine, bound to field
+ * definitions of file and executed for every record read with hold.
+ * Records are read with format buffer of assigned fields followed by
+ * other used fields, so beginning of read record buffer is before-image
+ * of record buffer written with format buffer of assigned fields.
+ * Rules of rules file ("condition -> FIELD=expression[;...]") are
+ * compiled into the same bytecode and evaluated together, so every
+ * record is read and updated once by all of them.
+ */
+
+/* Compile transformation into bytecode. */
+int transform_parse(const char *expr);
+/* Compile rules file into bytecode. */
+int transform_rules(const char *file_name);
+/* Print numbers of records matched by rules. */
+void transform_report(void);
+/* Check whether transformation is specified. */
+int transform_enabled(void);
+/* Get format buffer of fields used by transformation. */
+const char *transform_read_format(void);
+/* Get format buffer of fields assigned by transformation. */
+const char *transform_write_format(void);
+/* Get maximal length of record buffers of transformation. */
+uint32_t transform_record_max(void);
+/* Bind transformation to field definitions of file. */
+int transform_bind(const struct FieldTable *table);
+/* Compute record buffer of assigned fields from read record buffer. */
+int transform_apply(const unsigned char *record_buf, uint32_t record_len,
+	unsigned char *result_buf, uint32_t *result_len, uint32_t *image_len);
+
+#endif /* TRANSFORM_H */
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include "adamod.h"
+#include "timer.h"
+#include "tune.h"
+
+/* Target duration of one read command (microseconds). */
+#define FETCH_TARGET_USEC 50000
+/* Minimal number of records or ISNs read by one command. */
+#define FETCH_MIN 16
+
+/* Current number of records per transaction. */
+static unsigned int commit_count = 0;
+/* Average rate of processing (records per second). */
+static double commit_rate = 0;
+/* Time of previous end of transaction. */
+static uint64_t commit_time = 0;
+
+/* Current and maximal number of records or ISNs read by one command. */
+static uint32_t fetch_size = 0;
+static uint32_t fetch_max = 0;
+
+/*
+ * Get number of records per transaction. Without upper bound number
+ * of records is fixed, otherwise it's tuned between bounds.
+ */
+unsigned int tune_commit_count(void)
+{
+	if (options.commit_max == 0) {
+		return options.commit_count;
+	}
+	if (commit_count == 0) {
+		commit_count = options.commit_count;
+		commit_time = timer_usec();
+	}
+
+	return commit_count;
+}
+
+/*
+ * Account ended transaction with its records and duration of ET.
+ * Transaction grows while commits take notable share of processing
+ * time, and shrinks when processing rate drops.
+ */
+void tune_commit(unsigned int records, uint64_t commit_usec)
+{
+	uint64_t now, elapsed;
+	double rate;
+
+	if (options.commit_max == 0 || records == 0) {
+		return;
+	}
+	tune_commit_count();
+
+	now = timer_usec();
+	elapsed = now > commit_time ? now - commit_time : 1;
+	commit_time = now;
+	rate = records * 1000000.0 / elapsed;
+
+	if (commit_rate > 0 && rate < commit_rate * 0.8) {
+		commit_count -= commit_count / 4;
+	} else if (commit_usec * 10 > elapsed) {
+		commit_count += commit_count / 4 + 1;
+	}
+	if (commit_count < options.commit_count) {
+		commit_count = options.commit_count;
+	}
+	if (commit_count > options.commit_max) {
+		commit_count = options.commit_max;
+	}
+
+	commit_rate = commit_rate > 0 ? (commit_rate * 3 + rate) / 4 : rate;
+}
+
+/*
+ * Account response of nucleus caused by too large transaction
+ * (hold queue overflow): number of records per transaction is halved.
+ */
+void tune_overload(void)
+{
+	if (options.commit_max == 0) {
+		return;
+	}
+	tune_commit_count();
+
+	commit_count /= 2;
+	if (commit_count < options.commit_count) {
+		commit_count = options.commit_count;
+	}
+	commit_rate = 0;
+}
+
+/*
+ * Get number of records or ISNs read by one command. Without tuning
+ * default size is used, otherwise size is tuned up to maximal size
+ * of command buffers.
+ */
+uint32_t tune_fetch_size(uint32_t default_size, uint32_t max_size)
+{
+	if (options.commit_max == 0) {
+		return default_size;
+	}
+	if (fetch_size == 0) {
+		fetch_size = default_size;
+	}
+	fetch_max = max_size;
+	if (fetch_size > fetch_max) {
+		fetch_size = fetch_max;
+	}
+
+	return fetch_size;
+}
+
+/*
+ * Account duration of read command: slow commands read less records,
+ * fast commands read more.
+ */
+void tune_fetch(uint64_t call_usec)
+{
+	if (options.commit_max == 0) {
+		return;
+	}
+
+	if (call_usec > FETCH_TARGET_USEC && fetch_size > FETCH_MIN) {
+		fetch_size /= 2;
+	} else if (call_usec < FETCH_TARGET_USEC / 4
+		&& fetch_size * 2 <= fetch_max)
+	{
+		fetch_size *= 2;
+	}
+}
+
+/*
+ * Print tuned sizes.
+ */
+void tune_report(void)
+{
+	if (options.commit_max > 0 && options.verbose_level > 1) {
+		fprintf(stderr, "Records per transaction: %u, "
+			"records per read: %lu\n", tune_commit_count(),
+			(unsigned long) fetch_size);
+	}
+}
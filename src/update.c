@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adamod.h"
+#include "coalesce.h"
+#include "codepage.h"
+#include "fdt.h"
+#include "input.h"
+#include "messages.h"
+#include "modify.h"
+#include "timer.h"
+#include "trace.h"
+#include "update.h"
+
+/* Size of update file buffer. */
+#define INPUT_BUF_SIZE (1024 * 1024)
+/* Maximal length of line of update file. */
+#define LINE_MAX_LEN 65535
+/* Interval of checking growth of regular file in follow mode. */
+#define FOLLOW_POLL_USEC 200000
+
+int fill_input(void);
+int read_modification(uint32_t *line_len);
+int parse_modification(char *line, uint32_t line_len);
+int dispatch_updates(void);
+int batch_expired(void);
+
+/* Update file and its buffer. */
+static struct InputStream update_file;
+static char *input_buf = NULL;
+static uint32_t input_pos = 0, input_len = 0;
+
+/* Line of update file and its number. */
+static char *line_buf = NULL;
+static AdamodIsn line_no = 0;
+
+/* Pending modifications of records. */
+static struct Coalescer coalescer;
+/* Field definitions for translation of alphanumeric values. */
+static struct FieldTable field_table;
+static struct RecordLayout layout;
+/* Number of modifications read since last dispatch. */
+static unsigned int window_modifications = 0;
+/* Number of updated records. */
+static AdamodIsn updated_records = 0;
+
+/* Number of dispatched batches and arrival time of their first rows. */
+static AdamodIsn batch_count = 0;
+static uint64_t batch_start_usec = 0;
+
+/*
+ * Read next portion of update file into input buffer (returns
+ * ADAMOD_M_DONE at the end of file). In follow mode pending batch is
+ * dispatched when its deadline comes before new data, and reading
+ * continues after the end of file until standard input is closed.
+ */
+int fill_input(void)
+{
+	int result_code;
+	long len;
+	uint64_t now_usec, deadline_usec;
+
+	for (;;) {
+		/* Pause or stop processing on request. */
+		result_code = check_control();
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+
+		if (options.follow_mode && window_modifications > 0) {
+			now_usec = timer_usec();
+			deadline_usec = batch_start_usec
+				+ (uint64_t) options.batch_latency * 1000;
+			result_code = input_wait(&update_file,
+				deadline_usec > now_usec
+				? deadline_usec - now_usec : 0);
+			trace_span("input wait", "wait", now_usec, timer_usec());
+			if (result_code < 0 && errno == EINTR) {
+				continue;
+			}
+			if (result_code < 0) {
+				return ADAMOD_E_INPUT_IO;
+			}
+			if (result_code == 0) {
+				result_code = dispatch_updates();
+				if (result_code != ADAMOD_SUCCESS) {
+					return result_code;
+				}
+				continue;
+			}
+		}
+
+		/* Waiting for data is interrupted by control signals. */
+		now_usec = timer_usec();
+		len = input_read(&update_file, input_buf, INPUT_BUF_SIZE);
+		trace_span("input read", "wait", now_usec, timer_usec());
+		if (len < 0 && errno == EINTR) {
+			continue;
+		}
+		if (len < 0) {
+			return ADAMOD_E_INPUT_IO;
+		}
+		if (len > 0) {
+			input_pos = 0;
+			input_len = (uint32_t) len;
+			return ADAMOD_SUCCESS;
+		}
+
+		/* End of file. */
+		if (!options.follow_mode || update_file.file_name == NULL) {
+			return ADAMOD_M_DONE;
+		}
+
+		/* Modifications are not held while waiting for writer. */
+		if (window_modifications > 0) {
+			result_code = dispatch_updates();
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+		}
+		if (update_file.fifo) {
+			if (input_reopen(&update_file) != ADAMOD_SUCCESS) {
+				return ADAMOD_E_INPUT_IO;
+			}
+		} else {
+			timer_sleep(FOLLOW_POLL_USEC);
+		}
+	}
+}
+
+/*
+ * Read next non-empty line of update file (returns ADAMOD_M_DONE
+ * at the end of file). Line terminator is not included in line.
+ */
+int read_modification(uint32_t *line_len)
+{
+	int result_code;
+	char c;
+	uint32_t len;
+
+	do {
+		line_no++;
+		len = 0;
+		for (;;) {
+			if (input_pos == input_len) {
+				result_code = fill_input();
+				if (result_code == ADAMOD_M_DONE && len > 0) {
+					/* Last line without terminator. */
+					break;
+				}
+				if (result_code != ADAMOD_SUCCESS) {
+					return result_code;
+				}
+			}
+			c = input_buf[input_pos++];
+			if (c == '\n') {
+				break;
+			}
+			if (len >= LINE_MAX_LEN) {
+				return ADAMOD_E_INVUPDATE;
+			}
+			line_buf[len++] = c;
+		}
+		if (len > 0 && line_buf[len - 1] == '\r') {
+			len--;
+		}
+	} while (len == 0);
+
+	*line_len = len;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Parse line of update file ("isn formatbuf.recordbuf") and add
+ * modification to pending records.
+ */
+int parse_modification(char *line, uint32_t line_len)
+{
+	AdamodIsn isn;
+	uint32_t pos = 0;
+	uint32_t format_pos;
+	char delimiter;
+
+	/* ISN is separated from buffers by spaces or tabs. */
+	while (pos < line_len && line[pos] != ' ' && line[pos] != '\t') {
+		pos++;
+	}
+	if (pos == line_len) {
+		return ADAMOD_E_INVUPDATE;
+	}
+	delimiter = line[pos];
+	line[pos] = '\0';
+	if (parse_isn(line, &isn) != ADAMOD_SUCCESS || isn == 0) {
+		return ADAMOD_E_INVUPDATE;
+	}
+	line[pos] = delimiter;
+	while (pos < line_len && (line[pos] == ' ' || line[pos] == '\t')) {
+		pos++;
+	}
+
+	/* Format buffer is ended with '.', record buffer follows it. */
+	format_pos = pos;
+	while (pos < line_len && line[pos] != '.') {
+		pos++;
+	}
+	if (pos == line_len) {
+		return ADAMOD_E_INVUPDATE;
+	}
+	pos++;
+
+	/* Alphanumeric values are translated to codepage of database. */
+	if (codepage_enabled()
+		&& (layout_compile(&field_table, line + format_pos,
+			pos - format_pos, &layout) != ADAMOD_SUCCESS
+		|| codepage_record(&layout, (unsigned char *) line + pos,
+			line_len - pos, 1) != ADAMOD_SUCCESS))
+	{
+		return ADAMOD_E_INVUPDATE;
+	}
+
+	return coalescer_add(&coalescer, isn, line + format_pos,
+		pos - format_pos, line + pos, line_len - pos);
+}
+
+/*
+ * Modify pending records in order of their first modification, every
+ * record with merged values of its fields.
+ */
+int dispatch_updates(void)
+{
+	int result_code;
+	uint32_t record_no;
+	AdamodIsn isn;
+	char *format_buf, *record_buf;
+	uint32_t format_buf_len, record_buf_len;
+
+	for (record_no = 0; record_no < coalescer_count(&coalescer);
+		record_no++)
+	{
+		result_code = coalescer_get(&coalescer, record_no, &isn,
+			&format_buf, &format_buf_len, &record_buf,
+			&record_buf_len);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+
+		result_code = modify_fields(isn, format_buf, format_buf_len,
+			record_buf, record_buf_len);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+		updated_records++;
+	}
+
+	/* In follow mode every batch is committed and reported. */
+	if (options.follow_mode && window_modifications > 0) {
+		result_code = end_transaction();
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+
+		batch_count++;
+		trace_span("batch", "batch", batch_start_usec, timer_usec());
+		if (options.verbose_level > 0) {
+			fprintf(stderr, "Batch %llu: %u modifications, "
+				"%lu records, latency %lu ms\n",
+				(unsigned long long) batch_count,
+				window_modifications,
+				(unsigned long) coalescer_count(&coalescer),
+				(unsigned long) ((timer_usec() - batch_start_usec)
+					/ 1000));
+		}
+	}
+
+	coalescer_clear(&coalescer);
+	window_modifications = 0;
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Check whether deadline of pending batch has come.
+ */
+int batch_expired(void)
+{
+	return timer_usec() - batch_start_usec
+		>= (uint64_t) options.batch_latency * 1000;
+}
+
+/*
+ * Modify records with values read from update file. Modifications are
+ * collected in window of specified size, so several modifications of
+ * the same record are merged and the record is updated once. In follow
+ * mode update file is read as endless feed and every batch is committed
+ * when window is full or its deadline has come.
+ */
+int update_file_records(void)
+{
+	int result_code;
+	time_t start_time, prev_time;
+	AdamodIsn rec_no = 0;
+	uint32_t line_len;
+
+	line_buf = malloc(LINE_MAX_LEN);
+	input_buf = malloc(INPUT_BUF_SIZE);
+	if (line_buf == NULL || input_buf == NULL) {
+		free(line_buf);
+		free(input_buf);
+		return ADAMOD_E_NOMEMORY;
+	}
+	coalescer_init(&coalescer);
+
+	/* Formats of fields are needed for translation of values. */
+	field_table.fields = NULL;
+	field_table.count = 0;
+	if (codepage_enabled()) {
+		result_code = fdt_load(&field_table);
+		if (result_code != ADAMOD_SUCCESS) {
+			free(line_buf);
+			free(input_buf);
+			return result_code;
+		}
+	}
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	result_code = input_open(&update_file, options.update_file_name);
+	while (result_code == ADAMOD_SUCCESS
+		&& (result_code = read_modification(&line_len))
+			== ADAMOD_SUCCESS)
+	{
+		/* Increase modifications counter. */
+		rec_no++;
+
+		result_code = parse_modification(line_buf, line_len);
+		if (result_code != ADAMOD_SUCCESS) {
+			if (options.verbose_level > 0) {
+				fprintf(stderr, "Invalid modification at line "
+					"%llu\n", (unsigned long long) line_no);
+			}
+			break;
+		}
+
+		/* Deadline of batch is counted from its first row. */
+		if (window_modifications == 0) {
+			batch_start_usec = timer_usec();
+		}
+
+		/*
+		 * Dispatch pending records when window is full
+		 * or deadline of batch has come.
+		 */
+		window_modifications++;
+		if (window_modifications >= options.coalesce_window
+			|| (options.follow_mode && batch_expired()))
+		{
+			result_code = dispatch_updates();
+		}
+
+		/* Print process status. */
+		print_progress(rec_no, &prev_time);
+	}
+	/* Pending modifications are dispatched at the end and on stop. */
+	if (result_code == ADAMOD_M_DONE) {
+		result_code = dispatch_updates();
+	} else if (result_code == ADAMOD_M_STOPPED
+		&& dispatch_updates() != ADAMOD_SUCCESS)
+	{
+		result_code = ADAMOD_E_ADABAS_A1;
+	}
+
+	if (options.verbose_level > 0) {
+		fprintf(stderr, "Updated records: %llu (merged modifications: "
+			"%llu)\n", (unsigned long long) updated_records,
+			(unsigned long long) coalescer.merged);
+	}
+
+	/* Close update file. */
+	input_close(&update_file);
+	free(input_buf);
+	free(line_buf);
+	coalescer_free(&coalescer);
+	fdt_free(&field_table);
+
+	/* Print used time. */
+	if (result_code == ADAMOD_SUCCESS) {
+		print_summary(rec_no, start_time);
+	}
+
+	return result_code;
+}
@@ -0,0 +1,605 @@
+/*
+ * Copyright (c) 2012, Alexander Fronkin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adacall.h"
+#include "adamod.h"
+#include "codepage.h"
+#include "control.h"
+#include "fdt.h"
+#include "messages.h"
+#include "modify.h"
+#include "search.h"
+#include "shard.h"
+#include "timer.h"
+#include "transform.h"
+#include "tune.h"
+#include "verify.h"
+
+/* Size of record buffer for multi-fetch reading. */
+#define RECORD_BUF_SIZE (256 * 1024)
+/*
+ * Number of consecutive ISNs sampled together, so records of sample
+ * are still read with multi-fetch.
+ */
+#define SAMPLE_BLOCK 256
+/* Interval of polling shard directory while chunks are leased. */
+#define SHARD_POLL_USEC 5000000
+
+int prepare_verification(void);
+int isn_sampled(AdamodIsn isn);
+int next_verified(const struct IsnSet *selection, AdamodIsn isn,
+	AdamodIsn *next_isn);
+uint32_t verify_fetch_size(const struct IsnSet *selection, AdamodIsn isn,
+	AdamodIsn last_isn);
+int report_record(AdamodIsn isn, int missing);
+int report_missing(const struct IsnSet *selection, AdamodIsn first_isn,
+	AdamodIsn last_isn);
+int verify_record(AdamodIsn isn, const unsigned char *record,
+	uint32_t record_len);
+int verify_range(struct ShardLease *lease, AdamodIsn first_isn,
+	AdamodIsn last_isn, const struct IsnSet *selection, int *last);
+int verify_shard(void);
+
+/* Format buffer of verified fields and their expected values. */
+static char *verify_format_buf = NULL;
+static uint32_t verify_format_len = 0;
+static char *expected_buf = NULL;
+static uint32_t expected_len = 0;
+
+/* Maximal length of record read by verification. */
+static uint32_t record_max = 0;
+
+/* Buffers of read records and of records computed by transformation. */
+static unsigned char *record_buf = NULL;
+static unsigned char *result_buf = NULL;
+
+/* Numbers of verified, mismatching and missing records. */
+static AdamodIsn rec_no = 0;
+static AdamodIsn mismatching_records = 0;
+static AdamodIsn missing_records = 0;
+static time_t prev_time;
+
+/*
+ * Prepare format buffer and expected values of verified fields and
+ * check them against field definitions of file. Transformation is
+ * verified by its repeated application, which should change nothing.
+ */
+int prepare_verification(void)
+{
+	struct FieldTable table;
+	struct RecordLayout layout;
+	int result_code;
+
+	result_code = fdt_load(&table);
+	if (result_code != ADAMOD_SUCCESS) {
+		return result_code;
+	}
+
+	if (transform_enabled()) {
+		result_code = transform_bind(&table);
+		fdt_free(&table);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+
+		verify_format_buf = (char *) transform_read_format();
+		verify_format_len = strlen(verify_format_buf);
+		record_max = transform_record_max();
+		result_buf = malloc(record_max);
+		if (result_buf == NULL) {
+			return ADAMOD_E_NOMEMORY;
+		}
+		return ADAMOD_SUCCESS;
+	}
+
+	verify_format_buf = (char *) options.modify_arg;
+	expected_buf = strchr(options.modify_arg, '.') + 1;
+	verify_format_len = expected_buf - verify_format_buf;
+	expected_len = strlen(expected_buf);
+	record_max = expected_len > 0 ? expected_len : 1;
+
+	result_code = layout_compile(&table, verify_format_buf,
+		verify_format_len, &layout);
+	fdt_free(&table);
+	if (result_code == ADAMOD_SUCCESS) {
+		result_code = layout_check(&layout,
+			(const unsigned char *) expected_buf, expected_len);
+	}
+	if (result_code == ADAMOD_SUCCESS) {
+		/* Values are stored in codepage of database. */
+		codepage_record(&layout, (unsigned char *) expected_buf,
+			expected_len, 1);
+	} else if (result_code == ADAMOD_E_INVFORMAT && codepage_enabled()) {
+		result_code = ADAMOD_E_INVMODIFY;
+	} else if (result_code == ADAMOD_E_INVFORMAT) {
+		/* Values are compared as they are specified. */
+		result_code = ADAMOD_SUCCESS;
+	}
+
+	return result_code;
+}
+
+/*
+ * Check whether ISN belongs to sample of verified records. Sample
+ * consists of blocks of consecutive ISNs chosen by hash of block
+ * number, so the same records are sampled by every run.
+ */
+int isn_sampled(AdamodIsn isn)
+{
+	uint32_t hash;
+
+	if (options.sample_percent >= 100.0) {
+		return 1;
+	}
+
+	/* Upper bits of multiplicative hash are uniform in [0, 65536). */
+	hash = (uint32_t) (isn / SAMPLE_BLOCK * 2654435761UL) >> 16;
+
+	return hash < options.sample_percent * 655.36;
+}
+
+/*
+ * Get the first ISN not less than specified one to be verified: ISN
+ * of selected record (any ISN without selection) of sample. Returns 0
+ * when no selected records follow.
+ */
+int next_verified(const struct IsnSet *selection, AdamodIsn isn,
+	AdamodIsn *next_isn)
+{
+	struct IsnSetIterator iterator;
+
+	if (selection == NULL) {
+		while (!isn_sampled(isn)) {
+			isn = (isn / SAMPLE_BLOCK + 1) * SAMPLE_BLOCK;
+		}
+		*next_isn = isn;
+		return 1;
+	}
+
+	isn_set_seek(selection, &iterator, isn);
+	while (isn_set_next(selection, &iterator, next_isn)) {
+		if (isn_sampled(*next_isn)) {
+			return 1;
+		}
+
+		/* The rest of block is not sampled. */
+		isn_set_seek(selection, &iterator,
+			(*next_isn / SAMPLE_BLOCK + 1) * SAMPLE_BLOCK);
+	}
+
+	return 0;
+}
+
+/*
+ * Get number of records read by multi-fetch from verified ISN. Read
+ * records are limited by sampled block and, when records are
+ * selected, by span of selected ISNs: records are read one by one
+ * where selected ISNs are sparse.
+ */
+uint32_t verify_fetch_size(const struct IsnSet *selection, AdamodIsn isn,
+	AdamodIsn last_isn)
+{
+	struct IsnSetIterator iterator;
+	AdamodIsn selected_isn, end_isn = last_isn;
+	uint32_t fetch_size, selected_count = 0;
+
+	fetch_size = tune_fetch_size(MULTIFETCH_MAX, MULTIFETCH_MAX);
+	if (fetch_size > RECORD_BUF_SIZE / record_max) {
+		fetch_size = RECORD_BUF_SIZE / record_max;
+	}
+	if (fetch_size < 1) {
+		fetch_size = 1;
+	}
+	if (options.sample_percent < 100.0
+		&& end_isn > (isn / SAMPLE_BLOCK + 1) * SAMPLE_BLOCK - 1)
+	{
+		end_isn = (isn / SAMPLE_BLOCK + 1) * SAMPLE_BLOCK - 1;
+	}
+	if (end_isn - isn + 1 < fetch_size) {
+		fetch_size = (uint32_t) (end_isn - isn + 1);
+	}
+	if (selection == NULL) {
+		return fetch_size;
+	}
+
+	/*
+	 * Records are read up to the last selected ISN, before which at
+	 * least half of ISNs are selected.
+	 */
+	isn_set_seek(selection, &iterator, isn);
+	end_isn = isn;
+	while (isn_set_next(selection, &iterator, &selected_isn)
+		&& selected_isn - isn < fetch_size)
+	{
+		selected_count++;
+		if (selected_count * 2 >= selected_isn - isn + 1) {
+			end_isn = selected_isn;
+		}
+	}
+
+	return (uint32_t) (end_isn - isn + 1);
+}
+
+/*
+ * Count mismatching or missing record and write its ISN to ISN log.
+ */
+int report_record(AdamodIsn isn, int missing)
+{
+	if (missing) {
+		missing_records++;
+	} else {
+		mismatching_records++;
+	}
+
+	if (options.verbose_level > 1) {
+		fprintf(stderr, "\rRecord %llu %s\n", (unsigned long long) isn,
+			missing ? "is missing" : "doesn't match modification");
+	}
+
+	if (isn_writer_put(&isn_log, isn) != ADAMOD_SUCCESS) {
+		return ADAMOD_E_LOG_IO;
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Report selected records of sample with ISNs in range as missing.
+ */
+int report_missing(const struct IsnSet *selection, AdamodIsn first_isn,
+	AdamodIsn last_isn)
+{
+	struct IsnSetIterator iterator;
+	AdamodIsn isn;
+	int result_code;
+
+	if (selection == NULL) {
+		return ADAMOD_SUCCESS;
+	}
+
+	isn_set_seek(selection, &iterator, first_isn);
+	while (isn_set_next(selection, &iterator, &isn) && isn <= last_isn) {
+		if (!isn_sampled(isn) || isn_excluded(isn)) {
+			continue;
+		}
+		result_code = report_record(isn, 1);
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Compare read fields of record with values of modification.
+ */
+int verify_record(AdamodIsn isn, const unsigned char *record,
+	uint32_t record_len)
+{
+	uint32_t result_len, image_len;
+	int matched;
+
+	if (isn_excluded(isn)) {
+		return ADAMOD_SUCCESS;
+	}
+	rec_no++;
+
+	if (transform_enabled()) {
+		matched = transform_apply(record, record_len, result_buf,
+			&result_len, &image_len) == ADAMOD_SUCCESS
+			&& result_len == image_len
+			&& memcmp(result_buf, record, image_len) == 0;
+	} else {
+		matched = record_len == expected_len
+			&& memcmp(record, expected_buf, expected_len) == 0;
+	}
+
+	print_progress(rec_no, &prev_time);
+
+	return matched ? ADAMOD_SUCCESS : report_record(isn, 0);
+}
+
+/*
+ * Read records of ISN range in sequence of ISNs with multi-fetch and
+ * verify selected records of sample. Selected records not returned by
+ * command are missing. Flag last is set when no records follow the
+ * range.
+ */
+int verify_range(struct ShardLease *lease, AdamodIsn first_isn,
+	AdamodIsn last_isn, const struct IsnSet *selection, int *last)
+{
+	int result_code;
+	AdamodIsn isn = first_isn;
+	ACBX acbx;
+	ABD fb_abd, rb_abd, mb_abd;
+	ABD *abds[3];
+	unsigned char multifetch_buf[MULTIFETCH_BUF_SIZE];
+	uint32_t entry_count, entry_no, record_pos;
+
+	/*
+	 * Prepare Adabas direct call control block.
+	 * Command L1 (Read Record) with option 'I': read record with
+	 * specified ISN or with the next higher one.
+	 */
+	acbx_init(&acbx, "L1", options.db_id, options.file_no);
+	memcpy(acbx.acbxcid, "AMOV", 4);
+	abd_init(&fb_abd, ABD_FORMAT, verify_format_buf, verify_format_len,
+		verify_format_len);
+	abd_init(&rb_abd, ABD_RECORD, record_buf, RECORD_BUF_SIZE, 0);
+	abd_init(&mb_abd, ABD_MULTIFETCH, multifetch_buf,
+		sizeof(multifetch_buf), 0);
+	abds[0] = &fb_abd;
+	abds[1] = &rb_abd;
+	abds[2] = &mb_abd;
+
+	*last = 0;
+	while (isn <= last_isn && next_verified(selection, isn, &isn)
+		&& isn <= last_isn)
+	{
+		/* Pause or stop processing on request. */
+		result_code = check_control();
+		if (result_code == ADAMOD_SUCCESS && lease != NULL) {
+			result_code = shard_renew(lease);
+		}
+		if (result_code != ADAMOD_SUCCESS) {
+			return result_code;
+		}
+
+		/* Command option 1 'M': read records with multi-fetch. */
+		acbx.acbxcop[0] = 'M';
+		acbx.acbxcop[1] = 'I';
+		acbx.acbxisn = isn;
+		acbx.acbxisl = verify_fetch_size(selection, isn, last_isn);
+
+		/* Execute Adabas direct call command L1. */
+		if (adabas_call(&acbx, 3, abds) != ADA_NORMAL) {
+			/* There are no records after read ones. */
+			if (acbx.acbxrsp == ADA_EOF) {
+				*last = 1;
+				return report_missing(selection, isn, last_isn);
+			}
+
+			if (options.verbose_level > 0) {
+				dump_adabas_cb(&acbx);
+			}
+			return ADAMOD_E_ADABAS_L1;
+		}
+
+		tune_fetch(adabas_call_usec());
+		entry_count = multifetch_count(multifetch_buf);
+		if (entry_count == 0 || entry_count > MULTIFETCH_MAX) {
+			return ADAMOD_E_INVRECORD;
+		}
+
+		record_pos = 0;
+		for (entry_no = 0; entry_no < entry_count; entry_no++) {
+			struct MultifetchEntry entry;
+
+			multifetch_entry(multifetch_buf, entry_no, &entry);
+			if (entry.response == ADA_EOF) {
+				*last = 1;
+				return report_missing(selection, isn, last_isn);
+			}
+			if (entry.response != ADA_NORMAL) {
+				continue;
+			}
+			if (record_pos + entry.record_len > RECORD_BUF_SIZE) {
+				return ADAMOD_E_INVRECORD;
+			}
+			if (entry.isn > last_isn) {
+				return report_missing(selection, isn, last_isn);
+			}
+
+			/* Records with ISNs skipped by command don't exist. */
+			result_code = entry.isn > isn
+				? report_missing(selection, isn, entry.isn - 1)
+				: ADAMOD_SUCCESS;
+			if (result_code == ADAMOD_SUCCESS
+				&& (selection == NULL
+				|| isn_set_contains(selection, entry.isn))
+				&& isn_sampled(entry.isn))
+			{
+				result_code = verify_record(entry.isn,
+					record_buf + record_pos, entry.record_len);
+			}
+			if (result_code != ADAMOD_SUCCESS) {
+				return result_code;
+			}
+			record_pos += entry.record_len;
+			isn = entry.isn + 1;
+		}
+	}
+
+	return ADAMOD_SUCCESS;
+}
+
+/*
+ * Verify records of job shared with other processes by leases of ISN
+ * ranges in shard directory.
+ */
+int verify_shard(void)
+{
+	int result_code = ADAMOD_SUCCESS;
+	struct IsnSet set;
+	struct ShardLease lease;
+	ShardClaim claim;
+	AdamodIsn isn;
+	int owner_flag, last, waiting = 0;
+
+	/* Processes work on snapshot of selection made by one of them. */
+	shard_open();
+	isn_set_init(&set);
+	if (options.search_count > 0) {
+		result_code = shard_selection(&set, &owner_flag);
+		if (result_code == ADAMOD_SUCCESS && owner_flag) {
+			result_code = select_isn_set(&set);
+			if (result_code == ADAMOD_SUCCESS) {
+				result_code = shard_save_selection(&set);
+			}
+		}
+	}
+
+	while (result_code == ADAMOD_SUCCESS) {
+		result_code = shard_claim(&lease, &claim);
+		if (result_code != ADAMOD_SUCCESS || claim == SHARD_DONE) {
+			break;
+		}
+
+		/* Remaining chunks are leased by other processes. */
+		if (claim == SHARD_BUSY) {
+			if (!waiting && options.verbose_level > 0) {
+				fputs("\rWaiting for chunks leased by other processes\n",
+					stderr);
+			}
+			waiting = 1;
+			result_code = check_control();
+			if (result_code == ADAMOD_SUCCESS) {
+				timer_sleep(SHARD_POLL_USEC);
+			}
+			continue;
+		}
+		waiting = 0;
+
+		result_code = verify_range(&lease, lease.first_isn, lease.last_isn,
+			options.search_count > 0 ? &set : NULL, &last);
+
+		/* Selection may end before end of file. */
+		if (result_code == ADAMOD_SUCCESS && options.search_count > 0) {
+			last = !next_verified(&set, lease.last_isn + 1, &isn);
+		}
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = isn_writer_flush(&isn_log);
+		}
+
+		if (result_code == ADAMOD_SUCCESS) {
+			result_code = shard_complete(&lease, last);
+		} else if (result_code == ADAMOD_E_SHARD_LOST) {
+			/* Chunk is verified again by process which took it over. */
+			if (options.verbose_level > 0) {
+				fprintf(stderr, "\rLease of chunk %lu lost\n",
+					(unsigned long) lease.chunk_no);
+			}
+			result_code = ADAMOD_SUCCESS;
+		} else {
+			shard_release(&lease);
+		}
+	}
+	isn_set_free(&set);
+
+	return result_code;
+}
+
+/*
+ * Verify modification of records in specified Adabas file: read
+ * modified fields of selected records (all records of file without
+ * selection) and write ISNs of mismatching and missing records to
+ * ISN log.
+ */
+int verify_file_records(void)
+{
+	int return_code;
+	char db_options[30];
+	time_t start_time;
+	struct IsnSet set;
+	int last;
+
+	record_buf = malloc(RECORD_BUF_SIZE);
+	if (record_buf == NULL) {
+		return ADAMOD_E_NOMEMORY;
+	}
+
+	/* Open Adabas database for reading. */
+	sprintf(db_options, "ACC=%d.", options.file_no);
+	if (db_open(options.db_id, db_options) != ADA_NORMAL) {
+		free(record_buf);
+		return ADAMOD_E_ADABAS_OP;
+	}
+
+	return_code = prepare_verification();
+	if (return_code != ADAMOD_SUCCESS) {
+		db_close(options.db_id);
+		free(result_buf);
+		free(record_buf);
+		return return_code;
+	}
+
+	/* Processing may be paused and stopped by signals. */
+	control_init();
+
+	/* Get process start time. */
+	time(&start_time);
+	prev_time = start_time;
+
+	if (options.shard_dir_name != NULL) {
+		/* Ranges of ISNs are verified by several processes. */
+		return_code = verify_shard();
+	} else if (options.isn > 0 || options.search_count > 0) {
+		/* Selected records are read in order of ISNs. */
+		isn_set_init(&set);
+		return_code = options.isn > 0 ? isn_set_add(&set, options.isn)
+			: select_isn_set(&set);
+		if (return_code == ADAMOD_SUCCESS) {
+			return_code = verify_range(NULL, 1, ~(AdamodIsn) 0, &set,
+				&last);
+		}
+		isn_set_free(&set);
+	} else {
+		return_code = verify_range(NULL, 1, ~(AdamodIsn) 0, NULL, &last);
+	}
+
+	/* Close Adabas database. */
+	if (db_close(options.db_id) != ADA_NORMAL
+		&& return_code == ADAMOD_SUCCESS)
+	{
+		return_code = ADAMOD_E_ADABAS_CL;
+	}
+	free(result_buf);
+	free(record_buf);
+
+	if (return_code == ADAMOD_SUCCESS || return_code == ADAMOD_M_STOPPED) {
+		fprintf(stderr, "\rVerified records: %llu, mismatching: %llu, "
+			"missing: %llu\n", (unsigned long long) rec_no,
+			(unsigned long long) mismatching_records,
+			(unsigned long long) missing_records);
+		print_summary(rec_no, start_time);
+	}
+
+	/* Records to be processed again are reported as failure. */
+	if (return_code == ADAMOD_SUCCESS
+		&& mismatching_records + missing_records > 0)
+	{
+		return_code = ADAMOD_E_VERIFY;
+	}
+
+	return return_code;
+}